@@ -0,0 +1,103 @@
+// tupperware container lib
+// tw_alloc_arena.h
+
+/*
+ * tw_alloc_arena.h
+ *
+ * A bump allocator for containers which live only for the length of a request (or similar),
+ * and are thrown away all at once.
+ */
+
+#ifndef TW_ALLOC_ARENA_H_
+#define TW_ALLOC_ARENA_H_
+
+#include <TW/tw_alloc.h>
+
+// default size of each chunk the arena bump allocates from
+#ifndef TW_ARENA_CHUNK_SIZE
+#define TW_ARENA_CHUNK_SIZE (32*1024)
+#endif
+
+// all allocations are aligned to this (same as glibc malloc)
+#define TW_ARENA_ALIGN 16
+
+namespace TWlib {
+
+/**
+ * Arena allocator. Memory is bump allocated out of a chain of chunks, free() is a no-op,
+ * and reset() releases everything allocated from the arena at once - so tearing down a
+ * request's worth of containers costs O(chunks) rather than O(nodes).
+ *
+ * The static calls (which the containers use as their ALLOC) allocate from the calling thread's
+ * current arena, which is set with an Alloc_Arena::Scope:
+ *
+ *   Alloc_Arena arena;
+ *   {
+ *      Alloc_Arena::Scope s(arena);
+ *      TW_KHash_32<int, Thing, TW_NoMutex, eqint, Allocator<Alloc_Arena> > table;
+ *      ... // everything table allocates comes from arena
+ *   }
+ *   arena.reset();
+ *
+ * If a thread has no current arena, malloc() returns NULL.
+ * An arena is not thread safe - it is meant to be used by one thread at a time.
+ * Containers using an arena should be destroyed (or abandoned) before reset() is called.
+ */
+class Alloc_Arena {
+public:
+	class Scope {
+	public:
+		Scope(Alloc_Arena &a) : _prev(Alloc_Arena::current()) { Alloc_Arena::setCurrent(&a); }
+		~Scope() { Alloc_Arena::setCurrent(_prev); }
+	protected:
+		Alloc_Arena *_prev;
+	};
+
+	Alloc_Arena(tw_size chunksize = TW_ARENA_CHUNK_SIZE);
+	~Alloc_Arena(); // releases all memory
+
+	// these allocate from this arena, whatever the thread's current arena is
+	void *i_malloc(tw_size nbytes);
+	void *i_calloc(tw_size nelem, tw_size elemsize);
+	void *i_realloc(void *d, tw_size s);
+	void i_free(void *p) { } // memory is released by reset()
+
+	// releases everything allocated from the arena. Keeps the first chunk for reuse.
+	void reset();
+	// bytes handed out since the last reset()
+	size_t bytesUsed() { return _used; }
+	int chunks() { return _nchunks; }
+
+	static Alloc_Arena *current();
+	static void setCurrent(Alloc_Arena *a);
+
+	// the ALLOC contract - these use the current arena
+	static void *malloc (tw_size nbytes) { Alloc_Arena *a = current(); return a ? a->i_malloc(nbytes) : NULL; }
+	static void *calloc (tw_size nelem, tw_size elemsize) { Alloc_Arena *a = current(); return a ? a->i_calloc(nelem, elemsize) : NULL; }
+	static void *realloc(void *d, tw_size s) { Alloc_Arena *a = current(); return a ? a->i_realloc(d, s) : NULL; }
+	static void free(void *p) { }
+	static void sync(void *addr, tw_size len, int flags = 0) { } // does nothing - not shared memory
+	static void *memcpy(void *d, const void *s, size_t n) { return ::memcpy(d,s,n); };
+	static void *memmove(void *d, const void *s, size_t n) { return ::memmove(d,s,n); };
+	static int memcmp(void *l, void *r, size_t n) { return ::memcmp(l, r, n); }
+	static void *memset(void *d, int c, size_t n) { return ::memset(d,c,n); }
+	static const char *ALLOC_NOMEM_ERROR_MESSAGE;
+protected:
+	struct chunk {
+		chunk *next;
+		size_t size;  // usable bytes after the chunk header
+		size_t used;
+	};
+	chunk *newChunk(size_t size);
+	void *bump(chunk *c, tw_size nbytes);
+
+	chunk *_head;     // the chunk being bumped from. The rest are chained behind it.
+	tw_size _chunksize;
+	size_t _used;
+	int _nchunks;
+	void *_last;      // last allocation - realloc() can grow it in place
+};
+
+}
+
+#endif /* TW_ALLOC_ARENA_H_ */
@@ -0,0 +1,338 @@
+// tupperware container lib
+// tw_alloc_magazine.h
+
+/*
+ * tw_alloc_magazine.h
+ *
+ * A per-thread caching layer which can sit on top of any Alloc_* policy:
+ *   typedef Allocator<Alloc_Magazine<Alloc_Std> > MyAlloc;
+ *
+ * This is the 'magazine' scheme of Bonwick & Adams ("Magazines and Vmem", USENIX 2001).
+ */
+
+#ifndef TW_ALLOC_MAGAZINE_H_
+#define TW_ALLOC_MAGAZINE_H_
+
+#include <pthread.h>
+
+#include <TW/tw_alloc.h>
+
+// number of blocks a magazine holds
+#ifndef TW_MAGAZINE_ROUNDS
+#define TW_MAGAZINE_ROUNDS 32
+#endif
+
+// max number of loaded magazines the shared depot keeps per size class. Beyond this, blocks go back to the base allocator.
+#ifndef TW_MAGAZINE_DEPOT_MAX
+#define TW_MAGAZINE_DEPOT_MAX 64
+#endif
+
+// size classes are powers of two from 16 to 16 << (TW_MAGAZINE_NUM_CLASSES-1) (1024). Anything bigger is not cached.
+#define TW_MAGAZINE_NUM_CLASSES 7
+#define TW_MAGAZINE_MIN_BLOCK 16
+#define TW_MAGAZINE_HDR_SIZE 16
+
+namespace TWlib {
+
+/**
+ * Caches recently freed blocks in per-thread 'magazines' (small stacks of blocks) per size class.
+ * Each thread has a loaded and a previous magazine per class: malloc() pops, free() pushes, and
+ * when both are empty / full a whole magazine is swapped with the shared depot under one lock.
+ *
+ * A block freed by a thread which did not allocate it just goes in the freeing thread's magazine,
+ * so a producer allocating and a consumer freeing never touch the same lock per block - blocks
+ * flow back to the producer a magazine at a time through the depot.
+ *
+ * BASE is any Alloc_* policy. A small header in front of each block records its size class.
+ */
+template <class BASE>
+struct Alloc_Magazine {
+	static void *malloc (tw_size nbytes);
+	static void *calloc (tw_size nelem, tw_size elemsize);
+	static void *realloc(void *d, tw_size s);
+	static void free(void *p);
+	static void sync(void *addr, tw_size len, int flags = 0) { BASE::sync(addr,len,flags); }
+	static void *memcpy(void *d, const void *s, size_t n) { return BASE::memcpy(d,s,n); };
+	static void *memmove(void *d, const void *s, size_t n) { return BASE::memmove(d,s,n); };
+	static int memcmp(void *l, void *r, size_t n) { return BASE::memcmp(l, r, n); }
+	static void *memset(void *d, int c, size_t n) { return BASE::memset(d,c,n); }
+	static const char *ALLOC_NOMEM_ERROR_MESSAGE;
+
+	// returns the calling thread's magazines to the depot. Done automatically on thread exit.
+	static void releaseThreadCache();
+	// number of loaded magazines sitting in the depot (all classes)
+	static int depotMagazines();
+protected:
+	struct magazine {
+		magazine *next;
+		int count;
+		void *rounds[TW_MAGAZINE_ROUNDS];
+	};
+	struct classcache {
+		magazine *loaded;
+		magazine *previous;
+	};
+	struct threadcache {
+		classcache cls[TW_MAGAZINE_NUM_CLASSES];
+	};
+	struct depot {
+		pthread_mutex_t mutex;
+		magazine *full;
+		int nfull;
+		magazine *empty;
+	};
+	struct hdr {
+		int cls;      // size class, or -1 if not cached
+		tw_size size; // requested size, uncached blocks only
+	};
+
+	static depot _depots[TW_MAGAZINE_NUM_CLASSES];
+	static pthread_key_t _key;
+	static pthread_once_t _once;
+	static __thread threadcache *_cache;
+
+	static void init();
+	static void threadExit(void *d);
+	static threadcache *getCache();
+	static int classOf(tw_size n) {
+		int c = 0;
+		while((TW_MAGAZINE_MIN_BLOCK << c) < n) c++;
+		return c;
+	}
+	static tw_size classSize(int c) { return TW_MAGAZINE_MIN_BLOCK << c; }
+	static hdr *hdrOf(void *p) { return (hdr *) ((char *) p - TW_MAGAZINE_HDR_SIZE); }
+	static void *blockOf(hdr *h) { return (char *) h + TW_MAGAZINE_HDR_SIZE; }
+	static magazine *newMagazine() {
+		magazine *m = (magazine *) ::malloc(sizeof(magazine));
+		if(m) { m->next = NULL; m->count = 0; }
+		return m;
+	}
+	static void emptyToBase(magazine *m) {
+		for(int n=0;n<m->count;n++)
+			BASE::free(hdrOf(m->rounds[n]));
+		m->count = 0;
+	}
+	static void putInDepot(int cls, magazine *m);
+};
+
+template <class BASE> const char *Alloc_Magazine<BASE>::ALLOC_NOMEM_ERROR_MESSAGE = "*** MEMORY TWlib::Allocator FAILURE using ALLOC (Alloc_Magazine): %s:%d ***\n";
+template <class BASE> typename Alloc_Magazine<BASE>::depot Alloc_Magazine<BASE>::_depots[TW_MAGAZINE_NUM_CLASSES];
+template <class BASE> pthread_key_t Alloc_Magazine<BASE>::_key;
+template <class BASE> pthread_once_t Alloc_Magazine<BASE>::_once = PTHREAD_ONCE_INIT;
+template <class BASE> __thread typename Alloc_Magazine<BASE>::threadcache *Alloc_Magazine<BASE>::_cache = NULL;
+
+template <class BASE>
+void Alloc_Magazine<BASE>::init() {
+	for(int n=0;n<TW_MAGAZINE_NUM_CLASSES;n++) {
+		pthread_mutex_init(&_depots[n].mutex, NULL);
+		_depots[n].full = NULL;
+		_depots[n].nfull = 0;
+		_depots[n].empty = NULL;
+	}
+	pthread_key_create(&_key, threadExit);
+}
+
+template <class BASE>
+typename Alloc_Magazine<BASE>::threadcache *Alloc_Magazine<BASE>::getCache() {
+	if(!_cache) {
+		pthread_once(&_once, init);
+		_cache = (threadcache *) ::calloc(1, sizeof(threadcache));
+		if(_cache)
+			pthread_setspecific(_key, _cache);
+	}
+	return _cache;
+}
+
+// a magazine with blocks in it goes to the depot. If the depot is full, its blocks go back to BASE
+template <class BASE>
+void Alloc_Magazine<BASE>::putInDepot(int cls, magazine *m) {
+	depot &d = _depots[cls];
+	if(m->count > 0) {
+		pthread_mutex_lock(&d.mutex);
+		if(d.nfull < TW_MAGAZINE_DEPOT_MAX) {
+			m->next = d.full;
+			d.full = m;
+			d.nfull++;
+			pthread_mutex_unlock(&d.mutex);
+			return;
+		}
+		pthread_mutex_unlock(&d.mutex);
+		emptyToBase(m);
+	}
+	::free(m);
+}
+
+template <class BASE>
+void Alloc_Magazine<BASE>::threadExit(void *p) {
+	threadcache *c = (threadcache *) p;
+	if(!c) return;
+	for(int n=0;n<TW_MAGAZINE_NUM_CLASSES;n++) {
+		if(c->cls[n].loaded) putInDepot(n, c->cls[n].loaded);
+		if(c->cls[n].previous) putInDepot(n, c->cls[n].previous);
+	}
+	if(_cache == c) _cache = NULL;
+	::free(c);
+}
+
+template <class BASE>
+void Alloc_Magazine<BASE>::releaseThreadCache() {
+	if(_cache) {
+		threadcache *c = _cache;
+		pthread_setspecific(_key, NULL);
+		threadExit(c);
+	}
+}
+
+template <class BASE>
+int Alloc_Magazine<BASE>::depotMagazines() {
+	int ret = 0;
+	pthread_once(&_once, init);
+	for(int n=0;n<TW_MAGAZINE_NUM_CLASSES;n++) {
+		pthread_mutex_lock(&_depots[n].mutex);
+		ret += _depots[n].nfull;
+		pthread_mutex_unlock(&_depots[n].mutex);
+	}
+	return ret;
+}
+
+template <class BASE>
+void *Alloc_Magazine<BASE>::malloc(tw_size nbytes) {
+	hdr *h;
+	if(nbytes > classSize(TW_MAGAZINE_NUM_CLASSES-1)) {
+		h = (hdr *) BASE::malloc(nbytes + TW_MAGAZINE_HDR_SIZE);
+		if(!h) return NULL;
+		h->cls = -1;
+		h->size = nbytes;
+		return blockOf(h);
+	}
+	int cls = classOf(nbytes);
+	threadcache *c = getCache();
+	if(c) {
+		classcache &cc = c->cls[cls];
+		if(cc.loaded && cc.loaded->count > 0)
+			return cc.loaded->rounds[--cc.loaded->count];
+		if(cc.previous && cc.previous->count > 0) {
+			magazine *t = cc.loaded; cc.loaded = cc.previous; cc.previous = t;
+			return cc.loaded->rounds[--cc.loaded->count];
+		}
+		// both empty - trade one for a loaded magazine from the depot
+		depot &d = _depots[cls];
+		pthread_mutex_lock(&d.mutex);
+		if(d.full) {
+			magazine *m = d.full;
+			d.full = m->next;
+			d.nfull--;
+			if(cc.previous) {
+				cc.previous->next = d.empty;
+				d.empty = cc.previous;
+			}
+			pthread_mutex_unlock(&d.mutex);
+			cc.previous = cc.loaded;
+			cc.loaded = m;
+			return cc.loaded->rounds[--cc.loaded->count];
+		}
+		pthread_mutex_unlock(&d.mutex);
+	}
+	h = (hdr *) BASE::malloc(classSize(cls) + TW_MAGAZINE_HDR_SIZE);
+	if(!h) return NULL;
+	h->cls = cls;
+	h->size = 0;
+	return blockOf(h);
+}
+
+template <class BASE>
+void Alloc_Magazine<BASE>::free(void *p) {
+	if(!p) return;
+	hdr *h = hdrOf(p);
+	if(h->cls < 0) {
+		BASE::free(h);
+		return;
+	}
+	int cls = h->cls;
+	threadcache *c = getCache();
+	if(!c) {
+		BASE::free(h);
+		return;
+	}
+	classcache &cc = c->cls[cls];
+	if(cc.loaded && cc.loaded->count < TW_MAGAZINE_ROUNDS) {
+		cc.loaded->rounds[cc.loaded->count++] = p;
+		return;
+	}
+	if(cc.previous && cc.previous->count < TW_MAGAZINE_ROUNDS) {
+		magazine *t = cc.loaded; cc.loaded = cc.previous; cc.previous = t;
+		cc.loaded->rounds[cc.loaded->count++] = p;
+		return;
+	}
+	// both full (or not there yet) - hand the previous one to the depot, and get an empty one
+	depot &d = _depots[cls];
+	magazine *m = NULL;
+	magazine *flush = NULL;
+	pthread_mutex_lock(&d.mutex);
+	if(cc.previous) {
+		if(d.nfull < TW_MAGAZINE_DEPOT_MAX) {
+			cc.previous->next = d.full;
+			d.full = cc.previous;
+			d.nfull++;
+		} else
+			flush = cc.previous; // depot is full - reuse this magazine once its blocks go back to BASE
+	}
+	if(!flush && d.empty) {
+		m = d.empty;
+		d.empty = m->next;
+	}
+	pthread_mutex_unlock(&d.mutex);
+	if(flush) {
+		emptyToBase(flush);
+		m = flush;
+	} else if(!m) {
+		m = newMagazine();
+		if(!m) {
+			BASE::free(h);
+			return;
+		}
+	}
+	cc.previous = cc.loaded;
+	cc.loaded = m;
+	m->rounds[m->count++] = p;
+}
+
+template <class BASE>
+void *Alloc_Magazine<BASE>::calloc(tw_size nelem, tw_size elemsize) {
+	tw_size n = nelem * elemsize;
+	void *ret = malloc(n);
+	if(ret) ::memset(ret, 0, n);
+	return ret;
+}
+
+template <class BASE>
+void *Alloc_Magazine<BASE>::realloc(void *d, tw_size s) {
+	if(!d) return malloc(s);
+	if(s == 0) {
+		free(d);
+		return NULL;
+	}
+	hdr *h = hdrOf(d);
+	tw_size old;
+	if(h->cls < 0) {
+		if(s > classSize(TW_MAGAZINE_NUM_CLASSES-1)) {
+			h = (hdr *) BASE::realloc(h, s + TW_MAGAZINE_HDR_SIZE);
+			if(!h) return NULL;
+			h->size = s;
+			return blockOf(h);
+		}
+		old = h->size;
+	} else {
+		old = classSize(h->cls);
+		if(s <= old) return d; // still fits
+	}
+	void *ret = malloc(s);
+	if(!ret) return NULL;
+	::memcpy(ret, d, (old < s) ? old : s);
+	free(d);
+	return ret;
+}
+
+}
+
+#endif /* TW_ALLOC_MAGAZINE_H_ */
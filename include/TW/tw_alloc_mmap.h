@@ -0,0 +1,102 @@
+// tupperware container lib
+// tw_alloc_mmap.h
+
+/*
+ * tw_alloc_mmap.h
+ *
+ * An allocator backed by a memory mapped file. Containers allocated here persist in the file,
+ * and can be picked back up (pointers and all) when the file is opened again.
+ */
+
+#ifndef TW_ALLOC_MMAP_H_
+#define TW_ALLOC_MMAP_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <TW/tw_alloc.h>
+
+// default max size a mapped file can grow to. Address space for all of it is reserved on open().
+#ifndef TW_MMAP_DEFAULT_MAX
+#define TW_MMAP_DEFAULT_MAX (1024LL*1024*1024)
+#endif
+
+#define TW_MMAP_ALIGN 16
+
+namespace TWlib {
+
+/**
+ * Allocator over a growable mmap()'d file.
+ *
+ * The whole max size of the file is mapped once at open(), so the mapping never moves as the file
+ * grows (the file itself is only extended with ftruncate() as space is needed). The address of the
+ * mapping is recorded in the file, and a later open() maps the file at that same address - so
+ * pointers stored inside the region stay valid across restarts. Use setRoot() / getRoot() to find
+ * your top level object again.
+ *
+ * Free space is kept in an address ordered first-fit free list, and neighboring free blocks are coalesced.
+ * sync() maps to msync() over the given range.
+ *
+ * The static calls (the ALLOC contract used by the containers) go to the default mapping, see setDefault().
+ * Calls are thread safe within a process. Sharing one file between processes at the same time is not supported.
+ */
+class Alloc_MMap {
+public:
+	Alloc_MMap();
+	~Alloc_MMap(); // closes
+
+	// opens or creates 'path'. Returns 0 on success, or an errno value.
+	// if the file already exists, its recorded max size is used instead of 'maxsize'.
+	int open(const char *path, uint64_t maxsize = TW_MMAP_DEFAULT_MAX);
+	int close();
+	bool isOpen() { return _hdr != NULL; }
+
+	void *i_malloc(tw_size nbytes);
+	void *i_calloc(tw_size nelem, tw_size elemsize);
+	void *i_realloc(void *d, tw_size s);
+	void i_free(void *p);
+	// addr == NULL syncs the entire mapping. flags are MS_SYNC / MS_ASYNC (0 is MS_SYNC). Returns 0 or errno.
+	int i_sync(void *addr = NULL, tw_size len = 0, int flags = 0);
+
+	// the object to find on the next open()
+	void setRoot(void *p);
+	void *getRoot();
+
+	void *base() { return _hdr; }
+	bool contains(void *p) { return _hdr && (char *) p >= (char *) _hdr && (char *) p < (char *) _hdr + _maxsize; }
+	uint64_t fileSize();
+	uint64_t bytesFree();
+
+	static void setDefault(Alloc_MMap *m) { _default = m; }
+	static Alloc_MMap *getDefault() { return _default; }
+
+	// the ALLOC contract - these use the default mapping
+	static void *malloc (tw_size nbytes) { return _default ? _default->i_malloc(nbytes) : NULL; }
+	static void *calloc (tw_size nelem, tw_size elemsize) { return _default ? _default->i_calloc(nelem, elemsize) : NULL; }
+	static void *realloc(void *d, tw_size s) { return _default ? _default->i_realloc(d, s) : NULL; }
+	static void free(void *p) { if(_default) _default->i_free(p); }
+	static void sync(void *addr, tw_size len, int flags = 0) { if(_default) _default->i_sync(addr, len, flags); }
+	static void *memcpy(void *d, const void *s, size_t n) { return ::memcpy(d,s,n); };
+	static void *memmove(void *d, const void *s, size_t n) { return ::memmove(d,s,n); };
+	static int memcmp(void *l, void *r, size_t n) { return ::memcmp(l, r, n); }
+	static void *memset(void *d, int c, size_t n) { return ::memset(d,c,n); }
+	static const char *ALLOC_NOMEM_ERROR_MESSAGE;
+protected:
+	struct header;
+	struct block;
+	block *blockAt(uint64_t off) { return (block *) ((char *) _hdr + off); }
+	uint64_t offsetOf(void *p) { return (uint64_t) ((char *) p - (char *) _hdr); }
+	bool grow(uint64_t need);
+	void *allocLocked(tw_size nbytes);
+	void freeLocked(void *p);
+
+	header *_hdr;
+	int _fd;
+	uint64_t _maxsize;
+	pthread_mutex_t _mutex;
+	static Alloc_MMap *_default;
+};
+
+}
+
+#endif /* TW_ALLOC_MMAP_H_ */
@@ -0,0 +1,64 @@
+// tupperware container lib
+// tw_alloc_pool.h
+
+/*
+ * tw_alloc_pool.h
+ *
+ * A slab / pool allocator with the same static contract as Alloc_Std, so it can be used
+ * as Allocator<Alloc_Pool>
+ */
+
+#ifndef TW_ALLOC_POOL_H_
+#define TW_ALLOC_POOL_H_
+
+#include <TW/tw_alloc.h>
+
+// size of each slab which is carved into chunks of a single size class
+#ifndef TW_POOL_SLAB_SIZE
+#define TW_POOL_SLAB_SIZE (64*1024)
+#endif
+
+// requests bigger than this go straight to ::malloc()
+#ifndef TW_POOL_MAX_CHUNK
+#define TW_POOL_MAX_CHUNK 512
+#endif
+
+// size classes are TW_POOL_ALIGN bytes apart. Every chunk is aligned to this (same as glibc malloc)
+#define TW_POOL_ALIGN 16
+#define TW_POOL_NUM_CLASSES (TW_POOL_MAX_CHUNK / TW_POOL_ALIGN)
+
+namespace TWlib {
+
+/**
+ * Pool allocator. Small requests (<= TW_POOL_MAX_CHUNK) are rounded up to a size class and
+ * handed out as fixed size chunks carved from large slabs. Each thread keeps its own free list
+ * per size class, so malloc() / free() are a pointer pop / push with no lock in the common case.
+ * Chunks move between a thread and the shared pool in batches when a thread's list runs dry or
+ * grows too long, and all of a thread's chunks go back to the shared pool when the thread exits.
+ *
+ * Slab memory is never returned to the OS - it is reused by later allocations of the same size class.
+ * Every chunk has a small header in front of it, so free() and realloc() need no size.
+ */
+struct Alloc_Pool {
+	static void *malloc (tw_size nbytes);
+	static void *calloc (tw_size nelem, tw_size elemsize);
+	static void *realloc(void *d, tw_size s);
+	static void free(void *p);
+	static void sync(void *addr, tw_size len, int flags = 0) { } // does nothing - not shared memory
+	static void *memcpy(void *d, const void *s, size_t n) { return ::memcpy(d,s,n); };
+	static void *memmove(void *d, const void *s, size_t n) { return ::memmove(d,s,n); };
+	static int memcmp(void *l, void *r, size_t n) { return ::memcmp(l, r, n); }
+	static void *memset(void *d, int c, size_t n) { return ::memset(d,c,n); }
+	static const char *ALLOC_NOMEM_ERROR_MESSAGE;
+
+	// returns the calling thread's cached chunks to the shared pool. Done automatically on thread exit.
+	static void releaseThreadCache();
+	// the number of usable bytes at p (the size class, for pooled chunks)
+	static tw_size usableSize(void *p);
+	// total bytes of slab memory the pool has taken from the heap
+	static size_t slabBytes();
+};
+
+}
+
+#endif /* TW_ALLOC_POOL_H_ */
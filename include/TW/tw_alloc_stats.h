@@ -0,0 +1,329 @@
+// tupperware container lib
+// tw_alloc_stats.h
+
+/*
+ * tw_alloc_stats.h
+ *
+ * An instrumented allocator policy, which counts what goes through any other Alloc_* policy:
+ *   struct SessionTableTag {};
+ *   typedef Allocator<Alloc_Stats<Alloc_Std, SessionTableTag> > SessionAlloc;
+ *   ...
+ *   std::string s = Alloc_Stats<Alloc_Std, SessionTableTag>::dump();
+ *
+ * Each distinct TAG gets its own counters, so giving each container (or subsystem) its own tag
+ * tells you which one is using the memory.
+ */
+
+#ifndef TW_ALLOC_STATS_H_
+#define TW_ALLOC_STATS_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <atomic>
+#include <string>
+
+#include <TW/tw_alloc.h>
+
+// histogram buckets: bucket n counts requests of size (2^(n-1), 2^n]. The last bucket is everything bigger.
+#define TW_ALLOC_STATS_BUCKETS 24
+
+// a thread folds its net allocated bytes into the shared live / peak numbers every time it drifts this
+// far - so peakBytes is exact to within (threads * TW_ALLOC_STATS_FLUSH_BYTES)
+#ifndef TW_ALLOC_STATS_FLUSH_BYTES
+#define TW_ALLOC_STATS_FLUSH_BYTES (64*1024)
+#endif
+
+#define TW_ALLOC_STATS_HDR_SIZE 16
+
+namespace TWlib {
+
+/**
+ * A snapshot of the counters of an Alloc_Stats<>
+ */
+struct tw_alloc_stats {
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t allocBytes;
+	uint64_t freeBytes;
+	int64_t liveBytes;
+	int64_t liveBlocks;
+	int64_t peakBytes;
+	int threads;          // threads which have counters (live ones)
+	double seconds;       // since the previous snapshot()
+	double allocsPerSec;  // since the previous snapshot()
+	double freesPerSec;
+	uint64_t hist[TW_ALLOC_STATS_BUCKETS];
+};
+
+/**
+ * Counts allocations going through BASE. Every thread counts into its own counters, so the
+ * counting costs no shared writes. The counters are only summed up when snapshot() / dump() is called.
+ * A thread's counters are folded into a 'retired' total when it exits.
+ *
+ * A small header in front of each block records its size, so free() can count bytes.
+ */
+template <class BASE, class TAG = void>
+struct Alloc_Stats {
+	static void *malloc (tw_size nbytes);
+	static void *calloc (tw_size nelem, tw_size elemsize);
+	static void *realloc(void *d, tw_size s);
+	static void free(void *p);
+	static void sync(void *addr, tw_size len, int flags = 0) { BASE::sync(addr,len,flags); }
+	static void *memcpy(void *d, const void *s, size_t n) { return BASE::memcpy(d,s,n); };
+	static void *memmove(void *d, const void *s, size_t n) { return BASE::memmove(d,s,n); };
+	static int memcmp(void *l, void *r, size_t n) { return BASE::memcmp(l, r, n); }
+	static void *memset(void *d, int c, size_t n) { return BASE::memset(d,c,n); }
+	static const char *ALLOC_NOMEM_ERROR_MESSAGE;
+
+	// name used in dump()
+	static void setName(const char *name) { _name = name; }
+	static void snapshot(tw_alloc_stats &out);
+	// the snapshot() as one line of JSON
+	static std::string dump();
+protected:
+	struct counters {
+		std::atomic<uint64_t> allocs;
+		std::atomic<uint64_t> frees;
+		std::atomic<uint64_t> allocBytes;
+		std::atomic<uint64_t> freeBytes;
+		std::atomic<uint64_t> hist[TW_ALLOC_STATS_BUCKETS];
+		int64_t unflushed; // owner only
+		counters *next;
+		counters *prev;
+	};
+	struct totals {
+		uint64_t allocs, frees, allocBytes, freeBytes;
+		uint64_t hist[TW_ALLOC_STATS_BUCKETS];
+	};
+
+	static pthread_mutex_t _mutex; // protects _threads, _retired, and the snapshot rate numbers
+	static counters *_threads;
+	static totals _retired;
+	static std::atomic<int64_t> _live;
+	static std::atomic<int64_t> _peak;
+	static pthread_key_t _key;
+	static pthread_once_t _once;
+	static __thread counters *_mine;
+	static const char *_name;
+	static struct timeval _lastSnap;
+	static uint64_t _lastAllocs, _lastFrees;
+
+	static void init() { pthread_key_create(&_key, threadExit); }
+	static void threadExit(void *d);
+	static counters *mine();
+	// only the owning thread writes its counters - so a plain load / store is enough
+	static void bump(std::atomic<uint64_t> &c, uint64_t n) { c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+	static int bucketOf(tw_size n) {
+		int b = 0;
+		while(b < TW_ALLOC_STATS_BUCKETS-1 && ((tw_size) 1 << b) < n) b++;
+		return b;
+	}
+	static void flush(counters *c);
+	static void countAlloc(tw_size n);
+	static void countFree(tw_size n);
+};
+
+template <class BASE, class TAG> const char *Alloc_Stats<BASE,TAG>::ALLOC_NOMEM_ERROR_MESSAGE = "*** MEMORY TWlib::Allocator FAILURE using ALLOC (Alloc_Stats): %s:%d ***\n";
+template <class BASE, class TAG> pthread_mutex_t Alloc_Stats<BASE,TAG>::_mutex = PTHREAD_MUTEX_INITIALIZER;
+template <class BASE, class TAG> typename Alloc_Stats<BASE,TAG>::counters *Alloc_Stats<BASE,TAG>::_threads = NULL;
+template <class BASE, class TAG> typename Alloc_Stats<BASE,TAG>::totals Alloc_Stats<BASE,TAG>::_retired;
+template <class BASE, class TAG> std::atomic<int64_t> Alloc_Stats<BASE,TAG>::_live(0);
+template <class BASE, class TAG> std::atomic<int64_t> Alloc_Stats<BASE,TAG>::_peak(0);
+template <class BASE, class TAG> pthread_key_t Alloc_Stats<BASE,TAG>::_key;
+template <class BASE, class TAG> pthread_once_t Alloc_Stats<BASE,TAG>::_once = PTHREAD_ONCE_INIT;
+template <class BASE, class TAG> __thread typename Alloc_Stats<BASE,TAG>::counters *Alloc_Stats<BASE,TAG>::_mine = NULL;
+template <class BASE, class TAG> const char *Alloc_Stats<BASE,TAG>::_name = "";
+template <class BASE, class TAG> struct timeval Alloc_Stats<BASE,TAG>::_lastSnap;
+template <class BASE, class TAG> uint64_t Alloc_Stats<BASE,TAG>::_lastAllocs = 0;
+template <class BASE, class TAG> uint64_t Alloc_Stats<BASE,TAG>::_lastFrees = 0;
+
+template <class BASE, class TAG>
+typename Alloc_Stats<BASE,TAG>::counters *Alloc_Stats<BASE,TAG>::mine() {
+	if(!_mine) {
+		pthread_once(&_once, init);
+		counters *c = (counters *) ::calloc(1, sizeof(counters));
+		if(!c) return NULL;
+		pthread_mutex_lock(&_mutex);
+		c->next = _threads;
+		if(_threads) _threads->prev = c;
+		_threads = c;
+		pthread_mutex_unlock(&_mutex);
+		_mine = c;
+		pthread_setspecific(_key, c);
+	}
+	return _mine;
+}
+
+template <class BASE, class TAG>
+void Alloc_Stats<BASE,TAG>::threadExit(void *d) {
+	counters *c = (counters *) d;
+	if(!c) return;
+	flush(c);
+	pthread_mutex_lock(&_mutex);
+	_retired.allocs += c->allocs.load(std::memory_order_relaxed);
+	_retired.frees += c->frees.load(std::memory_order_relaxed);
+	_retired.allocBytes += c->allocBytes.load(std::memory_order_relaxed);
+	_retired.freeBytes += c->freeBytes.load(std::memory_order_relaxed);
+	for(int n=0;n<TW_ALLOC_STATS_BUCKETS;n++)
+		_retired.hist[n] += c->hist[n].load(std::memory_order_relaxed);
+	if(c->prev) c->prev->next = c->next;
+	else _threads = c->next;
+	if(c->next) c->next->prev = c->prev;
+	pthread_mutex_unlock(&_mutex);
+	if(_mine == c) _mine = NULL;
+	::free(c);
+}
+
+template <class BASE, class TAG>
+void Alloc_Stats<BASE,TAG>::flush(counters *c) {
+	if(!c->unflushed) return;
+	int64_t live = _live.fetch_add(c->unflushed, std::memory_order_relaxed) + c->unflushed;
+	c->unflushed = 0;
+	int64_t peak = _peak.load(std::memory_order_relaxed);
+	while(live > peak && !_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) { }
+}
+
+template <class BASE, class TAG>
+void Alloc_Stats<BASE,TAG>::countAlloc(tw_size n) {
+	counters *c = mine();
+	if(!c) return;
+	bump(c->allocs, 1);
+	bump(c->allocBytes, n);
+	bump(c->hist[bucketOf(n)], 1);
+	c->unflushed += n;
+	if(c->unflushed > TW_ALLOC_STATS_FLUSH_BYTES || c->unflushed < -TW_ALLOC_STATS_FLUSH_BYTES)
+		flush(c);
+}
+
+template <class BASE, class TAG>
+void Alloc_Stats<BASE,TAG>::countFree(tw_size n) {
+	counters *c = mine();
+	if(!c) return;
+	bump(c->frees, 1);
+	bump(c->freeBytes, n);
+	c->unflushed -= n;
+	if(c->unflushed > TW_ALLOC_STATS_FLUSH_BYTES || c->unflushed < -TW_ALLOC_STATS_FLUSH_BYTES)
+		flush(c);
+}
+
+template <class BASE, class TAG>
+void *Alloc_Stats<BASE,TAG>::malloc(tw_size nbytes) {
+	char *h = (char *) BASE::malloc(nbytes + TW_ALLOC_STATS_HDR_SIZE);
+	if(!h) return NULL;
+	*((tw_size *) h) = nbytes;
+	countAlloc(nbytes);
+	return h + TW_ALLOC_STATS_HDR_SIZE;
+}
+
+template <class BASE, class TAG>
+void *Alloc_Stats<BASE,TAG>::calloc(tw_size nelem, tw_size elemsize) {
+	tw_size n = nelem * elemsize;
+	void *ret = malloc(n);
+	if(ret) ::memset(ret, 0, n);
+	return ret;
+}
+
+template <class BASE, class TAG>
+void *Alloc_Stats<BASE,TAG>::realloc(void *d, tw_size s) {
+	if(!d) return malloc(s);
+	char *h = (char *) d - TW_ALLOC_STATS_HDR_SIZE;
+	tw_size old = *((tw_size *) h);
+	h = (char *) BASE::realloc(h, s + TW_ALLOC_STATS_HDR_SIZE);
+	if(!h) return NULL;
+	*((tw_size *) h) = s;
+	countFree(old);
+	countAlloc(s);
+	return h + TW_ALLOC_STATS_HDR_SIZE;
+}
+
+template <class BASE, class TAG>
+void Alloc_Stats<BASE,TAG>::free(void *p) {
+	if(!p) return;
+	char *h = (char *) p - TW_ALLOC_STATS_HDR_SIZE;
+	countFree(*((tw_size *) h));
+	BASE::free(h);
+}
+
+template <class BASE, class TAG>
+void Alloc_Stats<BASE,TAG>::snapshot(tw_alloc_stats &out) {
+	::memset(&out, 0, sizeof(out));
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	pthread_mutex_lock(&_mutex);
+	out.allocs = _retired.allocs;
+	out.frees = _retired.frees;
+	out.allocBytes = _retired.allocBytes;
+	out.freeBytes = _retired.freeBytes;
+	for(int n=0;n<TW_ALLOC_STATS_BUCKETS;n++)
+		out.hist[n] = _retired.hist[n];
+	for(counters *c = _threads; c; c = c->next) {
+		out.allocs += c->allocs.load(std::memory_order_relaxed);
+		out.frees += c->frees.load(std::memory_order_relaxed);
+		out.allocBytes += c->allocBytes.load(std::memory_order_relaxed);
+		out.freeBytes += c->freeBytes.load(std::memory_order_relaxed);
+		for(int n=0;n<TW_ALLOC_STATS_BUCKETS;n++)
+			out.hist[n] += c->hist[n].load(std::memory_order_relaxed);
+		out.threads++;
+	}
+	out.liveBytes = (int64_t) (out.allocBytes - out.freeBytes);
+	out.liveBlocks = (int64_t) (out.allocs - out.frees);
+	out.peakBytes = _peak.load(std::memory_order_relaxed);
+	if(out.liveBytes > out.peakBytes) out.peakBytes = out.liveBytes;
+	if(_lastSnap.tv_sec) {
+		out.seconds = (now.tv_sec - _lastSnap.tv_sec) + (now.tv_usec - _lastSnap.tv_usec) / 1000000.0;
+		if(out.seconds > 0) {
+			out.allocsPerSec = (out.allocs - _lastAllocs) / out.seconds;
+			out.freesPerSec = (out.frees - _lastFrees) / out.seconds;
+		}
+	}
+	_lastSnap = now;
+	_lastAllocs = out.allocs;
+	_lastFrees = out.frees;
+	pthread_mutex_unlock(&_mutex);
+}
+
+template <class BASE, class TAG>
+std::string Alloc_Stats<BASE,TAG>::dump() {
+	tw_alloc_stats s;
+	snapshot(s);
+	char buf[512];
+	std::string ret("{\"name\":\"");
+	for(const char *c = _name; c && *c; c++) { // a JSON string - escape quotes, backslashes and control chars
+		if(*c == '"' || *c == '\\') {
+			ret += '\\';
+			ret += *c;
+		} else if((unsigned char) *c < 0x20) {
+			snprintf(buf, sizeof(buf), "\\u%04x", (unsigned int) (unsigned char) *c);
+			ret += buf;
+		} else
+			ret += *c;
+	}
+	snprintf(buf, sizeof(buf), "\",\"allocs\":%llu,\"frees\":%llu,\"allocBytes\":%llu,\"freeBytes\":%llu,"
+			"\"liveBytes\":%lld,\"liveBlocks\":%lld,\"peakBytes\":%lld,\"threads\":%d,",
+			(unsigned long long) s.allocs, (unsigned long long) s.frees,
+			(unsigned long long) s.allocBytes, (unsigned long long) s.freeBytes,
+			(long long) s.liveBytes, (long long) s.liveBlocks, (long long) s.peakBytes, s.threads);
+	ret += buf;
+	snprintf(buf, sizeof(buf), "\"seconds\":%.3f,\"allocsPerSec\":%.1f,\"freesPerSec\":%.1f,\"hist\":{",
+			s.seconds, s.allocsPerSec, s.freesPerSec);
+	ret += buf;
+	bool first = true;
+	for(int n=0;n<TW_ALLOC_STATS_BUCKETS;n++) {
+		if(!s.hist[n]) continue;
+		if(n == TW_ALLOC_STATS_BUCKETS-1)
+			snprintf(buf, sizeof(buf), "%s\"big\":%llu", first ? "" : ",", (unsigned long long) s.hist[n]);
+		else
+			snprintf(buf, sizeof(buf), "%s\"%lu\":%llu", first ? "" : ",", (unsigned long) 1 << n, (unsigned long long) s.hist[n]);
+		ret += buf;
+		first = false;
+	}
+	ret += "}}";
+	return ret;
+}
+
+}
+
+#endif /* TW_ALLOC_STATS_H_ */
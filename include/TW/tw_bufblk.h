@@ -25,23 +25,53 @@
 #include <pthread.h>
 #include <limits.h>
 #include <stdio.h>
-
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <new>
 #include <string>
-#include <sstream>
 #include <iostream>
 
 using namespace std;
 
+// max number of iovecs BufBlk::writeTo() / readFrom() hand to a single writev() / readv()
+#ifndef TW_BUFBLK_MAX_IOV
+#define TW_BUFBLK_MAX_IOV 64
+#endif
+
 namespace TWlib {
 
 template <class ALLOC>
 class BufBlk;
 
+template <class ALLOC>
+class MemBlk;
+
+template <class ALLOC>
+class BufBlkPool;
+
+/**
+ * Something which takes back a MemBlk (and its memory) when its reference count reaches zero,
+ * instead of it being freed. See BufBlkPool.
+ */
+template <class ALLOC>
+class MemBlkRecycler {
+public:
+	virtual void recycle( MemBlk<ALLOC> *m ) = 0;
+	virtual ~MemBlkRecycler() {}
+};
+
 /**
  * The basic abstraction of a chunk of memory.
  * -Contigous
  * -Is not aware of other memory
- * -Has a reference count for itself
+ * -Has a reference count for itself. The count is atomic - checkout() / release() don't take a lock,
+ *  so duplicating and releasing BufBlks across threads stays cheap.
  */
 template <class ALLOC>
 class MemBlk {
@@ -58,16 +88,36 @@ public:
 	void *base();               // report base of block
 	MemBlk *deepCopy();         // makes an entirely new copy of the memory
 	MemBlk *deepCopy(ALLOC *a);
+	static MemBlk *newInline( int size ); // header and memory in one allocation
+	bool isInline();
+	static MemBlk *newFile( int fd, off_t offset, int len, bool closefd = false ); // a range of a file
+	bool isFile();
+	int fileFd();
+	off_t fileOffset();
 	std::string &hexDump(std::string &in);
 	friend class BufBlk<ALLOC>;
+	friend class BufBlkPool<ALLOC>;
 protected:
-	int _concatHexDump(std::ostringstream &outs, char *rdptr, char *wrtptr, int max);
-	int _ref_count;
-	pthread_mutex_t _refMutex; // thread safety for buffer, ref count
+	char *_hexDumpTo(char *out, char *rdptr, char *wrtptr, int n);
+	static int _hexDumpBound(int n) { return 3 * n + 24; } // most chars _hexDumpTo() writes for n bytes
+	void _destroy();
+	static size_t _inlineHdrSize() { return (sizeof(MemBlk) + 15) & ~((size_t) 15); } // memory starts 16 aligned
+	void *_inlineData() { return ((char *) this) + _inlineHdrSize(); }
+	std::atomic<int> _ref_count;
 	void *_base;                // the memory
 	int _size;                  // size of memory region
 	bool _manage;
 	bool _proper;
+	bool _inline;               // this object was placed in front of its memory by newInline()
+	struct fileRange {          // for newFile() blocks. _base points into 'map'
+		int fd;
+		bool closefd;
+		off_t offset;
+		void *map;
+		size_t maplen;
+	};
+	fileRange *_file;
+	MemBlkRecycler<ALLOC> *_recycler; // if set, gets the block on the last release() instead of it being freed
 };
 
 template <class ALLOC>
@@ -83,6 +133,8 @@ class BufBlk {
 protected:
 	BufBlk( MemBlk<ALLOC> *m );
 	void assignFromBlk( const BufBlk<ALLOC> &o );
+	void advanceRdPtrs( int n );
+	void advanceWrPtrs( int n );
 	MemBlk<ALLOC> *_blk;
 	char *_rd_ptr;
 	char *_wr_ptr;
@@ -95,12 +147,15 @@ protected:
 #endif
 public:
 	friend class twbufblkIter;
+	friend class BufBlkPool<ALLOC>;
 	BufBlk();
 	BufBlk( BufBlk &o );
 	BufBlk( void *data, int size, bool manage = true );
 	BufBlk( int size );
 	BufBlk( int size, ALLOC *a );
 	BufBlk( int size, BufBlk<ALLOC> *next, ALLOC *a );
+	static BufBlk *newInline( int size );
+	static BufBlk *newFile( int fd, off_t offset, int len, bool closefd = false );
 
 	~BufBlk();
 
@@ -114,6 +169,14 @@ public:
 	bool isContigous(char *pos, int len);
 	bool isContigousReadble(char *pos, int len);
 
+	int getIovecs( struct iovec *iov, int max, int *bytes = NULL );
+	int getFreeIovecs( struct iovec *iov, int max, int *bytes = NULL );
+	int writeTo( int fd );
+	int readFrom( int fd );
+	int sendTo( int fd );
+	bool isFileBlk();
+	off_t fileOffset();
+
 	int copyFrom( const void *src, int size );
 	void fillWith( char v );
 	void reset();
@@ -125,6 +188,8 @@ public:
 	int total_length();
 	int capacity();
 	int total_capacity();
+	int total_blocks();
+	BufBlk *tail();
 	int freespace();
 	bool isValid();
 	void *base();
@@ -145,9 +210,13 @@ public:
 
 	BufBlk& operator=(const BufBlk<ALLOC> &o);
 	BufBlk *duplicate();
+	BufBlk *slice( int rd_offset, int len );
+	bool makeWritable();
+	bool isShared();
 	int getRefCount();
 	MemBlk<ALLOC> *memblk() { return _blk; } // returns a pointer to underlying MemBlk
 	std::string &hexDump(std::string &outs, int max = 0);
+	int hexDump(char *out, int space, int max = 0);
 };
 
 template <class ALLOC>
@@ -165,6 +234,44 @@ protected:
 	int _rd_offset;  // current offset from that blk's rd_ptr
 };
 
+/**
+ * Builds a chain by adding to its end, keeping track of the tail, and the length, capacity and count of
+ * the blocks in front of it as they go by - so assembling a message out of many small segments is linear.
+ *
+ * This is where those numbers are cached, not on the BufBlk head: any block of a chain can be changed
+ * through its own pointer (copyFrom(), setNexblk(), eatBytes() on a sub chain, release()), and the head
+ * can not see that. So BufBlk's addToEnd(), total_length() and total_capacity() walk the chain every
+ * call, and are right however the chain was changed. Code which builds up a chain a piece at a time
+ * should use a BufBlkChain (or keep its own count, as BufBlkReader does).
+ *
+ * The tail's own length is always read live, so data can be written into tail() at any time. Blocks in
+ * front of the tail must not be changed, added or removed through their own pointers while the chain is
+ * in here - take() it first.
+ */
+template <class ALLOC>
+class BufBlkChain {
+public:
+	BufBlkChain( BufBlk<ALLOC> *chain = NULL );
+	BufBlkChain( BufBlkChain<ALLOC> &o ) = delete;
+	BufBlkChain<ALLOC> &operator=( const BufBlkChain<ALLOC> &o ) = delete;
+	~BufBlkChain();
+	void append( BufBlk<ALLOC> *b );
+	BufBlk<ALLOC> *take();
+	BufBlk<ALLOC> *head() { return _head; }
+	BufBlk<ALLOC> *tail() { return _tail; }
+	bool empty() { return _head == NULL; }
+	int total_length();
+	int total_capacity();
+	int total_blocks();
+protected:
+	BufBlk<ALLOC> *_head;
+	BufBlk<ALLOC> *_tail;
+	int _len;    // length(), capacity() and number of the blocks in front of _tail
+	int _cap;
+	int _count;
+	uint64_t _stepped; // blocks append() has walked past - one per block added, never the ones already here
+};
+
 } // end namespace
 
 
@@ -187,14 +294,16 @@ MemBlk<ALLOC>::MemBlk(int size) :
 	_base( 0 ),
 	_size( 0 ),
 	_manage( true ),
-	_proper( true )
+	_proper( true ),
+	_inline( false ),
+	_file( NULL ),
+	_recycler( NULL )
 {
 	_base = ALLOC::malloc( size );
 	if(_base) {
 		_size = size;
 	} else
 		_proper = false;
-	pthread_mutex_init( &_refMutex, NULL );
 }
 
 template <class ALLOC>
@@ -203,14 +312,16 @@ MemBlk<ALLOC>::MemBlk(int size, ALLOC *a) :
 	_base( 0 ),
 	_size( 0 ),
 	_manage( true ),
-	_proper( true )
+	_proper( true ),
+	_inline( false ),
+	_file( NULL ),
+	_recycler( NULL )
 {
 	_base = a->i_malloc( size );
 	if(_base) {
 		_size = size;
 	} else
 		_proper = false;
-	pthread_mutex_init( &_refMutex, NULL );
 }
 
 template <class ALLOC>
@@ -218,9 +329,12 @@ MemBlk<ALLOC>::MemBlk(void *data, int size, bool manage ) :
 	_ref_count( 1 ),
 	_base( data ),
 	_size( size ),
-	_manage( manage )
+	_manage( manage ),
+	_proper( true ),
+	_inline( false ),
+	_file( NULL ),
+	_recycler( NULL )
 { // def: manage = true
-	pthread_mutex_init( &_refMutex, NULL );
 }
 
 /**
@@ -229,39 +343,123 @@ MemBlk<ALLOC>::MemBlk(void *data, int size, bool manage ) :
  */
 template <class ALLOC>
 int MemBlk<ALLOC>::getRefCount() {
-	int ret = 0;
-	pthread_mutex_lock(&_refMutex);
-	ret = _ref_count;
-	pthread_mutex_unlock(&_refMutex);
-	return ret;
+	return _ref_count.load(std::memory_order_acquire);
 }
 
 /**
  * tells tw_memblk that another tw_bufblk is referencing it, _ref_count++
+ * The caller already holds a reference, so nothing needs ordering here.
  */
 template <class ALLOC>
 void MemBlk<ALLOC>::checkout() {
-	pthread_mutex_lock(&_refMutex);
-	_ref_count++;
-	pthread_mutex_unlock(&_refMutex);
-}
-
-template <class ALLOC>
-void MemBlk<ALLOC>::release() {             // decreases the ref count
-	bool remove = false;
-	pthread_mutex_lock(&_refMutex);
-	_ref_count--;
-	if(_ref_count < 1)
-		remove = true;
-	pthread_mutex_unlock(&_refMutex);
-//	printf("release %x - ref: %d\n", _base, _ref_count);
-	if(remove) {
-//		printf("remove: %x\n", _base);
+	_ref_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * decreases the ref count. The last release() frees the memory and deletes the MemBlk.
+ * The decrement is a release, so writes made through other references happen before the
+ * free. The thread which drops the count to zero does an acquire fence before freeing.
+ * A block with a recycler is handed back to it instead.
+ */
+template <class ALLOC>
+void MemBlk<ALLOC>::release() {
+	if(_ref_count.fetch_sub(1, std::memory_order_release) == 1) {
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(_recycler) {
+			_recycler->recycle(this);
+			return;
+		}
+		_destroy();
+	}
+}
+
+/**
+ * frees the memory (if managed) and this object. For an inline block that is one free(),
+ * unless resize() moved the memory out.
+ */
+template <class ALLOC>
+void MemBlk<ALLOC>::_destroy() {
+	if(_file) {
+		munmap(_file->map, _file->maplen);
+		if(_file->closefd)
+			::close(_file->fd);
+		delete _file;
+		delete this;
+	} else if(_inline) {
+		if(_manage && _base != _inlineData())
+			ALLOC::free( _base );
+		this->~MemBlk();
+		ALLOC::free( this );
+	} else {
 		if(_manage)
 			ALLOC::free( _base ); // free the memory block
 		delete this;         // good bye...
 	}
-	pthread_mutex_destroy(&_refMutex);
+}
+
+/**
+ * Creates a MemBlk of 'size' bytes, where this object and its memory come from a single ALLOC::malloc():
+ * [MemBlk][memory...]. One allocation instead of two, and the header is next to the data.
+ * The block otherwise acts like MemBlk(size) - resize() beyond the current size moves the memory to a
+ * separate allocation.
+ * @return the MemBlk, with a ref count of 1, or NULL if out of memory
+ */
+template <class ALLOC>
+MemBlk<ALLOC> *MemBlk<ALLOC>::newInline( int size ) {
+	void *p = ALLOC::malloc(_inlineHdrSize() + size);
+	if(!p) return NULL;
+	MemBlk<ALLOC> *ret = new (p) MemBlk<ALLOC>( ((char *) p) + _inlineHdrSize(), size, true );
+	ret->_inline = true;
+	return ret;
+}
+
+template <class ALLOC>
+bool MemBlk<ALLOC>::isInline() {
+	return _inline;
+}
+
+/**
+ * Creates a MemBlk over 'len' bytes of the file 'fd', starting at 'offset'. The range is mmap()'d read only,
+ * so the block can be read like any other (pages come in as they are touched) - but BufBlk::sendTo() hands
+ * the range to sendfile(), and never touches the mapping at all.
+ * The block can't be written to or resize()'d.
+ * @param closefd if true, fd is closed when the block is freed
+ * @return the MemBlk, with a ref count of 1, or NULL w/ errno set if the range can't be mapped
+ */
+template <class ALLOC>
+MemBlk<ALLOC> *MemBlk<ALLOC>::newFile( int fd, off_t offset, int len, bool closefd ) {
+	off_t page = (off_t) sysconf(_SC_PAGESIZE);
+	off_t start = offset & ~(page - 1); // mmap() needs a page aligned offset
+	size_t maplen = (size_t) (offset - start) + len;
+	void *map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, start);
+	if(map == MAP_FAILED)
+		return NULL;
+	MemBlk<ALLOC> *ret = new MemBlk<ALLOC>( ((char *) map) + (offset - start), len, false );
+	ret->_file = new fileRange;
+	ret->_file->fd = fd;
+	ret->_file->closefd = closefd;
+	ret->_file->offset = offset;
+	ret->_file->map = map;
+	ret->_file->maplen = maplen;
+	return ret;
+}
+
+template <class ALLOC>
+bool MemBlk<ALLOC>::isFile() {
+	return _file != NULL;
+}
+
+template <class ALLOC>
+int MemBlk<ALLOC>::fileFd() {
+	return _file ? _file->fd : -1;
+}
+
+/**
+ * @return the file offset of base(), or -1 if not a file block
+ */
+template <class ALLOC>
+off_t MemBlk<ALLOC>::fileOffset() {
+	return _file ? _file->offset : -1;
 }
 
 template <class ALLOC>
@@ -281,6 +479,24 @@ MemBlk<ALLOC> *MemBlk<ALLOC>::deepCopy(ALLOC *a) {
 template <class ALLOC>
 bool MemBlk<ALLOC>::resize(int size) {                 // report block size
 	void *newb = NULL;
+	if(_file) // the memory is a file mapping
+		return false;
+	if(_inline && _base == _inlineData()) {
+		// the memory shares an allocation with this object - so it can only shrink in place.
+		// growing moves it to its own allocation.
+		if(size <= _size) {
+			_size = size;
+			return true;
+		}
+		newb = ALLOC::malloc(size);
+		if(newb) {
+			ALLOC::memcpy(newb, _base, _size);
+			_base = newb;
+			_size = size;
+			return true;
+		}
+		return false;
+	}
 	newb = ALLOC::realloc(this->_base,size);
 	if(newb) {
 		this->_base = newb;
@@ -306,52 +522,48 @@ void MemBlk<ALLOC>::fillWith(char v) {
 	ALLOC::memset(this->_base,(int) v, this->_size);
 }
 
+/**
+ * Writes the first 'n' bytes of the block (n <= size()) to 'out' as "(size)[00,RD*01,02,WR*03]", marking where
+ * rdptr and wrtptr point. 'out' needs room for _hexDumpBound(n) chars. Not NUL terminated.
+ * @return the end of what was written
+ */
 template <class ALLOC>
-int MemBlk<ALLOC>::_concatHexDump(std::ostringstream &outs, char *rdptr, char *wrtptr, int max) {
-	int left = max;
-	char buf[8];
-	if(!max)
-		left = INT_MAX;
+char *MemBlk<ALLOC>::_hexDumpTo(char *out, char *rdptr, char *wrtptr, int n) {
 	char *walk = (char *) _base;
+	out += sprintf(out, "(%d)[", (int) _size);
 	int c = 0;
-	snprintf(buf,8,"(%d",(int) _size);
-	outs << buf;
-	outs << ")[";
-//	outs.setf(std::ios_base::hex,std::ios_base::basefield);
-	while(c < _size) {
-		if(left < 6) // typical hex digit FF (2 chars) plus  ']' plus possible RD*
-			break;
-		if(rdptr == walk) {
-			if(rdptr == wrtptr)
-				outs << "R*W";
-			else
-				outs << "RD*";
-		} else if(wrtptr == walk)
-			outs << "WR*";
-	//	outs << (int) *walk; // send as in so its hex
-		snprintf(buf,8,"%02X",(unsigned char) *walk);
-		outs << buf;
-		c++;
-		walk++;
-		left --;
-		if(c < _size) {
-			outs << ",";
-			left--;
+	while(c < n) {
+		if(c > 0)
+			*out++ = ',';
+		if(rdptr == walk + c) {
+			ALLOC::memcpy(out, (rdptr == wrtptr) ? "R*W" : "RD*", 3);
+			out += 3;
+		} else if(wrtptr == walk + c) {
+			ALLOC::memcpy(out, "WR*", 3);
+			out += 3;
 		}
+		// the run of bytes up to the next marker
+		int end = n;
+		if(rdptr > walk + c && rdptr < walk + end)
+			end = (int) (rdptr - walk);
+		if(wrtptr > walk + c && wrtptr < walk + end)
+			end = (int) (wrtptr - walk);
+		out = tw_hex_encode_sep(out, walk + c, end - c, ',');
+		c = end;
+	}
+	if(walk + c == wrtptr) { // if the block is fully written to, then the wr_ptr is point to byte after the end of the block.
+		ALLOC::memcpy(out, "WR*", 3);
+		out += 3;
 	}
-	if(walk == wrtptr) // if the block is fully written to, then the wr_ptr is point to byte after the end of the block.
-		outs << "WR*";
-	outs << "]";
-	return max - left;
+	*out++ = ']';
+	return out;
 }
 
 template <class ALLOC>
 std::string &MemBlk<ALLOC>::hexDump(std::string &out) {
-	std::ostringstream outs;
-	out.clear();
-	outs.str(out);
-	_concatHexDump(outs,0,0,0);
-	out = outs.str();
+	out.resize(_hexDumpBound(_size));
+	char *end = _hexDumpTo(&out[0], 0, 0, _size);
+	out.resize(end - &out[0]);
 	return out;
 }
 
@@ -521,6 +733,7 @@ BufBlk<ALLOC>& BufBlk<ALLOC>::operator=(const BufBlk<ALLOC> &o) {
 		_blk->release(); // release underlying memblk
 
 	assignFromBlk( o );
+	return *this;
 }
 
 
@@ -537,6 +750,113 @@ BufBlk<ALLOC> *BufBlk<ALLOC>::duplicate() {
 	return new BufBlk( *this );
 }
 
+/**
+ * Returns a view of 'len' bytes of the readable data in the chain, starting 'rd_offset' bytes past this block's
+ * rd_ptr. Nothing is copied - each block of the new chain shares the MemBlk it came from (ref count +1),
+ * w/ its rd_ptr / wr_ptr narrowed to the range. Writing to the slice clones the block first (see makeWritable()).
+ * @return the new chain, or NULL if the range is not all there (or len is 0)
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *BufBlk<ALLOC>::slice( int rd_offset, int len ) {
+	BufBlk *ret = NULL;
+	BufBlk *tail = NULL;
+	BufBlk *look = this;
+	while(look && rd_offset >= look->length()) { // find the block where rd_offset starts
+		rd_offset -= look->length();
+		look = look->_nextblk;
+	}
+	while(look && len > 0) {
+		int l = look->length() - rd_offset;
+		if(l > len) l = len;
+		if(l > 0) {
+			BufBlk *b = new BufBlk( look->_blk );
+			b->_rd_ptr = look->_rd_ptr + rd_offset;
+			b->_mark = b->_rd_ptr;
+			b->_wr_ptr = b->_rd_ptr + l;
+			b->_flags = look->_flags;
+			if(tail) tail->_nextblk = b;
+			else ret = b;
+			tail = b;
+			len -= l;
+		}
+		rd_offset = 0;
+		look = look->_nextblk;
+	}
+	if(len > 0 && ret) { // ran out of chain
+		ret->release();
+		ret = NULL;
+	}
+	return ret;
+}
+
+/**
+ * @return true if the MemBlk under this block is referenced by other BufBlks (or is a read only file block),
+ * so writing to it would change what they see.
+ */
+template <class ALLOC>
+bool BufBlk<ALLOC>::isShared() {
+	return _blk && (_blk->getRefCount() > 1 || _blk->_file);
+}
+
+/**
+ * Copy-on-write. If this block's memory is shared (isShared()), gives this BufBlk its own copy of the MemBlk,
+ * and drops its reference to the shared one. Only this block is copied - not the chain.
+ * copyFrom(), fillWith(), resize() and eatBytes() do this on their own. Call it before writing through
+ * rd_ptr() / wr_ptr() directly.
+ * @return false if out of memory
+ */
+template <class ALLOC>
+bool BufBlk<ALLOC>::makeWritable() {
+	if(!isShared())
+		return true;
+	MemBlk<ALLOC> *m = new MemBlk<ALLOC>( _blk->_size );
+	if(!m->_proper) {
+		m->release();
+		return false;
+	}
+	ALLOC::memcpy(m->_base, _blk->_base, _blk->_size);
+	char *oldb = (char *) _blk->_base;
+	_rd_ptr = ((char *) m->_base) + (_rd_ptr - oldb);
+	_wr_ptr = ((char *) m->_base) + (_wr_ptr - oldb);
+	if(_mark)
+		_mark = ((char *) m->_base) + (_mark - oldb);
+	_blk->release();
+	_blk = m;
+	return true;
+}
+
+/**
+ * Creates a BufBlk over a MemBlk::newInline() block - the MemBlk and its memory are one allocation.
+ * Reference count starts at 1, as w/ BufBlk(size).
+ * @param size in bytes of memory required
+ * @return the new BufBlk, or NULL if out of memory
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *BufBlk<ALLOC>::newInline( int size ) {
+	MemBlk<ALLOC> *m = MemBlk<ALLOC>::newInline(size);
+	if(!m) return NULL;
+	m->_ref_count.store(0, std::memory_order_relaxed); // the BufBlk checks it out
+	BufBlk<ALLOC> *ret = new BufBlk<ALLOC>(m);
+	ret->_mark = ret->_rd_ptr;
+	return ret;
+}
+
+/**
+ * Creates a BufBlk over a MemBlk::newFile() block - 'len' bytes of the file 'fd' from 'offset'.
+ * The whole range is readable (wr_ptr is at the end). Use sendTo() to send it w/o copying.
+ * @return the new BufBlk, or NULL w/ errno set
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *BufBlk<ALLOC>::newFile( int fd, off_t offset, int len, bool closefd ) {
+	MemBlk<ALLOC> *m = MemBlk<ALLOC>::newFile(fd, offset, len, closefd);
+	if(!m) return NULL;
+	m->_ref_count.store(0, std::memory_order_relaxed); // the BufBlk checks it out
+	BufBlk<ALLOC> *ret = new BufBlk<ALLOC>(m);
+	ret->_mark = ret->_rd_ptr;
+	ret->_wr_ptr = ret->_rd_ptr + len;
+	return ret;
+}
+
 /** This constuctor attaches a bufblk to an existing block of memory. If manage is true,
  * it will also manage this buffer, and free it when no references exist.
  * Reference count start at one upon creation.
@@ -721,6 +1041,10 @@ int BufBlk<ALLOC>::copyFrom( const void *src, int size ) {
 	int s = size;
 	if(BufBlk<ALLOC>::freespace() < size)
 		s = BufBlk<ALLOC>::freespace();
+	if(s <= 0)
+		return 0;
+	if(!makeWritable())
+		return 0;
 	ALLOC::memcpy(_wr_ptr, src, s);
 	_wr_ptr = _wr_ptr + s;
 	return s;
@@ -749,7 +1073,7 @@ bool BufBlk<ALLOC>::isValid() {
 template <class ALLOC>
 bool BufBlk<ALLOC>::resize(int size) {
 	bool ret = false;
-	if(_blk) {
+	if(_blk && !_blk->_file && makeWritable()) { // file blocks can't be resized
 		char *oldb = (char *) _blk->_base;
 		if(_blk->resize(size)) {
 			_rd_ptr = ((char *) _blk->_base) + (_rd_ptr - oldb);
@@ -836,6 +1160,31 @@ int BufBlk<ALLOC>::total_capacity() {
 	return ret;
 }
 
+/**
+ * @return the number of blocks in the chain, including this one
+ */
+template <class ALLOC>
+int BufBlk<ALLOC>::total_blocks() {
+	BufBlk *look = this;
+	int ret = 0;
+	while(look) {
+		ret++;
+		look=look->_nextblk;
+	}
+	return ret;
+}
+
+/**
+ * @return the last block in the chain
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *BufBlk<ALLOC>::tail() {
+	BufBlk *look = this;
+	while(look->_nextblk)
+		look=look->_nextblk;
+	return look;
+}
+
 /**
  * Fills the entire underlying memory block with value 'v']
  * (Irregardless of rd_ptr and wr_ptr)
@@ -843,35 +1192,64 @@ int BufBlk<ALLOC>::total_capacity() {
  */
 template <class ALLOC>
 void BufBlk<ALLOC>::fillWith(char v) {
-	_blk->fillWith(v);
+	if(makeWritable())
+		_blk->fillWith(v);
 }
 
 /**
  * dumps the entire chain of memory blocks, as a list of hexadecimal number (per byte)
+ * The string is sized once, up front - nothing is formatted through streams.
  * @param in string object the dump will be placed in
- * @param max number of chars to put in string (0 is no max, dump everything in)
+ * @param max most bytes to dump, over the whole chain (0 is no max, dump everything in)
  */
 template <class ALLOC>
 std::string &BufBlk<ALLOC>::hexDump(std::string &out, int max) {
-	ostringstream outs;
-	out.clear();
-	outs.str(out);
-	outs.setf(std::ios_base::hex,std::ios_base::basefield);
+	int left = max ? max : INT_MAX;
+	int space = 4; // "END" + NUL
+	for(BufBlk *look = this; look && left > 0; look = look->_nextblk) {
+		int n = (look->_blk->size() < left) ? look->_blk->size() : left;
+		space += MemBlk<ALLOC>::_hexDumpBound(n) + 2;
+		left -= n;
+	}
+	out.resize(space);
+	out.resize(hexDump(&out[0], space, max));
+	return out;
+}
+
+/**
+ * Same as hexDump(std::string &, int), into a caller's buffer - for tracing w/o allocating. If the buffer is too
+ * small, the dump is cut short (still ending w/ "END"). Always NUL terminated if space > 0.
+ * @param out the buffer
+ * @param space size of 'out'
+ * @param max most bytes to dump, over the whole chain (0 is no max)
+ * @return the length of the dump, not including the NUL
+ */
+template <class ALLOC>
+int BufBlk<ALLOC>::hexDump(char *out, int space, int max) {
+	if(space < 4) {
+		if(space > 0) *out = '\0';
+		return 0;
+	}
+	char *walk = out;
+	char *end = out + space - 4; // leaves room for "END" + NUL
+	int left = max ? max : INT_MAX;
 	BufBlk *look = this;
-	int left = max - 3; // for "END"
-	while(look) {
-		left = left - 4;
-		if(max && left <= 0) break;
-		if(max)
-			left = left - look->_blk->_concatHexDump(outs, look->_rd_ptr, look->_wr_ptr, left);
-		else
-			look->_blk->_concatHexDump(outs, look->_rd_ptr, look->_wr_ptr, 0);
-		outs << "->";
+	while(look && left > 0) {
+		int n = (look->_blk->size() < left) ? look->_blk->size() : left;
+		int room = (int) (end - walk) - 2; // less "->"
+		if(MemBlk<ALLOC>::_hexDumpBound(n) > room) {
+			n = (room - MemBlk<ALLOC>::_hexDumpBound(0)) / 3;
+			if(n < 0) break;
+			left = n; // this is the last one
+		}
+		walk = look->_blk->_hexDumpTo(walk, look->_rd_ptr, look->_wr_ptr, n);
+		*walk++ = '-';
+		*walk++ = '>';
+		left -= n;
 		look=look->_nextblk;
 	}
-	outs << "END";
-	out = outs.str();
-	return out;
+	ALLOC::memcpy(walk, "END", 4);
+	return (int) (walk + 3 - out);
 }
 
 /**
@@ -902,6 +1280,10 @@ char *BufBlk<ALLOC>::rd_ptr() {
 	return _rd_ptr;
 }
 
+/**
+ * @return the write pointer. Call makeWritable() before writing through it (and then inc_wr_ptr()) -
+ * the block may share its memory (isShared()).
+ */
 template <class ALLOC>
 char *BufBlk<ALLOC>::wr_ptr() {
 	return _wr_ptr;
@@ -974,6 +1356,212 @@ bool BufBlk<ALLOC>::isContigousReadble(char *pos, int len) {
 		return false;
 }
 
+/**
+ * Fills 'iov' with the readable area (rd_ptr to wr_ptr) of each block in the chain, starting with this one.
+ * Empty blocks are skipped. Nothing is copied, the iovecs point into the blocks.
+ * @param iov array to fill
+ * @param max number of entries in iov
+ * @param bytes [out] if not NULL, set to the total bytes described by the filled entries
+ * @return the number of entries filled
+ */
+template <class ALLOC>
+int BufBlk<ALLOC>::getIovecs( struct iovec *iov, int max, int *bytes ) {
+	int n = 0;
+	int total = 0;
+	BufBlk *look = this;
+	while(look && n < max) {
+		if(look->_blk && look->length() > 0) {
+			iov[n].iov_base = look->_rd_ptr;
+			iov[n].iov_len = look->length();
+			total += look->length();
+			n++;
+		}
+		look = look->_nextblk;
+	}
+	if(bytes) *bytes = total;
+	return n;
+}
+
+/**
+ * Like getIovecs(), but for the writable space (wr_ptr to end of block) of each block in the chain.
+ * Blocks w/ free space are made writable (makeWritable()) first, so data read into them can not show
+ * up in a block they share memory with (a slice()'s free space is the rest of its source's data).
+ * Stops at a block which can not be copied (out of memory).
+ * @return the number of entries filled
+ */
+template <class ALLOC>
+int BufBlk<ALLOC>::getFreeIovecs( struct iovec *iov, int max, int *bytes ) {
+	int n = 0;
+	int total = 0;
+	BufBlk *look = this;
+	while(look && n < max) {
+		if(look->_blk && look->freespace() > 0) {
+			if(!look->makeWritable())
+				break;
+			iov[n].iov_base = look->_wr_ptr;
+			iov[n].iov_len = look->freespace();
+			total += look->freespace();
+			n++;
+		}
+		look = look->_nextblk;
+	}
+	if(bytes) *bytes = total;
+	return n;
+}
+
+// moves rd_ptr forward n bytes, across as many blocks as needed. Emptied blocks are left in the chain.
+template <class ALLOC>
+void BufBlk<ALLOC>::advanceRdPtrs( int n ) {
+	BufBlk *look = this;
+	while(look && n > 0) {
+		int l = look->length();
+		if(l > n) l = n;
+		look->_rd_ptr += l;
+		n -= l;
+		look = look->_nextblk;
+	}
+}
+
+// moves wr_ptr forward n bytes, filling each block before moving to the next
+template <class ALLOC>
+void BufBlk<ALLOC>::advanceWrPtrs( int n ) {
+	BufBlk *look = this;
+	while(look && n > 0) {
+		if(look->_blk) {
+			int l = look->freespace();
+			if(l > n) l = n;
+			look->_wr_ptr += l;
+			n -= l;
+		}
+		look = look->_nextblk;
+	}
+}
+
+/**
+ * Writes the readable data of the whole chain to 'fd' with a single writev() - no copying.
+ * The rd_ptr of each block is moved past whatever was written, so on a partial write
+ * (non-blocking fd, signal) calling writeTo() again picks up where it left off. Blocks which
+ * are fully written stay in the chain with length() 0.
+ * At most TW_BUFBLK_MAX_IOV blocks are sent per call.
+ * @param fd
+ * @return bytes written, or -1 w/ errno set (EAGAIN etc.). EINTR is retried.
+ */
+template <class ALLOC>
+int BufBlk<ALLOC>::writeTo( int fd ) {
+	struct iovec iov[TW_BUFBLK_MAX_IOV];
+	int n = getIovecs(iov, TW_BUFBLK_MAX_IOV);
+	if(!n) return 0;
+	ssize_t r;
+	do {
+		r = ::writev(fd, iov, n);
+	} while(r < 0 && errno == EINTR);
+	if(r > 0)
+		advanceRdPtrs((int) r);
+	return (int) r;
+}
+
+/**
+ * Reads from 'fd' into the free space of the chain with a single readv(). Each block is filled
+ * in order, and its wr_ptr is moved forward by what landed in it.
+ * @param fd
+ * @return bytes read, 0 on end of file (or no free space), or -1 w/ errno set. EINTR is retried.
+ */
+template <class ALLOC>
+int BufBlk<ALLOC>::readFrom( int fd ) {
+	struct iovec iov[TW_BUFBLK_MAX_IOV];
+	int n = getFreeIovecs(iov, TW_BUFBLK_MAX_IOV);
+	if(!n) return 0;
+	ssize_t r;
+	do {
+		r = ::readv(fd, iov, n);
+	} while(r < 0 && errno == EINTR);
+	if(r > 0)
+		advanceWrPtrs((int) r);
+	return (int) r;
+}
+
+template <class ALLOC>
+bool BufBlk<ALLOC>::isFileBlk() {
+	return _blk && _blk->_file;
+}
+
+/**
+ * @return the file offset of rd_ptr, for a block from newFile(). -1 otherwise.
+ */
+template <class ALLOC>
+off_t BufBlk<ALLOC>::fileOffset() {
+	if(!isFileBlk()) return -1;
+	return _blk->_file->offset + (_rd_ptr - (char *) _blk->_base);
+}
+
+/**
+ * Sends the readable data of the whole chain to 'fd', like writeTo(), but file blocks (newFile()) go
+ * through sendfile() - straight from the page cache, never copied through user space. Runs of memory
+ * blocks between them go out w/ one writev() each. If sendfile() can't be used for 'fd', the file block
+ * is sent from its mapping w/ write() instead.
+ * rd_ptrs are moved past what was sent. Stops at the first partial transfer, so this can be called
+ * again on a non-blocking fd when it is writable.
+ * @param fd
+ * @return bytes sent, or -1 w/ errno set if nothing could be sent. EINTR is retried.
+ */
+template <class ALLOC>
+int BufBlk<ALLOC>::sendTo( int fd ) {
+	int total = 0;
+	BufBlk *look = this;
+	while(look) {
+		if(!look->_blk || look->length() == 0) {
+			look = look->_nextblk;
+			continue;
+		}
+		ssize_t r;
+		int want;
+		if(look->_blk->_file) {
+			want = look->length();
+			off_t off = look->fileOffset();
+			do {
+				r = ::sendfile(fd, look->_blk->_file->fd, &off, want);
+			} while(r < 0 && errno == EINTR);
+			if(r < 0 && (errno == EINVAL || errno == ENOSYS)) {
+				do {
+					r = ::write(fd, look->_rd_ptr, want);
+				} while(r < 0 && errno == EINTR);
+			}
+			if(r > 0)
+				look->_rd_ptr += r;
+			if(r > 0 && r == want)
+				look = look->_nextblk;
+		} else {
+			// gather memory blocks up to the next file block
+			struct iovec iov[TW_BUFBLK_MAX_IOV];
+			int n = 0;
+			want = 0;
+			BufBlk *walk = look;
+			while(walk && n < TW_BUFBLK_MAX_IOV && !(walk->_blk && walk->_blk->_file)) {
+				if(walk->_blk && walk->length() > 0) {
+					iov[n].iov_base = walk->_rd_ptr;
+					iov[n].iov_len = walk->length();
+					want += walk->length();
+					n++;
+				}
+				walk = walk->_nextblk;
+			}
+			do {
+				r = ::writev(fd, iov, n);
+			} while(r < 0 && errno == EINTR);
+			if(r > 0)
+				look->advanceRdPtrs((int) r);
+			if(r > 0 && r == want)
+				look = walk;
+		}
+		if(r < 0)
+			return total ? total : -1;
+		total += (int) r;
+		if(r < want)
+			break;
+	}
+	return total;
+}
+
 /**
  * returns to the caller a contiguous memory block
  * @param rd_offset offset where you would like the contiguous block to begin, from where the rd_ptr of the current block is(the rd_ptr will not be moved)
@@ -1055,6 +1643,10 @@ BufBlk<ALLOC> *BufBlk<ALLOC>::eatBytes( int rd_offset, int size ) {
 	if(look && (look->length() > need)) { // if we were successful (we need more than rd_offset for sure...)
 		if(look->length() - need - size > 0) {
 			if(need > 0) {
+				if(!look->makeWritable()) { // out of memory - the chain is left as it was
+					TW_DEBUG_L("Failure at eatBytes: out of memory copying a shared block, size %d\n", size);
+					return head;
+				}
 				ALLOC::memmove(look->_rd_ptr + need, look->_rd_ptr + need + size, look->length() - size - need); // shift the remaining memory by the amount we want to get rid of...
 				look->_wr_ptr -= size; // shift the write pointer back (to change the length - and ignore the space we shifted left)
 			} else {
@@ -1070,47 +1662,34 @@ BufBlk<ALLOC> *BufBlk<ALLOC>::eatBytes( int rd_offset, int size ) {
 				look->release();
 			}
 		} else {
-			BufBlk *front = NULL; // front of the blocks to get rid of...
-			prev = look;
+			BufBlk *keep = prev;   // the last block which stays in front of what we drop
+			BufBlk *front = NULL;  // front of the blocks to get rid of...
+			BufBlk *back = NULL;   // ...and the back
 			int frontsz = look->length() - need;
 			if(need > 0) {
 				look->_wr_ptr -= frontsz; // shift the write pointer back (eats bytes to right)
+				keep = look;
 				front = look->_nextblk;
 			} else
-				front = look;
+				front = back = look;
 			size -= frontsz;
 			look = look->_nextblk;
-			BufBlk *back = front;
 			while(look && size > 0){
 				if(size < look->length()) {
 					look->_rd_ptr += size; // eat the last bytes
 					break;
-				} else {
-					size -= look->length();
 				}
+				size -= look->length();
 				back = look;
 				look = look->_nextblk;
 			}
-
-			if(front) {
-				if(front == head)
+			if(back) { // whole blocks to drop: [front..back]
+				back->_nextblk = NULL; // disconnect block
+				if(keep)
+					keep->_nextblk = look; // hook chain past the part we are dropping
+				else
 					head = look;  // fix the head if we are eating the blocks at the head
-//				if(prev != look->_nextblk)
-				if(back != front) {
-					back->_nextblk = NULL; // disconnect block
-					prev->_nextblk = look; // hook chain past the part we are dropping
-//					TW_DEBUG("releasing front.",NULL);
-					front->release();
-				} else {
-					if(prev != front) { // releasing one block
-						if(look == front && size) {} // release nothing if something was remaining and there was only one block
-						else {  // otherwise...
-						front->_nextblk = NULL;
-						prev->_nextblk = look; // hook chain past the part we are dropping
-						front->release();
-						}
-					}
-				}
+				front->release();
 			}
 		}
 	} else
@@ -1269,6 +1848,76 @@ BufBlkIter<ALLOC>::~BufBlkIter() {
 		_start->release();
 }
 
+/**
+ * @param chain a chain to start with (walked once), or NULL. The BufBlkChain owns it.
+ */
+template <class ALLOC>
+BufBlkChain<ALLOC>::BufBlkChain( BufBlk<ALLOC> *chain ) :
+	_head( NULL ),
+	_tail( NULL ),
+	_len( 0 ),
+	_cap( 0 ),
+	_count( 0 ),
+	_stepped( 0 )
+{
+	append(chain);
+}
+
+/**
+ * releases the chain, unless it was take()n
+ */
+template <class ALLOC>
+BufBlkChain<ALLOC>::~BufBlkChain() {
+	if(_head)
+		_head->release();
+}
+
+/**
+ * Adds 'b', and any blocks after it, to the end of the chain. Only walks b's own chain.
+ * DOES NOT increase reference count - the BufBlkChain owns 'b' now.
+ */
+template <class ALLOC>
+void BufBlkChain<ALLOC>::append( BufBlk<ALLOC> *b ) {
+	if(!b) return;
+	if(_tail)
+		_tail->setNexblk(b);
+	else
+		_head = _tail = b;
+	while(_tail->nexblk()) {
+		_len += _tail->length(); // the old tail is in the middle now
+		_cap += _tail->capacity();
+		_count++;
+		_stepped++;
+		_tail = _tail->nexblk();
+	}
+}
+
+/**
+ * @return the chain, which the caller now owns (or NULL if empty). The BufBlkChain is empty after this.
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *BufBlkChain<ALLOC>::take() {
+	BufBlk<ALLOC> *ret = _head;
+	_head = _tail = NULL;
+	_len = _cap = _count = 0;
+	return ret;
+}
+
+template <class ALLOC>
+int BufBlkChain<ALLOC>::total_length() {
+	return _tail ? _len + _tail->length() : 0;
+}
+
+template <class ALLOC>
+int BufBlkChain<ALLOC>::total_capacity() {
+	return _tail ? _cap + _tail->capacity() : 0;
+}
+
+template <class ALLOC>
+int BufBlkChain<ALLOC>::total_blocks() {
+	return _tail ? _count + 1 : 0;
+}
+
 
 
 
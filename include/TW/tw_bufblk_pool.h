@@ -0,0 +1,233 @@
+// tupperware container lib
+// tw_bufblk_pool.h
+
+/*
+ * tw_bufblk_pool.h
+ *
+ * A pool of MemBlks (with their memory) in power of two size classes:
+ *   BufBlkPool<Alloc_Std> pool;
+ *   BufBlk<Alloc_Std> *b = pool.get(1500);  // a 2048 byte block
+ *   ...
+ *   b->release();                           // the MemBlk goes back to the pool
+ */
+
+#ifndef TW_BUFBLK_POOL_H_
+#define TW_BUFBLK_POOL_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+#include <TW/tw_bufblk.h>
+
+// smallest and largest size class. Bigger requests are not pooled.
+#ifndef TW_BUFBLK_POOL_MIN
+#define TW_BUFBLK_POOL_MIN 64
+#endif
+#ifndef TW_BUFBLK_POOL_MAX
+#define TW_BUFBLK_POOL_MAX (64*1024)
+#endif
+// max MemBlks kept per size class - past this released blocks are freed
+#ifndef TW_BUFBLK_POOL_PER_CLASS
+#define TW_BUFBLK_POOL_PER_CLASS 256
+#endif
+
+namespace TWlib {
+
+struct tw_bufblk_pool_stats {
+	uint64_t hits;      // get() served from the pool
+	uint64_t misses;    // get() had to allocate a new block for a size class
+	uint64_t oversize;  // get() larger than the biggest class - never pooled
+	uint64_t recycled;  // released blocks put back in the pool
+	uint64_t dropped;   // released blocks freed, b/c their class was full (or they were resized)
+	int cached;         // blocks sitting in the pool right now
+};
+
+/**
+ * Recycles MemBlks and their memory, instead of freeing them when their reference count reaches zero.
+ *
+ * get(size) rounds size up to a power of two size class, and takes a MemBlk from that class if one
+ * is there - so the only allocation is the BufBlk itself. A pooled MemBlk returns to its class on its
+ * last release(), from whatever thread that happens on. Each class has its own lock.
+ *
+ * capacity() of a block from get() is the class size, which may be more than was asked for.
+ * The pool must outlive every block taken from it.
+ */
+template <class ALLOC>
+class BufBlkPool : public MemBlkRecycler<ALLOC> {
+public:
+	BufBlkPool( int minSize = TW_BUFBLK_POOL_MIN, int maxSize = TW_BUFBLK_POOL_MAX, int perClass = TW_BUFBLK_POOL_PER_CLASS );
+	~BufBlkPool();
+	BufBlk<ALLOC> *get( int size );   // NULL if out of memory
+	int classSize( int size );        // capacity a get(size) would have, or -1 if it is not pooled
+	void recycle( MemBlk<ALLOC> *m );
+	void trim();                      // frees every cached block
+	void getStats( tw_bufblk_pool_stats &out );
+protected:
+	struct sizeclass {  // counters are kept under the class lock, which is taken anyway
+		pthread_mutex_t mutex;
+		MemBlk<ALLOC> **cache;
+		int max;        // room in cache - 0 if it could not be allocated
+		int count;
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t recycled;
+		uint64_t dropped;
+	};
+	int classOf( int size );
+	// ceil(log2(n)), n > 0
+	static inline int log2ceil( int n ) { return (n <= 1) ? 0 : 32 - __builtin_clz((unsigned int) (n - 1)); }
+	int _minShift;
+	int _numClasses;
+	int _perClass;
+	sizeclass *_classes;
+	std::atomic<uint64_t> _oversize;
+	std::atomic<uint64_t> _dropped; // blocks which no longer fit a class
+};
+
+}
+
+using namespace TWlib;
+
+template <class ALLOC>
+BufBlkPool<ALLOC>::BufBlkPool( int minSize, int maxSize, int perClass ) :
+	_minShift( log2ceil(minSize) ),
+	_numClasses( 0 ),
+	_perClass( perClass ),
+	_classes( NULL ),
+	_oversize( 0 ),
+	_dropped( 0 )
+{
+	_numClasses = log2ceil(maxSize) - _minShift + 1;
+	if(_numClasses < 1) _numClasses = 1;
+	_classes = (sizeclass *) ALLOC::malloc(sizeof(sizeclass) * _numClasses);
+	if(!_classes) { // out of memory - no classes, so every get() is a plain new block
+		TW_ERROR("BufBlkPool: out of memory - pool disabled\n", NULL);
+		_numClasses = 0;
+	}
+	for(int c=0;c<_numClasses;c++) {
+		pthread_mutex_init(&_classes[c].mutex, NULL);
+		_classes[c].cache = (MemBlk<ALLOC> **) ALLOC::malloc(sizeof(MemBlk<ALLOC> *) * _perClass);
+		_classes[c].max = _classes[c].cache ? _perClass : 0; // w/o a cache, blocks are just not kept
+		_classes[c].count = 0;
+		_classes[c].hits = 0;
+		_classes[c].misses = 0;
+		_classes[c].recycled = 0;
+		_classes[c].dropped = 0;
+	}
+}
+
+template <class ALLOC>
+BufBlkPool<ALLOC>::~BufBlkPool() {
+	trim();
+	for(int c=0;c<_numClasses;c++) {
+		pthread_mutex_destroy(&_classes[c].mutex);
+		if(_classes[c].cache)
+			ALLOC::free(_classes[c].cache);
+	}
+	if(_classes)
+		ALLOC::free(_classes);
+}
+
+template <class ALLOC>
+int BufBlkPool<ALLOC>::classOf( int size ) {
+	int c = log2ceil(size) - _minShift;
+	if(c < 0) c = 0;
+	if(c >= _numClasses) return -1;
+	return c;
+}
+
+template <class ALLOC>
+int BufBlkPool<ALLOC>::classSize( int size ) {
+	int c = classOf(size);
+	return (c < 0) ? -1 : (1 << (c + _minShift));
+}
+
+/**
+ * @param size bytes needed
+ * @return a new BufBlk, w/ a reference count of 1 and a capacity of at least 'size'. NULL if out of memory.
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *BufBlkPool<ALLOC>::get( int size ) {
+	int c = classOf(size);
+	if(c < 0) {
+		_oversize.fetch_add(1, std::memory_order_relaxed);
+		return new BufBlk<ALLOC>(size);
+	}
+	MemBlk<ALLOC> *m = NULL;
+	sizeclass *sc = &_classes[c];
+	pthread_mutex_lock(&sc->mutex);
+	if(sc->count > 0) {
+		m = sc->cache[--sc->count];
+		sc->hits++;
+	} else
+		sc->misses++;
+	pthread_mutex_unlock(&sc->mutex);
+	if(!m) {
+		m = new MemBlk<ALLOC>(1 << (c + _minShift));
+		if(!m->_proper) {
+			delete m;
+			return NULL;
+		}
+		m->_recycler = this;
+	}
+	m->_ref_count.store(0, std::memory_order_relaxed); // the BufBlk checks it out
+	BufBlk<ALLOC> *ret = new BufBlk<ALLOC>(m);
+	ret->_mark = ret->_rd_ptr;
+	return ret;
+}
+
+/**
+ * Called by MemBlk::release() when a pooled block's reference count reaches zero.
+ */
+template <class ALLOC>
+void BufBlkPool<ALLOC>::recycle( MemBlk<ALLOC> *m ) {
+	int c = classOf(m->_size);
+	if(c >= 0 && m->_manage && m->_size == (1 << (c + _minShift))) { // not resize()'d off its class
+		sizeclass *sc = &_classes[c];
+		pthread_mutex_lock(&sc->mutex);
+		if(sc->count < sc->max) {
+			sc->cache[sc->count++] = m;
+			sc->recycled++;
+			pthread_mutex_unlock(&sc->mutex);
+			return;
+		}
+		sc->dropped++;
+		pthread_mutex_unlock(&sc->mutex);
+	} else
+		_dropped.fetch_add(1, std::memory_order_relaxed);
+	m->_destroy();
+}
+
+template <class ALLOC>
+void BufBlkPool<ALLOC>::trim() {
+	for(int c=0;c<_numClasses;c++) {
+		sizeclass *sc = &_classes[c];
+		pthread_mutex_lock(&sc->mutex);
+		while(sc->count > 0) {
+			sc->cache[--sc->count]->_destroy();
+		}
+		pthread_mutex_unlock(&sc->mutex);
+	}
+}
+
+template <class ALLOC>
+void BufBlkPool<ALLOC>::getStats( tw_bufblk_pool_stats &out ) {
+	::memset(&out, 0, sizeof(out));
+	out.oversize = _oversize.load(std::memory_order_relaxed);
+	out.dropped = _dropped.load(std::memory_order_relaxed);
+	for(int c=0;c<_numClasses;c++) {
+		sizeclass *sc = &_classes[c];
+		pthread_mutex_lock(&sc->mutex);
+		out.hits += sc->hits;
+		out.misses += sc->misses;
+		out.recycled += sc->recycled;
+		out.dropped += sc->dropped;
+		out.cached += sc->count;
+		pthread_mutex_unlock(&sc->mutex);
+	}
+}
+
+#endif /* TW_BUFBLK_POOL_H_ */
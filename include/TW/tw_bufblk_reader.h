@@ -0,0 +1,411 @@
+// tupperware container lib
+// tw_bufblk_reader.h
+
+/*
+ * tw_bufblk_reader.h
+ *
+ * A cursor over a BufBlk chain, for parsing framed protocols in place. Integers, varints and delimiter
+ * searches work across block boundaries, w/o copying the chain into a scratch buffer:
+ *   BufBlkReader<Alloc_Std> r(chain);
+ *   uint32_t len;
+ *   while(r.peekBE(len) && r.available() >= 4 + (int) len) {
+ *       r.skip(4);
+ *       BufBlk<Alloc_Std> *frame = r.takeFrame(len); // zero copy, shares the chain's memory
+ *       ...
+ *   }
+ *   // later: r.append(more);
+ */
+
+#ifndef TW_BUFBLK_READER_H_
+#define TW_BUFBLK_READER_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <TW/tw_bufblk.h>
+
+namespace TWlib {
+
+/**
+ * Reads a BufBlk chain from the front. The reader owns the chain it is given (and anything append()ed)
+ * and release()s it when destroyed, unless detach()ed.
+ * peek*() look at the data at the cursor, read*() also move the cursor past it. All of them return false,
+ * and leave the cursor alone, if not enough data is there yet.
+ * The data in front of the cursor stays in the chain until consume() or takeFrame().
+ * The reader keeps its own count of the bytes in the chain and its tail, so append() and available() do
+ * not walk the chain - add data only through append(), and don't change the blocks behind chain().
+ */
+template <class ALLOC>
+class BufBlkReader {
+public:
+	BufBlkReader( BufBlk<ALLOC> *chain = NULL );
+	~BufBlkReader();
+	void append( BufBlk<ALLOC> *b );
+	BufBlk<ALLOC> *chain() { return _head; }
+	BufBlk<ALLOC> *detach();
+	int available();
+	int position() { return _pos; }
+	void rewind();
+	bool skip( int n );
+
+	bool peekBytes( void *out, int n );
+	bool readBytes( void *out, int n );
+	template <typename T> bool peekLE( T &v );
+	template <typename T> bool peekBE( T &v );
+	template <typename T> bool readLE( T &v ) { return peekLE(v) && skip(sizeof(T)); }
+	template <typename T> bool readBE( T &v ) { return peekBE(v) && skip(sizeof(T)); }
+	bool peekVarint( uint64_t &v, int *len = NULL );
+	bool readVarint( uint64_t &v );
+	bool readVarintSigned( int64_t &v );
+
+	int find( char c, int max = -1 );
+	int find( const char *delim, int dlen, int max = -1 );
+
+	BufBlk<ALLOC> *takeFrame( int len );
+	void consume();
+protected:
+	void track( BufBlk<ALLOC> *b );
+	void settle();
+	int findByte( char c, int start, int limit, BufBlk<ALLOC> *&blk, int &boff );
+	static bool matchFrom( BufBlk<ALLOC> *blk, int boff, const char *s, int n );
+	BufBlk<ALLOC> *_head;
+	BufBlk<ALLOC> *_tail;
+	int _total;            // readable bytes in the chain - kept by append() and consume()
+	BufBlk<ALLOC> *_cur;   // the block the cursor is in
+	int _off;              // cursor's offset from _cur's rd_ptr
+	int _pos;              // cursor's offset from _head's rd_ptr
+};
+
+template <class ALLOC>
+BufBlkReader<ALLOC>::BufBlkReader( BufBlk<ALLOC> *chain ) :
+	_head( chain ),
+	_tail( NULL ),
+	_total( 0 ),
+	_cur( chain ),
+	_off( 0 ),
+	_pos( 0 )
+{
+	track(chain);
+}
+
+template <class ALLOC>
+BufBlkReader<ALLOC>::~BufBlkReader() {
+	if(_head)
+		_head->release();
+}
+
+/**
+ * Adds more data to the end of the chain. The reader takes ownership of 'b'.
+ */
+template <class ALLOC>
+void BufBlkReader<ALLOC>::append( BufBlk<ALLOC> *b ) {
+	if(!b) return;
+	if(_head)
+		_tail->setNexblk(b);
+	else {
+		_head = _cur = b;
+		_off = _pos = 0;
+	}
+	track(b);
+}
+
+// counts in the chain starting at 'b', which was just added to the end
+template <class ALLOC>
+void BufBlkReader<ALLOC>::track( BufBlk<ALLOC> *b ) {
+	for(; b; b = b->nexblk()) {
+		_total += b->length();
+		_tail = b;
+	}
+}
+
+/**
+ * Gives the chain (including any data in front of the cursor) back to the caller, and empties the reader.
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *BufBlkReader<ALLOC>::detach() {
+	BufBlk<ALLOC> *ret = _head;
+	_head = _tail = _cur = NULL;
+	_total = _off = _pos = 0;
+	return ret;
+}
+
+/**
+ * @return the number of bytes from the cursor to the end of the chain
+ */
+template <class ALLOC>
+int BufBlkReader<ALLOC>::available() {
+	return _total - _pos;
+}
+
+/**
+ * moves the cursor back to the front of the chain
+ */
+template <class ALLOC>
+void BufBlkReader<ALLOC>::rewind() {
+	_cur = _head;
+	_off = _pos = 0;
+}
+
+// moves _cur forward past blocks the cursor has read all of
+template <class ALLOC>
+void BufBlkReader<ALLOC>::settle() {
+	while(_cur && _off >= _cur->length() && _cur->nexblk()) {
+		_off -= _cur->length();
+		_cur = _cur->nexblk();
+	}
+}
+
+template <class ALLOC>
+bool BufBlkReader<ALLOC>::skip( int n ) {
+	if(n < 0 || available() < n)
+		return false;
+	_off += n;
+	_pos += n;
+	settle();
+	return true;
+}
+
+template <class ALLOC>
+bool BufBlkReader<ALLOC>::peekBytes( void *out, int n ) {
+	settle();
+	if(!_cur || n < 0)
+		return false;
+	if(_off + n <= _cur->length()) { // the usual case - all in this block
+		ALLOC::memcpy(out, _cur->rd_ptr() + _off, n);
+		return true;
+	}
+	if(available() < n)
+		return false;
+	char *walk = (char *) out;
+	BufBlk<ALLOC> *b = _cur;
+	int o = _off;
+	while(n > 0) {
+		int l = b->length() - o;
+		if(l > n) l = n;
+		ALLOC::memcpy(walk, b->rd_ptr() + o, l);
+		walk += l;
+		n -= l;
+		o = 0;
+		b = b->nexblk();
+	}
+	return true;
+}
+
+template <class ALLOC>
+bool BufBlkReader<ALLOC>::readBytes( void *out, int n ) {
+	return peekBytes(out, n) && skip(n);
+}
+
+/**
+ * The little endian integer at the cursor. T is an integer type: r.peekLE(u16), r.readLE(i64) ...
+ */
+template <class ALLOC>
+template <typename T>
+bool BufBlkReader<ALLOC>::peekLE( T &v ) {
+	unsigned char b[sizeof(T)];
+	if(!peekBytes(b, sizeof(T)))
+		return false;
+	uint64_t x = 0;
+	for(int n=0;n<(int) sizeof(T);n++)
+		x |= (uint64_t) b[n] << (8 * n);
+	v = (T) x;
+	return true;
+}
+
+/**
+ * The big endian (network order) integer at the cursor.
+ */
+template <class ALLOC>
+template <typename T>
+bool BufBlkReader<ALLOC>::peekBE( T &v ) {
+	unsigned char b[sizeof(T)];
+	if(!peekBytes(b, sizeof(T)))
+		return false;
+	uint64_t x = 0;
+	for(int n=0;n<(int) sizeof(T);n++)
+		x = (x << 8) | b[n];
+	v = (T) x;
+	return true;
+}
+
+/**
+ * An unsigned LEB128 varint (protobuf style) at the cursor.
+ * @param len [out] if given, the number of bytes it took
+ * @return false if the varint is incomplete, or longer than 10 bytes
+ */
+template <class ALLOC>
+bool BufBlkReader<ALLOC>::peekVarint( uint64_t &v, int *len ) {
+	settle();
+	if(!_cur)
+		return false;
+	uint64_t x = 0;
+	int n = 0;
+	BufBlk<ALLOC> *b = _cur;
+	int o = _off;
+	while(b && n < 10) {
+		const unsigned char *p = (const unsigned char *) b->rd_ptr() + o;
+		const unsigned char *end = (const unsigned char *) b->wr_ptr();
+		while(p < end && n < 10) {
+			x |= (uint64_t) (*p & 0x7F) << (7 * n);
+			n++;
+			if(!(*p++ & 0x80)) {
+				v = x;
+				if(len) *len = n;
+				return true;
+			}
+		}
+		o = 0;
+		b = b->nexblk();
+	}
+	return false;
+}
+
+template <class ALLOC>
+bool BufBlkReader<ALLOC>::readVarint( uint64_t &v ) {
+	int l;
+	return peekVarint(v, &l) && skip(l);
+}
+
+/**
+ * a zigzag encoded signed varint (protobuf sint64)
+ */
+template <class ALLOC>
+bool BufBlkReader<ALLOC>::readVarintSigned( int64_t &v ) {
+	uint64_t x;
+	if(!readVarint(x))
+		return false;
+	v = (int64_t) (x >> 1) ^ -(int64_t) (x & 1);
+	return true;
+}
+
+// offset from the cursor of the first 'c' at or past 'start', before 'limit' (-1: no limit).
+// blk / boff are set to where it is.
+template <class ALLOC>
+int BufBlkReader<ALLOC>::findByte( char c, int start, int limit, BufBlk<ALLOC> *&blk, int &boff ) {
+	settle();
+	BufBlk<ALLOC> *b = _cur;
+	int o = _off;
+	int at = 0; // offset from the cursor of b->rd_ptr() + o
+	while(b && at + (b->length() - o) <= start) { // find the block 'start' is in
+		at += b->length() - o;
+		o = 0;
+		b = b->nexblk();
+	}
+	if(b) {
+		o += start - at;
+		at = start;
+	}
+	while(b) {
+		int l = b->length() - o;
+		if(limit >= 0 && at + l > limit)
+			l = limit - at;
+		if(l > 0) {
+			const char *p = b->rd_ptr() + o;
+			const char *hit = (const char *) memchr(p, c, l);
+			if(hit) {
+				blk = b;
+				boff = (int) (hit - b->rd_ptr());
+				return at + (int) (hit - p);
+			}
+		}
+		at += l;
+		if(limit >= 0 && at >= limit)
+			break;
+		o = 0;
+		b = b->nexblk();
+	}
+	return -1;
+}
+
+// true if the n bytes starting at blk's rd_ptr + boff are 's'
+template <class ALLOC>
+bool BufBlkReader<ALLOC>::matchFrom( BufBlk<ALLOC> *blk, int boff, const char *s, int n ) {
+	while(n > 0 && blk) {
+		int l = blk->length() - boff;
+		if(l > n) l = n;
+		if(memcmp(blk->rd_ptr() + boff, s, l))
+			return false;
+		s += l;
+		n -= l;
+		boff = 0;
+		blk = blk->nexblk();
+	}
+	return n == 0;
+}
+
+/**
+ * Searches for a byte from the cursor on, across blocks. Uses memchr() on each block.
+ * @param max only look in the first 'max' bytes (-1: all of the chain)
+ * @return the offset of 'c' from the cursor, or -1 if not found
+ */
+template <class ALLOC>
+int BufBlkReader<ALLOC>::find( char c, int max ) {
+	BufBlk<ALLOC> *b;
+	int o;
+	return findByte(c, 0, max, b, o);
+}
+
+/**
+ * Searches for a delimiter (such as "\r\n") from the cursor on. It may span blocks.
+ * @param max the delimiter must end in the first 'max' bytes (-1: anywhere in the chain)
+ * @return the offset of the delimiter's first byte from the cursor, or -1 if not found
+ */
+template <class ALLOC>
+int BufBlkReader<ALLOC>::find( const char *delim, int dlen, int max ) {
+	if(dlen <= 0)
+		return -1;
+	int limit = (max >= 0) ? max - dlen + 1 : -1; // where the first byte may be
+	if(max >= 0 && limit <= 0)
+		return -1;
+	int from = 0;
+	while(1) {
+		BufBlk<ALLOC> *b;
+		int o;
+		int at = findByte(delim[0], from, limit, b, o);
+		if(at < 0)
+			return -1;
+		if(matchFrom(b, o, delim, dlen))
+			return at;
+		from = at + 1;
+	}
+}
+
+/**
+ * Takes the 'len' bytes at the cursor as their own chain, and drops everything up to the end of them
+ * from the reader (w/ eatBytes()). Nothing is copied - the frame shares the memory of the chain.
+ * The cursor is left at the byte after the frame, which is now the front of the chain.
+ * @return the frame, or NULL if 'len' bytes are not available (or len is 0)
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *BufBlkReader<ALLOC>::takeFrame( int len ) {
+	if(len <= 0 || available() < len)
+		return NULL;
+	settle();
+	BufBlk<ALLOC> *ret = _cur->slice(_off, len);
+	_pos += len;
+	consume();
+	return ret;
+}
+
+/**
+ * Drops the data in front of the cursor from the chain, releasing blocks which are used up.
+ * If that is all of it, the chain is released, and chain() is NULL until more is append()ed.
+ */
+template <class ALLOC>
+void BufBlkReader<ALLOC>::consume() {
+	if(_head && _pos > 0) {
+		if(_pos >= _total) { // all of it (and any empty blocks at the end)
+			_head->release();
+			_head = _tail = NULL;
+			_total = 0;
+		} else {
+			_head = _head->eatBytes(0, _pos); // leaves _tail, which still has data past _pos
+			_total -= _pos;
+		}
+	}
+	rewind();
+}
+
+}
+
+#endif /* TW_BUFBLK_READER_H_ */
@@ -0,0 +1,106 @@
+// tupperware container lib
+// tw_checksum.h
+
+/*
+ * tw_checksum.h
+ *
+ * CRC32C and a fast 64-bit hash, over flat memory or streamed across a BufBlk chain:
+ *   uint32_t crc = tw_crc32c_chain(buf);
+ *   uint64_t h = tw_hash64_chain(buf);
+ * The chain versions walk the blocks as they are - no getContigBlock() copy - and give the same
+ * result as hashing the data flat.
+ */
+
+#ifndef TW_CHECKSUM_H_
+#define TW_CHECKSUM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <TW/tw_bufblk.h>
+
+namespace TWlib {
+
+/**
+ * CRC32C (Castagnoli). Start with crc = 0, and pass the previous result to continue over more data
+ * (same convention as zlib's crc32()). Uses the SSE4.2 or ARMv8 CRC32 instructions when the CPU
+ * has them, and a table otherwise.
+ */
+uint32_t tw_crc32c( uint32_t crc, const void *data, size_t len );
+uint32_t tw_crc32c_sw( uint32_t crc, const void *data, size_t len ); // always the table
+bool tw_crc32c_hw();  // true if tw_crc32c() is using CPU instructions
+
+/**
+ * 64-bit non-cryptographic hash (the XXH64 algorithm). Results are the same no matter how the
+ * data is split up between tw_hash64_update() calls.
+ */
+struct tw_hash64_state {
+	uint64_t v[4];
+	uint64_t total;
+	uint64_t seed;
+	unsigned char mem[32]; // partial stripe, carried between updates
+	int memsize;
+};
+
+void tw_hash64_init( tw_hash64_state &s, uint64_t seed = 0 );
+void tw_hash64_update( tw_hash64_state &s, const void *data, size_t len );
+uint64_t tw_hash64_final( tw_hash64_state &s );
+uint64_t tw_hash64( const void *data, size_t len, uint64_t seed = 0 );
+
+// calls f(ptr, len) for each readable piece of the chain in [rd_offset, rd_offset + size). size -1 is 'to the end'
+template <class ALLOC, class F>
+void tw_chain_walk( BufBlk<ALLOC> *b, int rd_offset, int size, F &f ) {
+	while(b && rd_offset >= b->length()) { // find the block where rd_offset starts
+		rd_offset -= b->length();
+		b = b->nexblk();
+	}
+	while(b && size != 0) {
+		int l = b->length() - rd_offset;
+		if(size > 0 && l > size) l = size;
+		if(l > 0)
+			f(b->rd_ptr() + rd_offset, l);
+		if(size > 0) size -= l;
+		rd_offset = 0;
+		b = b->nexblk();
+	}
+}
+
+struct tw_crc32c_walker {
+	uint32_t crc;
+	void operator()( const char *p, int l ) { crc = tw_crc32c(crc, p, l); }
+};
+
+struct tw_hash64_walker {
+	tw_hash64_state s;
+	void operator()( const char *p, int l ) { tw_hash64_update(s, p, l); }
+};
+
+/**
+ * CRC32C of the readable data in a BufBlk chain.
+ * @param b head of chain
+ * @param crc previous crc, to continue a running crc
+ * @param rd_offset where to start, from the rd_ptr of the first block (can be beyond the first block)
+ * @param size bytes to cover, -1 for the rest of the chain
+ */
+template <class ALLOC>
+uint32_t tw_crc32c_chain( BufBlk<ALLOC> *b, uint32_t crc = 0, int rd_offset = 0, int size = -1 ) {
+	tw_crc32c_walker w;
+	w.crc = crc;
+	tw_chain_walk(b, rd_offset, size, w);
+	return w.crc;
+}
+
+/**
+ * tw_hash64() of the readable data in a BufBlk chain. Parameters as w/ tw_crc32c_chain()
+ */
+template <class ALLOC>
+uint64_t tw_hash64_chain( BufBlk<ALLOC> *b, uint64_t seed = 0, int rd_offset = 0, int size = -1 ) {
+	tw_hash64_walker w;
+	tw_hash64_init(w.s, seed);
+	tw_chain_walk(b, rd_offset, size, w);
+	return tw_hash64_final(w.s);
+}
+
+}
+
+#endif /* TW_CHECKSUM_H_ */
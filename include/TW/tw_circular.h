@@ -58,8 +58,11 @@ namespace TWlib {
  * T must support:
  * self assignment: operator= (T &a, T &b) or move()
  * default constructor
+ *
+ * SEMA is TW_SemaTwoWay by default. On Linux, TW_FutexSemaTwoWay can be used instead, which does
+ * not enter the kernel unless a thread has to block.
  */
-template <class T, class ALLOC>
+template <class T, class ALLOC, class SEMA = TW_SemaTwoWay>
 class tw_safeCircular {
 public:
 
@@ -75,7 +78,7 @@ public:
 
 	tw_safeCircular( int size, bool initobj = false );
 	tw_safeCircular() = delete;
-	tw_safeCircular( tw_safeCircular<T,ALLOC> &o ) = delete;
+	tw_safeCircular( tw_safeCircular<T,ALLOC,SEMA> &o ) = delete;
 #ifdef _TW_WINDOWS
 	tw_safeCircular( HANDLE theHeap );
 #endif
@@ -95,14 +98,14 @@ public:
 
 
 	// unimplemented-->
-//	void transferFrom( tw_safeCircular<T,ALLOC> &other ); // transfer record from other to 'this' - can block
-//	bool transferFromNoBlock( tw_safeCircular<T,ALLOC> &other ); // transfer record from other to 'this' -
+//	void transferFrom( tw_safeCircular<T,ALLOC,SEMA> &other ); // transfer record from other to 'this' - can block
+//	bool transferFromNoBlock( tw_safeCircular<T,ALLOC,SEMA> &other ); // transfer record from other to 'this' -
 //	                                               // wont block - false if would have blocked
 	// <--unimplemented
 
-	void cloneFrom( tw_safeCircular<T,ALLOC> &other );
+	void cloneFrom( tw_safeCircular<T,ALLOC,SEMA> &other );
 #ifdef TWLIB_HAS_MOVE_SEMANTICS
-	void transferFrom( tw_safeCircular<T,ALLOC> &other );
+	void transferFrom( tw_safeCircular<T,ALLOC,SEMA> &other );
 #endif
 
 
@@ -115,6 +118,12 @@ public:
 	bool removeOrBlock( T &fill, const int64_t usec_wait );
 	bool removeMvOrBlock( T &fill );
 	bool removeMvOrBlock( T &fill, const int64_t usec_wait );
+	// batch calls - these move up to 'n' / 'max' elements per lock acquisition, with one wakeup
+	int addMany( T *d, int n ); // blocks until all are added. returns number added
+	int addMany( T *d, int n, const int64_t usec_wait );
+	int removeMany( T *fill, int max ); // wont block. returns number removed
+	int removeManyOrBlock( T *fill, int max );
+	int removeMany( T *fill, int max, const int64_t usec_wait );
 	void clear(); // remove all nodes (does not delete T)
 //	void unblock();  // unblock 1 blocking call
 	void unblockAll(); // unblock all blocking calls
@@ -123,7 +132,7 @@ public:
 	void enable();
 
 	class iter final {
-		friend class tw_safeCircular<T,ALLOC>;
+		friend class tw_safeCircular<T,ALLOC,SEMA>;
 	public:
 		bool atEnd();
 		bool data(T &);
@@ -138,14 +147,14 @@ public:
 	};
 
 
-	tw_safeCircular<T,ALLOC>::iter getIter();
+	tw_safeCircular<T,ALLOC,SEMA>::iter getIter();
 
 	int remaining();
 	~tw_safeCircular();
 protected:
 	bool isObjects;
 	bool _reverse;
-	TW_SemaTwoWay sema;
+	SEMA sema;
 	bool enabled; // if enabled the FIFO can take new values
 //	pthread_mutex_t newDataMutex; // thread safety for FIFO
 //	pthread_cond_t newdataCond;
@@ -219,8 +228,8 @@ using namespace TWlib;
 
 
 #ifdef _TW_WINDOWS
-template <class T,class ALLOC>
-tw_safeCircular<T,ALLOC>::tw_safeCircular( HANDLE theHeap ) : enabled( true ) {
+template <class T,class ALLOC,class SEMA>
+tw_safeCircular<T,ALLOC,SEMA>::tw_safeCircular( HANDLE theHeap ) : enabled( true ) {
 	alloc = NULL;
 	out = (tw_FIFO_link *) NULL;
 	in = (tw_FIFO_link *) NULL;
@@ -229,8 +238,8 @@ tw_safeCircular<T,ALLOC>::tw_safeCircular( HANDLE theHeap ) : enabled( true ) {
 }
 #endif
 
-template <class T,class ALLOC>
-tw_safeCircular<T,ALLOC>::tw_safeCircular( int size, bool initobj ) : isObjects(initobj), _reverse(false), sema(size), enabled( true ),
+template <class T,class ALLOC,class SEMA>
+tw_safeCircular<T,ALLOC,SEMA>::tw_safeCircular( int size, bool initobj ) : isObjects(initobj), _reverse(false), sema(size), enabled( true ),
 	nextIn(-1), nextOut(0), _size(size), data(NULL) {
 //	alloc = NULL;
 //	pthread_mutex_init( &newDataMutex, NULL );
@@ -249,8 +258,8 @@ tw_safeCircular<T,ALLOC>::tw_safeCircular( int size, bool initobj ) : isObjects(
 /**
  * copies all values from the other circular buffer. This requires T to have a copy cstor
  */
-template <class T,class ALLOC>
-void tw_safeCircular<T,ALLOC>::cloneFrom( tw_safeCircular &other ) {
+template <class T,class ALLOC,class SEMA>
+void tw_safeCircular<T,ALLOC,SEMA>::cloneFrom( tw_safeCircular &other ) {
 	sema.lockSemaOnly();
 	other.sema.lockSemaOnly();
 
@@ -289,8 +298,8 @@ void tw_safeCircular<T,ALLOC>::cloneFrom( tw_safeCircular &other ) {
 /**
  * transfer all values from the other circular buffer. This requires T to have a move cstor
  */
-template <class T,class ALLOC>
-void tw_safeCircular<T,ALLOC>::transferFrom( tw_safeCircular &other ) {
+template <class T,class ALLOC,class SEMA>
+void tw_safeCircular<T,ALLOC,SEMA>::transferFrom( tw_safeCircular &other ) {
 	sema.lockSemaOnly();
 	other.sema.lockSemaOnly();
 
@@ -334,8 +343,8 @@ void tw_safeCircular<T,ALLOC>::transferFrom( tw_safeCircular &other ) {
 /**
  * enables the circular buffer, allowing the adding of new items.
  */
-template <class T,class ALLOC>
-void tw_safeCircular<T,ALLOC>::enable() {
+template <class T,class ALLOC,class SEMA>
+void tw_safeCircular<T,ALLOC,SEMA>::enable() {
 	sema.lockSemaOnly();
 	enabled = true;
 	sema.releaseSemaLock();
@@ -345,8 +354,8 @@ void tw_safeCircular<T,ALLOC>::enable() {
  * disables the FIFO, preventing the adding of new items.
  * Items already in the FIFO can be pulled out.
  */
-template <class T,class ALLOC>
-void tw_safeCircular<T,ALLOC>::disable() {
+template <class T,class ALLOC,class SEMA>
+void tw_safeCircular<T,ALLOC,SEMA>::disable() {
 	sema.lockSemaOnly();
 	enabled = false;
 	sema.releaseSemaLock();
@@ -356,8 +365,8 @@ void tw_safeCircular<T,ALLOC>::disable() {
 /**
  * Will block if queue is full
  */
-template <class T,class ALLOC>
-void tw_safeCircular<T,ALLOC>::add( T &the_d ) {
+template <class T,class ALLOC,class SEMA>
+void tw_safeCircular<T,ALLOC,SEMA>::add( T &the_d ) {
 	sema.acquireAndKeepLock();
 	TW_CIRCULAR_DBG_OUT("post acquireAndKeepLock - add()");
 	nextIn = nextNextIn();
@@ -368,8 +377,8 @@ void tw_safeCircular<T,ALLOC>::add( T &the_d ) {
 }
 
 #ifdef TWLIB_HAS_MOVE_SEMANTICS
-template <class T,class ALLOC>
-void tw_safeCircular<T,ALLOC>::addMv( T &the_d ) {
+template <class T,class ALLOC,class SEMA>
+void tw_safeCircular<T,ALLOC,SEMA>::addMv( T &the_d ) {
 	sema.acquireAndKeepLock();
 	TW_CIRCULAR_DBG_OUT("post acquireAndKeepLock - add(move)");
 	nextIn = nextNextIn();
@@ -380,8 +389,8 @@ void tw_safeCircular<T,ALLOC>::addMv( T &the_d ) {
 }
 #endif
 
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::addIfRoom( T &the_d ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::addIfRoom( T &the_d ) {
 	bool ret = false;
 	TW_CIRCULAR_DBG_OUT("acquireAndKeepLock - add()");
 	if(sema.acquireAndKeepLockNoBlock()) {
@@ -397,8 +406,8 @@ bool tw_safeCircular<T,ALLOC>::addIfRoom( T &the_d ) {
 }
 
 #ifdef TWLIB_HAS_MOVE_SEMANTICS
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::addMvIfRoom( T &the_d ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::addMvIfRoom( T &the_d ) {
 	bool ret = false;
 	TW_CIRCULAR_DBG_OUT("acquireAndKeepLock - add(move)");
 	if(sema.acquireAndKeepLockNoBlock()) {
@@ -416,8 +425,8 @@ bool tw_safeCircular<T,ALLOC>::addMvIfRoom( T &the_d ) {
 
 
 // will block is queue is full!!
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::add( T &the_d, const int64_t usec_wait  ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::add( T &the_d, const int64_t usec_wait  ) {
 	bool ret = true;
 	TW_CIRCULAR_DBG_OUT("acquireAndKeepLock - add()");
 	int r = sema.acquireAndKeepLock(usec_wait);
@@ -434,8 +443,8 @@ bool tw_safeCircular<T,ALLOC>::add( T &the_d, const int64_t usec_wait  ) {
 }
 
 #ifdef TWLIB_HAS_MOVE_SEMANTICS
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::addMv( T &the_d, const int64_t usec_wait  ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::addMv( T &the_d, const int64_t usec_wait  ) {
 	bool ret = true;
 	TW_CIRCULAR_DBG_OUT("acquireAndKeepLock - add(move)");
 	int r = sema.acquireAndKeepLock(usec_wait);
@@ -452,8 +461,8 @@ bool tw_safeCircular<T,ALLOC>::addMv( T &the_d, const int64_t usec_wait  ) {
 }
 #endif
 
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::get(int n, T &d ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::get(int n, T &d ) {
 	bool ret = false;
 	sema.lockSemaOnly();
 	if((n >= 0) && (n < remain())) {
@@ -475,8 +484,8 @@ bool tw_safeCircular<T,ALLOC>::get(int n, T &d ) {
 	return ret;
 }
 
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::set(int n, T &d ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::set(int n, T &d ) {
 	bool ret = false;
 	sema.lockSemaOnly();
 	if((n >= 0) && (n < remain())) {
@@ -499,8 +508,8 @@ bool tw_safeCircular<T,ALLOC>::set(int n, T &d ) {
 }
 
 #ifdef TWLIB_HAS_MOVE_SEMANTICS
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::setMv(int n, T &d ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::setMv(int n, T &d ) {
 	bool ret = false;
 	sema.lockSemaOnly();
 	if((n >= 0) && (n < remain())) {
@@ -525,13 +534,13 @@ bool tw_safeCircular<T,ALLOC>::setMv(int n, T &d ) {
 
 
 
-template <class T,class ALLOC>
-typename tw_safeCircular<T,ALLOC>::iter tw_safeCircular<T,ALLOC>::getIter() {
-	return tw_safeCircular<T,ALLOC>::iter(*this);
+template <class T,class ALLOC,class SEMA>
+typename tw_safeCircular<T,ALLOC,SEMA>::iter tw_safeCircular<T,ALLOC,SEMA>::getIter() {
+	return tw_safeCircular<T,ALLOC,SEMA>::iter(*this);
 }
 
-template <class T,class ALLOC>
-tw_safeCircular<T,ALLOC>::iter::iter(tw_safeCircular<T,ALLOC> &c) :
+template <class T,class ALLOC,class SEMA>
+tw_safeCircular<T,ALLOC,SEMA>::iter::iter(tw_safeCircular<T,ALLOC,SEMA> &c) :
 	owner(c), valid(false), n(0), p(0)
 {
 	c.sema.lockSemaOnly();
@@ -540,8 +549,8 @@ tw_safeCircular<T,ALLOC>::iter::iter(tw_safeCircular<T,ALLOC> &c) :
 		valid = true;
 }
 
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::iter::next() {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::iter::next() {
 	n++;
 	if(n < owner.remain()) {
 		p++;
@@ -553,8 +562,8 @@ bool tw_safeCircular<T,ALLOC>::iter::next() {
 	}
 }
 
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::iter::data(T &d) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::iter::data(T &d) {
 	if(valid && n < owner.remain()) {
 		d = owner.data[p];
 		return true;
@@ -562,23 +571,23 @@ bool tw_safeCircular<T,ALLOC>::iter::data(T &d) {
 		return false;
 }
 
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::iter::atEnd() {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::iter::atEnd() {
 	if(valid && n < owner.remain()) {
 		return false;
 	} else
 		return true;
 }
 
-template <class T,class ALLOC>
-void tw_safeCircular<T,ALLOC>::iter::release() {
+template <class T,class ALLOC,class SEMA>
+void tw_safeCircular<T,ALLOC,SEMA>::iter::release() {
 	owner.sema.releaseSemaLock();
 	valid = false;
 }
 
 
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::remove( T &fill ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::remove( T &fill ) {
 	bool ret = true;
 	sema.lockSemaOnly();
 	int r = remain();
@@ -598,8 +607,8 @@ bool tw_safeCircular<T,ALLOC>::remove( T &fill ) {
 
 
 #ifdef TWLIB_HAS_MOVE_SEMANTICS
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::removeMv( T &fill ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::removeMv( T &fill ) {
 	bool ret = true;
 	sema.lockSemaOnly();
 	int r = remain();
@@ -618,8 +627,8 @@ bool tw_safeCircular<T,ALLOC>::removeMv( T &fill ) {
 }
 #endif
 
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::removeOrBlock( T &fill ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::removeOrBlock( T &fill ) {
 	bool ret = true;
 	sema.lockSemaOnly();
 	TW_CIRCULAR_DBG_OUT("removeOrBlock.. remain = %d", remain());
@@ -653,8 +662,8 @@ bool tw_safeCircular<T,ALLOC>::removeOrBlock( T &fill ) {
 	return ret;
 }
 
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::removeOrBlock( T &fill, const int64_t usec_wait ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::removeOrBlock( T &fill, const int64_t usec_wait ) {
 	bool ret = true;
 	sema.lockSemaOnly();
 	TW_CIRCULAR_DBG_OUT("removeOrBlock.. remain = %d", remain());
@@ -691,8 +700,8 @@ bool tw_safeCircular<T,ALLOC>::removeOrBlock( T &fill, const int64_t usec_wait )
 
 
 #ifdef TWLIB_HAS_MOVE_SEMANTICS
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::removeMvOrBlock( T &fill ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::removeMvOrBlock( T &fill ) {
 	bool ret = true;
 	sema.lockSemaOnly();
 	TW_CIRCULAR_DBG_OUT("removeOrBlock.. remain = %d", remain());
@@ -725,8 +734,8 @@ bool tw_safeCircular<T,ALLOC>::removeMvOrBlock( T &fill ) {
 	}
 	return ret;
 }
-template <class T,class ALLOC>
-bool tw_safeCircular<T,ALLOC>::removeMvOrBlock( T &fill, const int64_t usec_wait ) {
+template <class T,class ALLOC,class SEMA>
+bool tw_safeCircular<T,ALLOC,SEMA>::removeMvOrBlock( T &fill, const int64_t usec_wait ) {
 	bool ret = true;
 	sema.lockSemaOnly();
 	TW_CIRCULAR_DBG_OUT("removeOrBlock.. remain = %d", remain());
@@ -765,8 +774,137 @@ bool tw_safeCircular<T,ALLOC>::removeMvOrBlock( T &fill, const int64_t usec_wait
 
 
 
-template <class T,class ALLOC>
-int tw_safeCircular<T,ALLOC>::remaining(void) {
+/**
+ * Adds all 'n' elements in 'd', blocking when the buffer is full. Elements are copied in as large a group as
+ * there is room for, under one lock, with one wakeup for removers.
+ * @return the number added (less than n only if unblocked / error)
+ */
+template <class T,class ALLOC,class SEMA>
+int tw_safeCircular<T,ALLOC,SEMA>::addMany( T *d, int n ) {
+	int done = 0;
+	while(done < n) {
+		int got = sema.acquireManyAndKeepLock(n - done);
+		TW_CIRCULAR_DBG_OUT("addMany() acquired %d",got);
+		for(int x=0;x<got;x++) {
+			nextIn = nextNextIn();
+			data[nextIn] = d[done++];
+		}
+		sema.releaseSemaLock();
+		if(got < 1) break;
+	}
+	return done;
+}
+
+/**
+ * Like addMany(d,n), but gives up after 'usec_wait' microseconds total.
+ * @return the number added
+ */
+template <class T,class ALLOC,class SEMA>
+int tw_safeCircular<T,ALLOC,SEMA>::addMany( T *d, int n, const int64_t usec_wait ) {
+	timeval tv;
+	timespec ts;
+	gettimeofday(&tv, NULL);
+	TWlib::add_usec_to_timeval(usec_wait, &tv);
+	TWlib::timeval_to_timespec(&tv,&ts);
+	int done = 0;
+	while(done < n) {
+		int got = sema.acquireManyAndKeepLock(n - done, &ts);
+		TW_CIRCULAR_DBG_OUT("addMany() acquired %d",got);
+		for(int x=0;x<got;x++) {
+			nextIn = nextNextIn();
+			data[nextIn] = d[done++];
+		}
+		sema.releaseSemaLock();
+		if(got < 1) break;
+	}
+	return done;
+}
+
+/**
+ * Removes up to 'max' elements into 'fill', under one lock. Will not block.
+ * @return number removed
+ */
+template <class T,class ALLOC,class SEMA>
+int tw_safeCircular<T,ALLOC,SEMA>::removeMany( T *fill, int max ) {
+	sema.lockSemaOnly();
+	int rm = remain();
+	int n = (rm < max) ? rm : max;
+	for(int x=0;x<n;x++) {
+		fill[x] = data[nextOut];
+		nextOut = nextNextOut();
+	}
+	if(n > 0 && n == rm) { // if we are now empty...
+		nextIn = -1; nextOut = 0; _reverse = false;
+	}
+	sema.releaseManyWithoutLock(n);
+	sema.releaseSemaLock();
+	return n;
+}
+
+/**
+ * Removes up to 'max' elements into 'fill', blocking until there is at least one.
+ * @return number removed, 0 if unblocked or error
+ */
+template <class T,class ALLOC,class SEMA>
+int tw_safeCircular<T,ALLOC,SEMA>::removeManyOrBlock( T *fill, int max ) {
+	sema.lockSemaOnly();
+	int rm = remain();
+	if(rm < 1) {
+		int r = sema.waitForAcquirersKeepLock(false); // unlocks while waiting for acquire
+		if(r != 0) {
+			TW_CIRCULAR_DBG_OUT("  ...removeManyOrBlock waitForAcquirers error (%d)", r);
+			sema.releaseSemaLock();
+			return 0;
+		}
+		rm = remain();
+	}
+	int n = (rm < max) ? rm : max;
+	for(int x=0;x<n;x++) {
+		fill[x] = data[nextOut];
+		nextOut = nextNextOut();
+	}
+	if(n > 0 && n == rm) { // if we are now empty...
+		nextIn = -1; nextOut = 0; _reverse = false;
+	}
+	sema.releaseManyWithoutLock(n);
+	sema.releaseSemaLock();
+	return n;
+}
+
+/**
+ * Removes up to 'max' elements into 'fill', blocking until there is at least one, with the same timeout
+ * behavior as removeOrBlock(fill, usec_wait)
+ * @return number removed, 0 if timeout, unblocked or error
+ */
+template <class T,class ALLOC,class SEMA>
+int tw_safeCircular<T,ALLOC,SEMA>::removeMany( T *fill, int max, const int64_t usec_wait ) {
+	sema.lockSemaOnly();
+	int rm = remain();
+	if(rm < 1) {
+		int r = sema.waitForAcquirersKeepLock(usec_wait, false); // unlocks while waiting for acquire
+		if(r != 0) {
+			TW_CIRCULAR_DBG_OUT("  ...removeMany waitForAcquirers timeout or error (%d)", r);
+			sema.releaseSemaLock();
+			return 0;
+		}
+		rm = remain();
+	}
+	int n = (rm < max) ? rm : max;
+	for(int x=0;x<n;x++) {
+		fill[x] = data[nextOut];
+		nextOut = nextNextOut();
+	}
+	if(n > 0 && n == rm) { // if we are now empty...
+		nextIn = -1; nextOut = 0; _reverse = false;
+	}
+	sema.releaseManyWithoutLock(n);
+	sema.releaseSemaLock();
+	return n;
+}
+
+
+template <class T,class ALLOC,class SEMA>
+int tw_safeCircular<T,ALLOC,SEMA>::remaining(void) {
 	int ret;
 	sema.lockSemaOnly();
 	ret = remain();
@@ -774,8 +912,8 @@ int tw_safeCircular<T,ALLOC>::remaining(void) {
 	return ret;
 }
 
-template <class T,class ALLOC>
-void tw_safeCircular<T,ALLOC>::clear() { // delete all remaining links (and hope someone took care of the data in each of those)
+template <class T,class ALLOC,class SEMA>
+void tw_safeCircular<T,ALLOC,SEMA>::clear() { // delete all remaining links (and hope someone took care of the data in each of those)
 	sema.lockSemaOnly();
 	if(isObjects) { // cleanup objects if needed. and rebuild empty ones
 		for(int n=0;n<_size;n++) {
@@ -796,22 +934,22 @@ void tw_safeCircular<T,ALLOC>::clear() { // delete all remaining links (and hope
  * Unblocks everything. NOTE: The queue is not safe to use after calling this, and should be discarded.
  * Use unblockAllRemovers() to safely unblock all removal calls.
  */
-template <class T,class ALLOC>
-void tw_safeCircular<T,ALLOC>::unblockAll() {
+template <class T,class ALLOC,class SEMA>
+void tw_safeCircular<T,ALLOC,SEMA>::unblockAll() {
 	sema.releaseAll();
 }
 
 /**
  * Unblocks all calls involving element removal. Those calls will fail gracefully with a false.
  */
-template <class T,class ALLOC>
-void tw_safeCircular<T,ALLOC>::unblockAllRemovers() {
+template <class T,class ALLOC,class SEMA>
+void tw_safeCircular<T,ALLOC,SEMA>::unblockAllRemovers() {
 	sema.releaseAllAcquireLocks();
 }
 
 
-template <class T,class ALLOC>
-tw_safeCircular<T,ALLOC>::~tw_safeCircular() { // delete all remaining links (and hope someone took care of the data in each of those)
+template <class T,class ALLOC,class SEMA>
+tw_safeCircular<T,ALLOC,SEMA>::~tw_safeCircular() { // delete all remaining links (and hope someone took care of the data in each of those)
 	unblockAll();
 	sema.lockSemaOnly();
 	if(isObjects) { // cleanup objects if needed
@@ -0,0 +1,407 @@
+// tupperware container lib
+#ifndef _TW_CIRCULAR_SPSC
+#define _TW_CIRCULAR_SPSC
+
+// A single producer / single consumer circular buffer.
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <new>
+#include <atomic>
+#include <utility>
+
+#include <TW/tw_defs.h>
+#include <TW/tw_utils.h> // TimeVal, add_usec_to_timeval
+#include <TW/tw_alloc.h>
+
+
+namespace TWlib {
+
+/**
+ * A lock-free circular FIFO for exactly one producer thread and exactly one consumer thread.
+ * Same calls as tw_safeCircular, but the fast path touches only two atomic indexes - no mutex.
+ * A mutex / condition is only used when a caller must block (buffer empty on remove, or full on add).
+ *
+ * The capacity is rounded up to the next power of two.
+ *
+ * T must support:
+ * self assignment: operator= (T &a, T &b) or move()
+ * default constructor
+ *
+ * NOTE: using more than one producer thread, or more than one consumer thread, is not safe. Use tw_safeCircular
+ * for that.
+ */
+template <class T, class ALLOC>
+class tw_spscCircular {
+public:
+	tw_spscCircular( int size, bool initobj = false );
+	tw_spscCircular() = delete;
+	tw_spscCircular( tw_spscCircular<T,ALLOC> &o ) = delete;
+
+	// producer side
+	void add( T &d );
+	bool add( T &the_d, const int64_t usec_wait );
+	bool addIfRoom( T &the_d );
+	void addMv( T &d );
+	bool addMv( T &the_d, const int64_t usec_wait );
+	bool addMvIfRoom( T &the_d );
+
+	// consumer side
+	bool remove( T &fill ); // true if got data
+	bool removeMv( T &fill );
+	bool removeOrBlock( T &fill ); // true if removed something
+	bool removeOrBlock( T &fill, const int64_t usec_wait );
+	bool removeMvOrBlock( T &fill );
+	bool removeMvOrBlock( T &fill, const int64_t usec_wait );
+
+	void unblockAll(); // unblock all blocking calls
+	void unblockAllRemovers();
+
+	int remaining();
+	int capacity() { return (int) _size; }
+	~tw_spscCircular();
+protected:
+	// the producer's line: only written by the producer
+	std::atomic<uint32_t> _tail;   // next slot to place a value
+	uint32_t _headCache;           // producer's last seen value of _head
+	char _pad1[TW_CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>) - sizeof(uint32_t)];
+	// the consumer's line: only written by the consumer
+	std::atomic<uint32_t> _head;   // next slot to pull a value from
+	uint32_t _tailCache;           // consumer's last seen value of _tail
+	char _pad2[TW_CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>) - sizeof(uint32_t)];
+
+	// slow path only - used for blocking
+	std::atomic<int> _producerWaiting;
+	std::atomic<int> _consumerWaiting;
+	pthread_mutex_t _waitMutex;
+	pthread_cond_t _notEmptyCond;
+	pthread_cond_t _notFullCond;
+	int _removerGen; // bumped to wake removers, who then fail
+	int _adderGen;   // bumped to wake adders, who then fail
+
+	uint32_t _size;  // power of two
+	uint32_t _mask;
+	bool isObjects;
+	T *data;
+
+	static uint32_t roundUpPow2( int n ) {
+		uint32_t r = 1;
+		while(r < (uint32_t) n) r <<= 1;
+		return r;
+	}
+
+	// producer only. Returns a slot to fill, or NULL if full
+	T *slotForAdd() {
+		uint32_t t = _tail.load(std::memory_order_relaxed);
+		if(t - _headCache >= _size) {
+			_headCache = _head.load(std::memory_order_acquire);
+			if(t - _headCache >= _size)
+				return NULL;
+		}
+		return data + (t & _mask);
+	}
+	// producer only. Publishes the slot given by slotForAdd()
+	void commitAdd() {
+		_tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(_consumerWaiting.load(std::memory_order_relaxed) && _consumerWaiting.exchange(0))
+			wakeup(&_notEmptyCond); // only one wakeup per park
+	}
+	// consumer only. Returns the slot to pull from, or NULL if empty
+	T *slotForRemove() {
+		uint32_t h = _head.load(std::memory_order_relaxed);
+		if(h == _tailCache) {
+			_tailCache = _tail.load(std::memory_order_acquire);
+			if(h == _tailCache)
+				return NULL;
+		}
+		return data + (h & _mask);
+	}
+	// consumer only. Frees the slot given by slotForRemove()
+	void commitRemove() {
+		_head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(_producerWaiting.load(std::memory_order_relaxed) && _producerWaiting.exchange(0))
+			wakeup(&_notFullCond); // only one wakeup per park
+	}
+
+	void wakeup( pthread_cond_t *c ) {
+		pthread_mutex_lock(&_waitMutex);
+		pthread_cond_signal(c);
+		pthread_mutex_unlock(&_waitMutex);
+	}
+
+	bool isFull() {
+		return (_tail.load(std::memory_order_relaxed) - _head.load(std::memory_order_acquire)) >= _size;
+	}
+	bool isEmpty() {
+		return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+	}
+
+	// blocks until the buffer is no longer full (true), or timeout / unblock (false)
+	bool waitForRoom( const struct timespec *abstime );
+	// blocks until the buffer is no longer empty (true), or timeout / unblock (false)
+	bool waitForData( const struct timespec *abstime );
+
+	static const struct timespec *usecToAbstime( const int64_t usec_wait, struct timespec *ts ) {
+		timeval tv;
+		gettimeofday(&tv, NULL);
+		TWlib::add_usec_to_timeval(usec_wait, &tv);
+		TWlib::timeval_to_timespec(&tv,ts);
+		return ts;
+	}
+};
+
+}
+
+using namespace TWlib;
+
+template <class T,class ALLOC>
+tw_spscCircular<T,ALLOC>::tw_spscCircular( int size, bool initobj ) :
+	_tail(0), _headCache(0), _head(0), _tailCache(0),
+	_producerWaiting(0), _consumerWaiting(0), _removerGen(0), _adderGen(0),
+	_size(roundUpPow2(size)), _mask(0), isObjects(initobj), data(NULL) {
+	_mask = _size - 1;
+	pthread_mutex_init( &_waitMutex, NULL );
+	pthread_cond_init( &_notEmptyCond, NULL );
+	pthread_cond_init( &_notFullCond, NULL );
+	data = (T *) ALLOC::malloc( _size * sizeof(T) );
+	if(isObjects) {
+		for(uint32_t n=0;n<_size;n++) {
+			T *p = data + n;
+			p = new (p) T(); // placement new, if objects require an init.
+		}
+	}
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::waitForRoom( const struct timespec *abstime ) {
+	bool ret = true;
+	pthread_mutex_lock(&_waitMutex);
+	int gen = _adderGen;
+	while(1) {
+		_producerWaiting.store(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with fence in commitRemove()
+		if(!isFull()) break;
+		if(gen != _adderGen) { ret = false; break; }
+		int r;
+		if(abstime)
+			r = pthread_cond_timedwait( &_notFullCond, &_waitMutex, abstime );
+		else
+			r = pthread_cond_wait( &_notFullCond, &_waitMutex );
+		if(r && isFull()) { ret = false; break; }
+	}
+	_producerWaiting.store(0, std::memory_order_relaxed);
+	pthread_mutex_unlock(&_waitMutex);
+	return ret;
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::waitForData( const struct timespec *abstime ) {
+	bool ret = true;
+	pthread_mutex_lock(&_waitMutex);
+	int gen = _removerGen;
+	while(1) {
+		_consumerWaiting.store(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with fence in commitAdd()
+		if(!isEmpty()) break;
+		if(gen != _removerGen) { ret = false; break; }
+		int r;
+		if(abstime)
+			r = pthread_cond_timedwait( &_notEmptyCond, &_waitMutex, abstime );
+		else
+			r = pthread_cond_wait( &_notEmptyCond, &_waitMutex );
+		if(r && isEmpty()) { ret = false; break; }
+	}
+	_consumerWaiting.store(0, std::memory_order_relaxed);
+	pthread_mutex_unlock(&_waitMutex);
+	return ret;
+}
+
+/**
+ * Will block if queue is full
+ */
+template <class T,class ALLOC>
+void tw_spscCircular<T,ALLOC>::add( T &the_d ) {
+	T *slot;
+	while(!(slot = slotForAdd())) {
+		if(!waitForRoom(NULL)) return; // unblocked
+	}
+	*slot = the_d;
+	commitAdd();
+}
+
+template <class T,class ALLOC>
+void tw_spscCircular<T,ALLOC>::addMv( T &the_d ) {
+	T *slot;
+	while(!(slot = slotForAdd())) {
+		if(!waitForRoom(NULL)) return; // unblocked
+	}
+	*slot = std::move(the_d);
+	commitAdd();
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::add( T &the_d, const int64_t usec_wait ) {
+	struct timespec ts;
+	const struct timespec *abstime = NULL;
+	T *slot;
+	while(!(slot = slotForAdd())) {
+		if(!abstime) abstime = usecToAbstime(usec_wait, &ts);
+		if(!waitForRoom(abstime)) return false;
+	}
+	*slot = the_d;
+	commitAdd();
+	return true;
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::addMv( T &the_d, const int64_t usec_wait ) {
+	struct timespec ts;
+	const struct timespec *abstime = NULL;
+	T *slot;
+	while(!(slot = slotForAdd())) {
+		if(!abstime) abstime = usecToAbstime(usec_wait, &ts);
+		if(!waitForRoom(abstime)) return false;
+	}
+	*slot = std::move(the_d);
+	commitAdd();
+	return true;
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::addIfRoom( T &the_d ) {
+	T *slot = slotForAdd();
+	if(!slot) return false;
+	*slot = the_d;
+	commitAdd();
+	return true;
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::addMvIfRoom( T &the_d ) {
+	T *slot = slotForAdd();
+	if(!slot) return false;
+	*slot = std::move(the_d);
+	commitAdd();
+	return true;
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::remove( T &fill ) {
+	T *slot = slotForRemove();
+	if(!slot) return false;
+	fill = *slot;
+	commitRemove();
+	return true;
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::removeMv( T &fill ) {
+	T *slot = slotForRemove();
+	if(!slot) return false;
+	fill = std::move(*slot);
+	commitRemove();
+	return true;
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::removeOrBlock( T &fill ) {
+	T *slot;
+	while(!(slot = slotForRemove())) {
+		if(!waitForData(NULL)) return false;
+	}
+	fill = *slot;
+	commitRemove();
+	return true;
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::removeOrBlock( T &fill, const int64_t usec_wait ) {
+	struct timespec ts;
+	const struct timespec *abstime = NULL;
+	T *slot;
+	while(!(slot = slotForRemove())) {
+		if(!abstime) abstime = usecToAbstime(usec_wait, &ts);
+		if(!waitForData(abstime)) return false;
+	}
+	fill = *slot;
+	commitRemove();
+	return true;
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::removeMvOrBlock( T &fill ) {
+	T *slot;
+	while(!(slot = slotForRemove())) {
+		if(!waitForData(NULL)) return false;
+	}
+	fill = std::move(*slot);
+	commitRemove();
+	return true;
+}
+
+template <class T,class ALLOC>
+bool tw_spscCircular<T,ALLOC>::removeMvOrBlock( T &fill, const int64_t usec_wait ) {
+	struct timespec ts;
+	const struct timespec *abstime = NULL;
+	T *slot;
+	while(!(slot = slotForRemove())) {
+		if(!abstime) abstime = usecToAbstime(usec_wait, &ts);
+		if(!waitForData(abstime)) return false;
+	}
+	fill = std::move(*slot);
+	commitRemove();
+	return true;
+}
+
+/**
+ * Number of items in the buffer. Only exact if called from the producer or consumer thread while the
+ * other side is idle.
+ */
+template <class T,class ALLOC>
+int tw_spscCircular<T,ALLOC>::remaining() {
+	return (int) (_tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire));
+}
+
+/**
+ * Unblocks all blocking calls - both adders and removers. Those calls will fail gracefully with a false
+ * (or just return, in the case of add() / addMv() )
+ */
+template <class T,class ALLOC>
+void tw_spscCircular<T,ALLOC>::unblockAll() {
+	pthread_mutex_lock(&_waitMutex);
+	_adderGen++;
+	_removerGen++;
+	pthread_cond_broadcast(&_notFullCond);
+	pthread_cond_broadcast(&_notEmptyCond);
+	pthread_mutex_unlock(&_waitMutex);
+}
+
+/**
+ * Unblocks all calls involving element removal. Those calls will fail gracefully with a false.
+ */
+template <class T,class ALLOC>
+void tw_spscCircular<T,ALLOC>::unblockAllRemovers() {
+	pthread_mutex_lock(&_waitMutex);
+	_removerGen++;
+	pthread_cond_broadcast(&_notEmptyCond);
+	pthread_mutex_unlock(&_waitMutex);
+}
+
+template <class T,class ALLOC>
+tw_spscCircular<T,ALLOC>::~tw_spscCircular() {
+	unblockAll();
+	if(isObjects) { // cleanup objects if needed
+		for(uint32_t n=0;n<_size;n++) {
+			data[n].~T();
+		}
+	}
+	ALLOC::free(data);
+	pthread_cond_destroy(&_notEmptyCond);
+	pthread_cond_destroy(&_notFullCond);
+	pthread_mutex_destroy(&_waitMutex);
+}
+
+#endif // _TW_CIRCULAR_SPSC
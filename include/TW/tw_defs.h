@@ -26,6 +26,11 @@
 
 #define TW_INLINE
 
+// used to pad apart data which is written by different threads (avoids false sharing)
+#ifndef TW_CACHE_LINE_SIZE
+#define TW_CACHE_LINE_SIZE 64
+#endif
+
 // legacy ACE stuff we may be able to kill
 #define TW_BEGIN_VERSIONED_NAMESPACE_DECL
 #define TW_END_VERSIONED_NAMESPACE_DECL
@@ -11,6 +11,7 @@
 
 
 #include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
 #include <TW/tw_fifo.h>
 #include <TW/tw_stack.h>
 #include <TW/tw_hashes.h>
@@ -303,8 +304,7 @@ bool TWDenseHash<KEY, DATA, MUTEX, EQFUNC,ALLOC>::removeAll() {
 		if(k) // ...now delete key
 			TW_DELETE_WALLOC( k, KEY, this->_alloc);
 
-		it = values.begin();
-//		it++;
+		++it; // erase() leaves iterators valid - starting over at begin() each time was O(n^2)
 	}
 	values.resize(0);
 	//  printf("rec count %d\n",values.size());
@@ -403,7 +403,7 @@ DATA *TWDenseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addReplaceNew( KEY& key ) {
 //	bool iamempty = false;
 	_lock.acquire();
 	TW_NEW_WALLOC(v, DATA, DATA(), this->_alloc);
-	if(!v) return false;
+	if(!v) return NULL;
 //--	ACE_NEW_MALLOC_RETURN
 //--			(v,	(reinterpret_cast<DATA *>
 //--				(this->_alloc->malloc (sizeof (DATA)))),
@@ -415,7 +415,7 @@ DATA *TWDenseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addReplaceNew( KEY& key ) {
 		it = values.find(&key);
 	if (it == values.end()) {
 		TW_NEW_WALLOC(k, KEY, KEY(key), this->_alloc);
-		if(!k) return false;
+		if(!k) return NULL;
 //--		ACE_NEW_MALLOC_RETURN
 //--		(k,	(reinterpret_cast<KEY *>
 //--			(this->_alloc->malloc (sizeof (KEY)))),
@@ -482,7 +482,7 @@ DATA *TWDenseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::findOrNew( KEY& key ) {
 	it = values.find(&key);
 	if(it == values.end()) {
 		TW_NEW_WALLOC(v, DATA, DATA(), this->_alloc);
-		if(!v) return false;
+		if(!v) return NULL;
 //--	ACE_NEW_MALLOC_RETURN
 //--			(v,	(reinterpret_cast<DATA *>
 //--				(this->_alloc->malloc (sizeof (DATA)))),
@@ -492,7 +492,7 @@ DATA *TWDenseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::findOrNew( KEY& key ) {
 //	else
 //	if (it == values.end()) {
 		TW_NEW_WALLOC(k, KEY, KEY(key), this->_alloc);
-		if(!k) return false;
+		if(!k) return NULL;
 
 //--		ACE_NEW_MALLOC_RETURN
 //--		(k,	(reinterpret_cast<KEY *>
@@ -516,7 +516,7 @@ bool TWDenseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addNoreplace( KEY& key, DATA& dat
 	_lock.acquire();
 	internal_zhashiterator it = values.find(&key);
 	if (it == values.end()) {
-		TW_NEW_WALLOC(v, DATA, DATA(), this->_alloc);
+		TW_NEW_WALLOC(v, DATA, DATA(dat), this->_alloc);
 		if(!v) return false;
 //--		ACE_NEW_MALLOC_RETURN
 //--				(v,	(reinterpret_cast<DATA *>
@@ -598,14 +598,15 @@ bool TWDenseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::remove( KEY& key ) {
 template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
 bool TWDenseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( KEY& key, DATA& fill ) {
 	DATA *v = NULL;
+	tw_mutex_traits<MUTEX>::acquireRead(_lock);
 	internal_zhashiterator it = values.find(&key);
 	if (it == values.end()) {
-		_lock.release();
+		tw_mutex_traits<MUTEX>::releaseRead(_lock);
 		return false;
 	} else {
 		v = it->second;
-		_lock.release();
-		fill = *v;    // put in new data (must support assignment)
+		fill = *v;    // put in new data (must support assignment) - before a remove() can delete it
+		tw_mutex_traits<MUTEX>::releaseRead(_lock);
 		return true;
 	}
 }
@@ -615,12 +616,13 @@ DATA *TWDenseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( KEY& key ) {
 	DATA *ret = NULL;
 //	if(values.empty())
 //		return NULL;
+	tw_mutex_traits<MUTEX>::acquireRead(_lock);
 	internal_zhashiterator it = values.find(&key);
 	if (it == values.end()) {
-		_lock.release();
+		tw_mutex_traits<MUTEX>::releaseRead(_lock);
 	} else {
 		ret = it->second;
-		_lock.release();
+		tw_mutex_traits<MUTEX>::releaseRead(_lock);
 	}
 	return ret;
 }
@@ -0,0 +1,196 @@
+// tupperware container lib
+// tw_futex.h
+//
+// Linux futex based lock primitives. These stay entirely in user space when uncontended, and only
+// enter the kernel when a thread actually has to sleep, or a sleeping thread has to be woken.
+
+#ifndef TW_FUTEX_H_
+#define TW_FUTEX_H_
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <atomic>
+
+#include <TW/tw_utils.h> // TimeVal
+
+// how many times to spin on a lock before sleeping in the kernel
+#ifndef TW_FUTEX_SPIN_COUNT
+#define TW_FUTEX_SPIN_COUNT 100
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+#define TW_CPU_RELAX() __asm__ __volatile__("pause" ::: "memory")
+#elif defined(__aarch64__) || (defined(__ARM_ARCH) && __ARM_ARCH >= 7)
+#define TW_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define TW_CPU_RELAX() __asm__ __volatile__("" ::: "memory")
+#endif
+
+namespace TWlib {
+
+namespace futex {
+
+// wait while *addr == val. abstime is an absolute CLOCK_REALTIME time (as from gettimeofday()), or NULL
+// returns 0 on wakeup (or if *addr != val), ETIMEDOUT on timeout, EINTR if interrupted
+inline int wait( std::atomic<int> *addr, int val, const struct timespec *abstime = NULL ) {
+	long r;
+	if(abstime)
+		r = syscall(SYS_futex, reinterpret_cast<int *>(addr), FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME,
+				val, abstime, NULL, FUTEX_BITSET_MATCH_ANY);
+	else
+		r = syscall(SYS_futex, reinterpret_cast<int *>(addr), FUTEX_WAIT | FUTEX_PRIVATE_FLAG, val, NULL, NULL, 0);
+	if(r == 0) return 0;
+	if(errno == EAGAIN) return 0; // value already changed
+	return errno;
+}
+
+inline int wake( std::atomic<int> *addr, int n ) {
+	return (int) syscall(SYS_futex, reinterpret_cast<int *>(addr), FUTEX_WAKE | FUTEX_PRIVATE_FLAG, n, NULL, NULL, 0);
+}
+
+// spinning is pointless on a single CPU - the thread we wait on can't run until we sleep
+inline int spinCount() {
+	static int spins = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? TW_FUTEX_SPIN_COUNT : 0;
+	return spins;
+}
+
+}
+
+/**
+ * A futex mutex (see Ulrich Drepper, "Futexes Are Tricky" - mutex #2).
+ * state: 0 = unlocked, 1 = locked, 2 = locked w/ possible sleepers
+ * Spins briefly before sleeping. Unlock only makes a syscall if someone may be sleeping.
+ *
+ * Has the same calls as TW_Mutex, so it can be used as a MUTEX template parameter.
+ */
+class TW_FutexMutex {
+protected:
+	std::atomic<int> state;
+
+	int lockSlow( const struct timespec *abstime ) {
+		int c = 0;
+		for(int n=0;n<futex::spinCount();n++) {
+			c = 0;
+			if(state.load(std::memory_order_relaxed) == 0 &&
+					state.compare_exchange_weak(c, 1, std::memory_order_acquire))
+				return 0;
+			TW_CPU_RELAX();
+		}
+		c = state.exchange(2, std::memory_order_acquire);
+		while(c != 0) {
+			int r = futex::wait(&state, 2, abstime);
+			if(r == ETIMEDOUT) return TW_FUTEX_TIMEOUT;
+			c = state.exchange(2, std::memory_order_acquire);
+		}
+		return 0;
+	}
+public:
+	static const int TW_FUTEX_TIMEOUT = ETIMEDOUT;
+
+	TW_FutexMutex() : state(0) { }
+	int acquire() {
+		int c = 0;
+		if(state.compare_exchange_strong(c, 1, std::memory_order_acquire))
+			return 0;
+		return lockSlow(NULL);
+	}
+	int acquire(const struct timespec *abstime) {
+		int c = 0;
+		if(state.compare_exchange_strong(c, 1, std::memory_order_acquire))
+			return 0;
+		return lockSlow(abstime);
+	}
+	int acquire(TimeVal &t) {
+		return acquire(t.timespec());
+	}
+	// used after a wait on a TW_FutexCond: we can't know if others are sleeping, so assume they are
+	void acquireContended() {
+		int c = state.exchange(2, std::memory_order_acquire);
+		while(c != 0) {
+			futex::wait(&state, 2);
+			c = state.exchange(2, std::memory_order_acquire);
+		}
+	}
+	int release() {
+		if(state.fetch_sub(1, std::memory_order_release) != 1) {
+			state.store(0, std::memory_order_release);
+			futex::wake(&state, 1);
+		}
+		return 0;
+	}
+	// returns 0 if succesful lock, if non-zero a lock was not acquired. This will not block.
+	int tryAcquire() {
+		int c = 0;
+		if(state.compare_exchange_strong(c, 1, std::memory_order_acquire))
+			return 0;
+		return EBUSY;
+	}
+	~TW_FutexMutex() { }
+};
+
+/**
+ * A futex condition variable, used with TW_FutexMutex. signal() / broadcast() must be called with
+ * the mutex held, and only make a syscall if a waiter is registered.
+ * Every wait() registers, and on its way out either takes one of the wakeups signal() / broadcast()
+ * handed out, or - if there is none left (a timeout, or a spurious wake) - cancels its own registration.
+ * So the count of registered waiters is always exact, whichever waiter a wakeup actually went to.
+ * The counters are unsigned, and only ever compared by difference, so they can wrap.
+ */
+class TW_FutexCond {
+protected:
+	std::atomic<int> seq;
+	// all protected by the mutex
+	unsigned int total;  // wait() registrations
+	unsigned int wakeup; // wakeups handed out by signal() / broadcast(), plus cancelled registrations
+	unsigned int woken;  // wakeups taken by returning waiters, plus cancelled registrations
+public:
+	TW_FutexCond() : seq(0), total(0), wakeup(0), woken(0) { }
+
+	// mutex must be held. Returns 0 or ETIMEDOUT. Like pthread_cond_wait() this can wake spuriously.
+	int wait( TW_FutexMutex &m, const struct timespec *abstime = NULL ) {
+		int s = seq.load(std::memory_order_relaxed);
+		total++;
+		m.release();
+		int r = futex::wait(&seq, s, abstime);
+		m.acquireContended();
+		if(wakeup != woken) { // a wakeup no one has taken yet - ours, or as good as
+			woken++;
+			return 0;
+		}
+		wakeup++; // none left - take ourselves off the count
+		woken++;
+		if(r == ETIMEDOUT) return ETIMEDOUT;
+		return 0;
+	}
+	int signal() {
+		if(total != wakeup) {
+			wakeup++;
+			seq.fetch_add(1, std::memory_order_release);
+			futex::wake(&seq, 1);
+		}
+		return 0;
+	}
+	int broadcast() {
+		if(total != wakeup) {
+			wakeup = total;
+			seq.fetch_add(1, std::memory_order_release);
+			futex::wake(&seq, INT_MAX);
+		}
+		return 0;
+	}
+	bool hasWaiters() { return total != wakeup; }
+};
+
+} // end namespace
+
+#endif // __linux__
+
+#endif /* TW_FUTEX_H_ */
@@ -40,6 +40,7 @@ The MIT License
 #define TW_KHASH_H_
 
 #include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
 #include <TW/tw_fifo.h>
 #include <TW/tw_stack.h>
 #include <TW/tw_hashes.h>
@@ -62,7 +63,7 @@ The MIT License
 
  TW_KHash_XXX manages the memory of the data it holds. When the Hash is deleted, it will delete data (and keys).
 
- MUTEX is a TW_Mutex or TW_NoMutex or similar
+ MUTEX is a TW_Mutex or TW_NoMutex or similar. With a TW_RWMutex the find() calls share the lock.
  DATA must implement:
  copy constructor
  assignment (operator =)
@@ -78,6 +79,11 @@ The MIT License
 
 */
 
+// how many keys findMany() hashes and prefetches ahead of resolving them
+#ifndef TW_KHASH_PREFETCH_BATCH
+#define TW_KHASH_PREFETCH_BATCH 32
+#endif
+
 namespace TWlib {
 
 
@@ -102,6 +108,7 @@ class TW_KHash_32  {
 		bool remove( const KEY& key, DATA& fill );
 		bool find( const KEY& key, DATA& fill );
 		DATA *find( const KEY& key );
+		int findMany( const KEY *keys, DATA **out, int n );
 		DATA *findOrNew( const KEY& key );
 		bool removeAll();
 		int size();
@@ -212,11 +219,16 @@ class TW_KHash_32  {
 		        }
 		    }
 			static inline khint_t kh_get_A(const kh_A_t *h, const KEY &key) // this dbl const crap is b/c of C++'s weird issue with const pointer vs const values
+			{
+				return kh_get_hashed_A(h, key, __hash_func(key));
+			}
+			// kh_get_A, w/ the hash already worked out (k == __hash_func(key))
+			static inline khint_t kh_get_hashed_A(const kh_A_t *h, const KEY &key, khint_t k)
 			{
 				if (h->n_buckets) {
-					khint_t inc, k, i, last, mask;
+					khint_t inc, i, last, mask;
 					mask = h->n_buckets - 1;
-					k = __hash_func(key); i = k & mask;
+					i = k & mask;
 					inc = __ac_inc(k, mask); last = i; /* inc==1 for linear probing */
 					while (!__ac_isempty(h->flags, i) && (__ac_isdel(h->flags, i) || !__hash_equal(h->keys[i], key))) {
 						i = (i + inc) & mask;
@@ -768,7 +780,7 @@ template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename
 bool TW_KHash_32<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( const KEY& key, DATA& fill ) {
 	bool ret = false;
 //	TW_DEBUG_L("looking. %p\n",KHASHMAP);
-	_lock.acquire();
+	tw_mutex_traits<MUTEX>::acquireRead(_lock); // shared, w/ a TW_RWMutex
 	khiter_t k = kh_get_A(KHASHMAP, key);
 	if(k != kh_end(KHASHMAP)) { // have it?
 //		TW_DEBUG_L("has it. %p\n",KHASHMAP);
@@ -777,7 +789,7 @@ bool TW_KHash_32<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( const KEY& key, DATA& fill
 			ret = true;
 		}
 	}
-	_lock.release();
+	tw_mutex_traits<MUTEX>::releaseRead(_lock);
 	return ret;
 }
 
@@ -786,15 +798,57 @@ DATA *TW_KHash_32<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( const KEY& key ) {
 
 	DATA *ret = NULL;
 
-	_lock.acquire();
+	tw_mutex_traits<MUTEX>::acquireRead(_lock);
 
 	khiter_t k = kh_get_A(KHASHMAP, key);
 	if(k != kh_end(KHASHMAP)) { // don't have it
 		ret = kh_value(KHASHMAP, k);
 	}
-	_lock.release();
+	tw_mutex_traits<MUTEX>::releaseRead(_lock);
 	return ret;
 }
 
+/**
+ * Looks up a batch of keys, w/ one lock acquisition. Does the same as out[i] = find(keys[i]) for each key,
+ * but hashes TW_KHASH_PREFETCH_BATCH keys at a time and prefetches their flags, key and value buckets before
+ * probing any of them - so the cache misses of a batch overlap, instead of one dependent miss per key.
+ * The DATA each found key points to is prefetched as well, for the caller.
+ * @param out filled w/ a DATA * (as find() would return) or NULL for each key
+ * @return the number of keys found
+ */
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+int TW_KHash_32<KEY,DATA,MUTEX,EQFUNC,ALLOC>::findMany( const KEY *keys, DATA **out, int n ) {
+	int found = 0;
+	khint_t hashes[TW_KHASH_PREFETCH_BATCH];
+	tw_mutex_traits<MUTEX>::acquireRead(_lock);
+	kh_A_t *h = KHASHMAP;
+	khint_t mask = h->n_buckets - 1;
+	for(int start=0;start<n;start+=TW_KHASH_PREFETCH_BATCH) {
+		int end = start + TW_KHASH_PREFETCH_BATCH;
+		if(end > n) end = n;
+		for(int j=start;j<end;j++) {
+			khint_t k = __hash_func(keys[j]);
+			hashes[j - start] = k;
+			if(h->n_buckets) {
+				khint_t i = k & mask;
+				__builtin_prefetch(h->flags + (i >> 4));
+				__builtin_prefetch(h->keys + i);
+				__builtin_prefetch(h->vals + i);
+			}
+		}
+		for(int j=start;j<end;j++) {
+			khiter_t x = kh_get_hashed_A(h, keys[j], hashes[j - start]);
+			if(x != kh_end(h)) {
+				out[j] = kh_value(h, x);
+				__builtin_prefetch(out[j]);
+				found++;
+			} else
+				out[j] = NULL;
+		}
+	}
+	tw_mutex_traits<MUTEX>::releaseRead(_lock);
+	return found;
+}
+
 
 #endif /* TW_KHASH_H_ */
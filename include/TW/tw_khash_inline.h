@@ -0,0 +1,590 @@
+/*
+ * tw_khash_inline.h
+ *
+ *  A sibling of TW_KHash_32 which keeps the values in the table itself.
+ *
+ * Uses the probing scheme and flag macros of klib's khash.h - see the license in tw_khash.h
+ */
+
+#ifndef TW_KHASH_INLINE_H_
+#define TW_KHASH_INLINE_H_
+
+#include <string.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_hashes.h>
+#include <TW/tw_hashcommon.h>
+
+#include <TW/khash.h>
+
+#include <new>
+#include <utility>
+#include <type_traits>
+
+/**
+ TW_KHash_32_Inline has the same API, template parameters and hashing as TW_KHash_32, but each bucket holds
+ the KEY and the DATA together, instead of a DATA* to a separately allocated value. So there is no allocation
+ per insert, and a lookup touches the flags and one bucket - not a bucket and then the value somewhere else.
+
+ The catch: a DATA * handed out by find(), findOrNew(), add*New() or the iterator points into the table,
+ and is only good until the next add or remove (which may move the buckets).
+
+ DATA must implement:
+ copy constructor
+ default constructor
+ destructor
+ operator= (for the find( key, fill ) / remove( key, fill ) forms)
+
+ KEY: as for TW_KHash_32
+
+ Optimistic lookups: w/ a TW_SeqLock as the MUTEX, and a KEY and DATA which are trivially copyable,
+ find( key, fill ) takes no lock. It probes the table, copies the value out, and starts over if a writer was
+ active in the meantime. To make that safe the table never frees its arrays while it is alive - an old set
+ is kept when the table grows, and reused if it needs a set that size again - so a reader which lost a race
+ reads stale memory, never freed memory. (That costs at most about the size of the current arrays.)
+ EQFUNC must not follow pointers in KEY, as it may be handed a half written key. The other calls lock
+ as usual; find( key ), which hands out a pointer into the table, takes the lock.
+*/
+
+namespace TWlib {
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+class TW_KHash_32_Inline {
+	public:
+		// this constructor availble for drop in compatibility with TWDensehash
+		TW_KHash_32_Inline(KEY &deletekey, KEY &emptykey, ALLOC *alloc = NULL, int items=0);
+		// normal constructor
+		TW_KHash_32_Inline(ALLOC *alloc = NULL, int items=0);
+		~TW_KHash_32_Inline();
+		bool addReplace( const KEY& key, DATA& dat );
+		bool addReplace( const KEY& key, DATA& dat, DATA& olddat );
+		bool addNoreplace( const KEY& key, DATA& dat );
+		DATA *addReplaceNew( const KEY& key );
+		DATA *addNoreplaceNew( const KEY& key );
+		bool remove( const KEY& key );
+		bool remove( const KEY& key, DATA& fill );
+		bool find( const KEY& key, DATA& fill );
+		DATA *find( const KEY& key );
+		// true if find( key, fill ) runs w/o a lock (see above)
+		static const bool optimisticFind = tw_mutex_traits<MUTEX>::optimistic
+				&& std::is_trivially_copyable<KEY>::value && std::is_trivially_copyable<DATA>::value;
+		DATA *findOrNew( const KEY& key );
+		bool removeAll();
+		int size();
+		int buckets() { return (int) _n_buckets; }
+
+		void releaseIter();
+		ALLOC *getAllocator() { return _alloc; }
+
+		class HashIterator {
+		public:
+			HashIterator(TW_KHash_32_Inline &map);
+			KEY *key();
+			DATA *data();
+			void setData(DATA *);  // copies *d into the bucket
+			bool getNext();
+			bool atEnd();
+			void release();
+			friend class TW_KHash_32_Inline;
+		protected:
+			khint_t _iter;
+			TW_KHash_32_Inline &_map;
+		};
+
+	protected:
+		// a bucket. Only constructed (key and val, w/ placement new) when the flags say it is in use
+		struct Slot {
+			KEY key;
+			DATA val;
+		};
+
+		void init(ALLOC *alloc, int items);
+		static inline khint32_t hashKey( const KEY &key ) {
+			TWlib::tw_hash<KEY *> hash;
+#if __x86_64__
+			return kh_int64_hash_func(hash.operator ()(const_cast<KEY *>(&key)));
+#else
+			return hash.operator ()(const_cast<KEY *>(&key));
+#endif
+		}
+		static inline bool keyEqual( const KEY &l, const KEY &r ) {
+			EQFUNC eq;
+			return eq.operator ()(&l,&r);
+		}
+		// move constructs where T can be, else copies (types w/ only a T(T&) copy constructor)
+		template<typename T> static void relocate( T *dst, T &src, std::true_type ) { new (dst) T(std::move(src)); }
+		template<typename T> static void relocate( T *dst, T &src, std::false_type ) { new (dst) T(src); }
+		template<typename T> static void relocate( T *dst, T &src ) {
+			relocate(dst, src, typename std::is_constructible<T, T&&>::type());
+			src.~T();
+		}
+		static khint_t probe( khint_t n_buckets, const khint32_t *flags, const Slot *slots, const KEY &key );
+		khint_t getSlot( const KEY &key );
+		bool find( const KEY& key, DATA& fill, std::true_type );
+		bool find( const KEY& key, DATA& fill, std::false_type );
+		void retire( khint_t n_buckets, khint32_t *flags, Slot *slots );
+		bool takeRetired( khint_t n_buckets, khint32_t *&flags, Slot *&slots );
+		khint_t putSlot( const KEY &key, int *ret );
+		void delSlot( khint_t x );
+		void resize( khint_t new_n_buckets );
+
+		friend class HashIterator;
+		void gotoStart(HashIterator &i);
+
+		khint_t _n_buckets, _size, _n_occupied, _upper_bound;
+		khint32_t *_flags;
+		Slot *_slots;
+		// arrays replaced by a resize, only kept w/ optimisticFind - readers may still be looking at them
+		struct Retired {
+			khint_t n_buckets;
+			khint32_t *flags;
+			Slot *slots;
+		};
+		Retired *_retired;
+		int _retiredCount, _retiredSpace;
+		int _iterators_out;
+		ALLOC *_alloc;
+		MUTEX _lock;
+};
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::TW_KHash_32_Inline( KEY &deletekey, KEY &emptykey, ALLOC *alloc, int items ) :
+_n_buckets( 0 ), _size( 0 ), _n_occupied( 0 ), _upper_bound( 0 ), _flags( NULL ), _slots( NULL ),
+_retired( NULL ), _retiredCount( 0 ), _retiredSpace( 0 ), _iterators_out( 0 ), _lock()
+{
+	init(alloc,items);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::TW_KHash_32_Inline( ALLOC *alloc, int items ) :
+_n_buckets( 0 ), _size( 0 ), _n_occupied( 0 ), _upper_bound( 0 ), _flags( NULL ), _slots( NULL ),
+_retired( NULL ), _retiredCount( 0 ), _retiredSpace( 0 ), _iterators_out( 0 ), _lock()
+{
+	init(alloc,items);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::init(ALLOC *alloc, int items) {
+	if(!alloc)
+		_alloc = ALLOC::getInstance();
+	else
+		_alloc = alloc;
+	if(items > 0)
+		resize(items);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::~TW_KHash_32_Inline() {
+	removeAll();
+	ALLOC::free(_flags);
+	ALLOC::free(_slots);
+	for(int n=0;n<_retiredCount;n++) {
+		ALLOC::free(_retired[n].flags);
+		ALLOC::free(_retired[n].slots);
+	}
+	ALLOC::free(_retired);
+}
+
+// the bucket 'key' is in, or n_buckets if it is not there. Visits each bucket at most once, so it ends
+// even on arrays a writer is changing.
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+khint_t TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::probe( khint_t n_buckets, const khint32_t *flags, const Slot *slots, const KEY &key ) {
+	if (n_buckets) {
+		khint_t inc, k, i, last, mask;
+		mask = n_buckets - 1;
+		k = hashKey(key); i = k & mask;
+		inc = __ac_inc(k, mask); last = i;
+		while (!__ac_isempty(flags, i) && (__ac_isdel(flags, i) || !keyEqual(slots[i].key, key))) {
+			i = (i + inc) & mask;
+			if (i == last) return n_buckets;
+		}
+		return __ac_iseither(flags, i)? n_buckets : i;
+	} else return 0;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+inline khint_t TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::getSlot( const KEY &key ) {
+	return probe(_n_buckets, _flags, _slots, key);
+}
+
+// keeps arrays which an optimistic reader may still be probing
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::retire( khint_t n_buckets, khint32_t *flags, Slot *slots ) {
+	if(_retiredCount == _retiredSpace) {
+		int space = _retiredSpace ? _retiredSpace * 2 : 8;
+		Retired *r = (Retired *) ALLOC::realloc(_retired, space * sizeof(Retired));
+		if(!r) { // can't keep track of them - leak, rather than free memory a reader may be in
+			TW_PALLOC_ERROR( TW_ALLOC_ERROR_MSG_NO_MEM, __FILE__, __LINE__ );
+			return;
+		}
+		_retired = r;
+		_retiredSpace = space;
+	}
+	_retired[_retiredCount].n_buckets = n_buckets;
+	_retired[_retiredCount].flags = flags;
+	_retired[_retiredCount].slots = slots;
+	_retiredCount++;
+}
+
+// a retired set of arrays w/ n_buckets buckets, if there is one
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::takeRetired( khint_t n_buckets, khint32_t *&flags, Slot *&slots ) {
+	for(int n=0;n<_retiredCount;n++)
+		if(_retired[n].n_buckets == n_buckets) {
+			flags = _retired[n].flags;
+			slots = _retired[n].slots;
+			_retired[n] = _retired[--_retiredCount];
+			return true;
+		}
+	return false;
+}
+
+// Rehashes into new arrays. Entries are moved into their new buckets, so DATA and KEY may be any type
+// (khash's in place kick-out shuffle only works for types which can be copied as bytes).
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::resize( khint_t new_n_buckets ) {
+	kroundup32(new_n_buckets);
+	if (new_n_buckets < 4) new_n_buckets = 4;
+	if (_size >= (khint_t)(new_n_buckets * __ac_HASH_UPPER + 0.5)) return; /* requested size is too small */
+	__TW_HASH_DEBUGL(" -- Rehash: %d\n", new_n_buckets);
+	khint32_t *new_flags = NULL;
+	Slot *new_slots = NULL;
+	if(!optimisticFind || !takeRetired(new_n_buckets, new_flags, new_slots)) {
+		new_flags = (khint32_t*)ALLOC::malloc(__ac_fsize(new_n_buckets) * sizeof(khint32_t));
+		new_slots = (Slot *)ALLOC::malloc(new_n_buckets * sizeof(Slot));
+	}
+	if(!new_flags || !new_slots) {
+		TW_PALLOC_ERROR( TW_ALLOC_ERROR_MSG_NO_MEM, __FILE__, __LINE__ );
+		ALLOC::free(new_flags);
+		ALLOC::free(new_slots);
+		return;
+	}
+	ALLOC::memset(new_flags, 0xaa, __ac_fsize(new_n_buckets) * sizeof(khint32_t));
+	khint_t new_mask = new_n_buckets - 1;
+	for (khint_t j = 0; j != _n_buckets; ++j) {
+		if (__ac_iseither(_flags, j) == 0) {
+			Slot &s = _slots[j];
+			khint_t k = hashKey(s.key);
+			khint_t i = k & new_mask;
+			khint_t inc = __ac_inc(k, new_mask);
+			while (!__ac_isempty(new_flags, i)) i = (i + inc) & new_mask;
+			__ac_set_isempty_false(new_flags, i);
+			relocate(&(new_slots[i].key), s.key);
+			relocate(&(new_slots[i].val), s.val);
+		}
+	}
+	if(optimisticFind && _n_buckets)
+		retire(_n_buckets, _flags, _slots);
+	else {
+		ALLOC::free(_flags);
+		ALLOC::free(_slots);
+	}
+	_flags = new_flags;
+	_slots = new_slots;
+	_n_buckets = new_n_buckets;
+	_n_occupied = _size;
+	_upper_bound = (khint_t)(_n_buckets * __ac_HASH_UPPER + 0.5);
+}
+
+// finds or makes the bucket for 'key'. If it is new (*ret != 0) the key is constructed, the val is not.
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+khint_t TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::putSlot( const KEY &key, int *ret ) {
+	khint_t x;
+	if (_n_occupied >= _upper_bound) { /* update the hash table */
+		if (_n_buckets > (_size<<1)) resize(_n_buckets - 1); /* clear "deleted" elements */
+		else resize(_n_buckets + 1); /* expand the hash table */
+	}
+	{
+		khint_t inc, k, i, site, last, mask = _n_buckets - 1;
+		x = site = _n_buckets; k = hashKey(key); i = k & mask;
+		if (__ac_isempty(_flags, i)) x = i; /* for speed up */
+		else {
+			inc = __ac_inc(k, mask); last = i;
+			while (!__ac_isempty(_flags, i) && (__ac_isdel(_flags, i) || !keyEqual(_slots[i].key, key))) {
+				if (__ac_isdel(_flags, i)) site = i;
+				i = (i + inc) & mask;
+				if (i == last) { x = site; break; }
+			}
+			if (x == _n_buckets) {
+				if (__ac_isempty(_flags, i) && site != _n_buckets) x = site;
+				else x = i;
+			}
+		}
+	}
+	if (__ac_isempty(_flags, x)) { /* not present at all */
+		new (&(_slots[x].key)) KEY(key);
+		__ac_set_isboth_false(_flags, x);
+		++_size; ++_n_occupied;
+		*ret = 1;
+	} else if (__ac_isdel(_flags, x)) { /* deleted */
+		new (&(_slots[x].key)) KEY(key);
+		__ac_set_isboth_false(_flags, x);
+		++_size;
+		*ret = 2;
+	} else *ret = 0; /* present */
+	return x;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::delSlot( khint_t x ) {
+	if (x != _n_buckets && !__ac_iseither(_flags, x)) {
+		_slots[x].key.~KEY();
+		_slots[x].val.~DATA();
+		__ac_set_isdel_true(_flags, x);
+		--_size;
+	}
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::removeAll() {
+	_lock.acquire();
+	int c = 0;
+	for (khint_t k = 0; k != _n_buckets; ++k)
+		if (!__ac_iseither(_flags, k)) {
+			_slots[k].key.~KEY();
+			_slots[k].val.~DATA();
+			c++;
+		}
+	if (_flags)
+		ALLOC::memset(_flags, 0xaa, __ac_fsize(_n_buckets) * sizeof(khint32_t));
+	_size = _n_occupied = 0;
+	_lock.release();
+	__TW_HASH_DEBUG("deleted: %d records\n", c );
+	return true;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+int TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::size() {
+	return (int) _size;
+}
+
+// replace the data if it exists.
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addReplace( const KEY& key, DATA& dat, DATA& oldref ) {
+	_lock.acquire();
+	int r;
+	khint_t k = putSlot(key, &r);
+	if(!r) { // have this key
+		oldref = _slots[k].val;
+		_slots[k].val.~DATA(); // out w/ the old, in with the new
+	}
+	new (&(_slots[k].val)) DATA(dat);
+	_lock.release();
+	return true;
+}
+
+// replace the data if it exists.
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addReplace( const KEY& key, DATA& dat ) {
+	_lock.acquire();
+	int r;
+	khint_t k = putSlot(key, &r);
+	if(!r)
+		_slots[k].val.~DATA();
+	new (&(_slots[k].val)) DATA(dat);
+	_lock.release();
+	return true;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addReplaceNew( const KEY& key ) {
+	_lock.acquire();
+	int r;
+	khint_t k = putSlot(key, &r);
+	if(!r)
+		_slots[k].val.~DATA();
+	DATA *ret = new (&(_slots[k].val)) DATA();
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addNoreplaceNew( const KEY& key ) {
+	DATA *ret = NULL;
+	_lock.acquire();
+	int r;
+	khint_t k = putSlot(key, &r);
+	if(r)
+		ret = new (&(_slots[k].val)) DATA();
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::findOrNew( const KEY& key ) {
+	_lock.acquire();
+	int r;
+	khint_t k = putSlot(key, &r);
+	if(r)
+		new (&(_slots[k].val)) DATA();
+	DATA *ret = &(_slots[k].val);
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addNoreplace( const KEY& key, DATA& dat ) {
+	bool ret = false;
+	_lock.acquire();
+	int r;
+	khint_t k = putSlot(key, &r);
+	if(r) {
+		new (&(_slots[k].val)) DATA(dat);
+		ret = true;
+	}
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::remove( const KEY& key, DATA& fill ) {
+	bool ret = false;
+	_lock.acquire();
+	khint_t k = getSlot(key);
+	if(k != _n_buckets) {
+		fill = _slots[k].val;
+		delSlot(k);
+		ret = true;
+	}
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::remove( const KEY& key ) {
+	bool ret = false;
+	_lock.acquire();
+	khint_t k = getSlot(key);
+	if(k != _n_buckets) {
+		delSlot(k);
+		ret = true;
+	}
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( const KEY& key, DATA& fill ) {
+	return find(key, fill, std::integral_constant<bool, optimisticFind>());
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( const KEY& key, DATA& fill, std::false_type ) {
+	bool ret = false;
+	tw_mutex_traits<MUTEX>::acquireRead(_lock);
+	khint_t k = getSlot(key);
+	if(k != _n_buckets) {
+		fill = _slots[k].val; // uses DATA::operator=()
+		ret = true;
+	}
+	tw_mutex_traits<MUTEX>::releaseRead(_lock);
+	return ret;
+}
+
+// the lock free version, for a TW_SeqLock
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( const KEY& key, DATA& fill, std::true_type ) {
+	typename std::aligned_storage<sizeof(DATA), alignof(DATA)>::type copy;
+	while(1) {
+		uint32_t s = _lock.readBegin();
+		khint_t n_buckets = _n_buckets;
+		const khint32_t *flags = _flags;
+		const Slot *slots = _slots;
+		if(!_lock.readValidate(s)) // caught in the middle of a resize - the three may not go together
+			continue;
+		khint_t k = probe(n_buckets, flags, slots, key);
+		bool found = (k != n_buckets);
+		if(found)
+			memcpy(&copy, &(slots[k].val), sizeof(DATA));
+		if(_lock.readValidate(s)) {
+			if(found)
+				memcpy(&fill, &copy, sizeof(DATA));
+			return found;
+		}
+	}
+}
+
+/**
+ * @return a pointer to the value in the table (good until the next add / remove), or NULL
+ */
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( const KEY& key ) {
+	DATA *ret = NULL;
+	tw_mutex_traits<MUTEX>::acquireRead(_lock);
+	khint_t k = getSlot(key);
+	if(k != _n_buckets)
+		ret = &(_slots[k].val);
+	tw_mutex_traits<MUTEX>::releaseRead(_lock);
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::gotoStart(HashIterator &i) {
+	_lock.acquire();
+	_iterators_out++;
+	i._iter = 0;
+	while(i._iter != _n_buckets && __ac_iseither(_flags, i._iter)) // skip empty buckets
+		i._iter++;
+	_lock.release();
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::releaseIter() {
+	_lock.acquire();
+	if(_iterators_out > 0)
+		_iterators_out--;
+	_lock.release();
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::HashIterator(TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC> &map) :
+_iter( 0 ), _map( map ) {
+	_map.gotoStart(*this);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+KEY *TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::key() {
+	if(_iter != _map._n_buckets)
+		return &(_map._slots[_iter].key);
+	else
+		return NULL;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::data() {
+	if(_iter != _map._n_buckets)
+		return &(_map._slots[_iter].val);
+	else
+		return NULL;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::setData(DATA *d) {
+	if(_iter != _map._n_buckets && d)
+		_map._slots[_iter].val = *d;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::getNext() {
+	if(_iter == _map._n_buckets)
+		return false;
+	_iter++;
+	while(_iter != _map._n_buckets && __ac_iseither(_map._flags, _iter)) // the iterator goes through empty buckets, so this deals with passing those up also
+		_iter++;
+	return _iter != _map._n_buckets;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::atEnd() {
+	return _iter == _map._n_buckets;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_KHash_32_Inline<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::release() {
+	_map.releaseIter();
+}
+
+} // end namespace
+
+#endif /* TW_KHASH_INLINE_H_ */
@@ -0,0 +1,346 @@
+// tupperware container lib
+// tw_lz4.h
+
+/*
+ * tw_lz4.h
+ *
+ * LZ4 block format compression (built in - no liblz4 needed), and compress / decompress of
+ * BufBlk chains:
+ *   BufBlk<Alloc_Std> *z = tw_lz4_compress_chain(msg, &pool);
+ *   BufBlk<Alloc_Std> *back = tw_lz4_decompress_chain(z, &pool);
+ *
+ * The chain is compressed in chunks of a configurable size. Each chunk is a frame:
+ *   [uint32 LE: compressed size, top bit set if the chunk is stored uncompressed][uint32 LE: raw size][data]
+ * so large messages can be compressed a chunk at a time as they are produced (see LZ4ChainCompressor),
+ * and decompressed frame by frame.
+ */
+
+#ifndef TW_LZ4_H_
+#define TW_LZ4_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <TW/tw_bufblk.h>
+#include <TW/tw_bufblk_pool.h>
+
+#ifndef TW_LZ4_CHUNK_SIZE
+#define TW_LZ4_CHUNK_SIZE (64*1024)
+#endif
+// frames claiming to be larger than this are treated as corrupt
+#ifndef TW_LZ4_MAX_CHUNK
+#define TW_LZ4_MAX_CHUNK (16*1024*1024)
+#endif
+
+#define TW_LZ4_FRAME_HDR 8
+#define TW_LZ4_STORED 0x80000000U
+
+namespace TWlib {
+
+// worst case compressed size of 'n' bytes
+inline int tw_lz4_bound( int n ) { return n + (n / 255) + 16; }
+
+/**
+ * Compresses 'len' bytes of src into dst, in the LZ4 block format.
+ * @return the compressed size, or 0 if it did not fit in 'cap'
+ */
+int tw_lz4_compress( const char *src, int len, char *dst, int cap );
+
+/**
+ * Decompresses an LZ4 block. Safe against corrupt input.
+ * @return the decompressed size, or -1 if the input is malformed or does not fit in 'cap'
+ */
+int tw_lz4_decompress( const char *src, int len, char *dst, int cap );
+
+/**
+ * A block of at least 'size' bytes for output - from 'pool' if one is given.
+ * @return the block, or NULL if out of memory
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *tw_lz4_new_blk( BufBlkPool<ALLOC> *pool, int size ) {
+	BufBlk<ALLOC> *b = pool ? pool->get(size) : new BufBlk<ALLOC>(size);
+	if(b && size > 0 && !b->wr_ptr()) { // MemBlk could not get its memory
+		b->release();
+		b = NULL;
+	}
+	return b;
+}
+
+/**
+ * Compresses data, a chunk at a time, into a chain of frames.
+ * Full chunks which are contiguous in the input are compressed straight from it. Only data which
+ * straddles blocks (or a chunk boundary) is copied, into one chunk sized buffer.
+ * If the worst case frame for a chunk fits one of the pool's size classes, the chunk is compressed
+ * straight into a block from 'pool'. Otherwise (no pool, or chunks bigger than the pool's classes) it
+ * is compressed into a reusable worst case sized buffer, then copied into a block sized to the frame,
+ * so unpooled output blocks do not pin worst case memory.
+ * If memory runs out, failed() is set, and the data added from then on is dropped - finish() returns NULL.
+ */
+template <class ALLOC>
+class LZ4ChainCompressor {
+public:
+	LZ4ChainCompressor( BufBlkPool<ALLOC> *pool = NULL, int chunkSize = TW_LZ4_CHUNK_SIZE );
+	~LZ4ChainCompressor();
+	bool add( BufBlk<ALLOC> *in );         // the readable data of the chain. 'in' is not changed.
+	bool add( const void *data, int len ); // false if out of memory
+	BufBlk<ALLOC> *takeOutput();           // the frames completed so far (caller owns them), or NULL
+	BufBlk<ALLOC> *finish();               // flushes the last partial chunk, and returns the rest of the output
+	bool failed() { return _failed; }
+	uint64_t rawBytes() { return _raw; }
+	uint64_t compressedBytes() { return _compressed; }
+protected:
+	bool emit( const char *src, int len );
+	BufBlkPool<ALLOC> *_pool;
+	int _chunk;
+	char *_pending;
+	int _pendingLen;
+	char *_zbuf;          // tw_lz4_bound(_chunk) bytes - compress() output for unpooled frames, before it is copied out
+	BufBlk<ALLOC> *_out;
+	BufBlk<ALLOC> *_outTail;
+	uint64_t _raw;
+	uint64_t _compressed;
+	bool _failed;
+};
+
+template <class ALLOC>
+LZ4ChainCompressor<ALLOC>::LZ4ChainCompressor( BufBlkPool<ALLOC> *pool, int chunkSize ) :
+	_pool( pool ),
+	_chunk( chunkSize ),
+	_pending( NULL ),
+	_pendingLen( 0 ),
+	_zbuf( NULL ),
+	_out( NULL ),
+	_outTail( NULL ),
+	_raw( 0 ),
+	_compressed( 0 ),
+	_failed( false )
+{ }
+
+template <class ALLOC>
+LZ4ChainCompressor<ALLOC>::~LZ4ChainCompressor() {
+	if(_pending)
+		ALLOC::free(_pending);
+	if(_zbuf)
+		ALLOC::free(_zbuf);
+	if(_out)
+		_out->release();
+}
+
+// writes the frame header in front of 'clen' bytes of compressed (or stored) data
+inline void tw_lz4_frame_hdr( char *hdr, uint32_t clen, uint32_t rlen ) {
+	for(int n=0;n<4;n++) { // little endian
+		hdr[n] = (char) (clen >> (8 * n));
+		hdr[4 + n] = (char) (rlen >> (8 * n));
+	}
+}
+
+template <class ALLOC>
+bool LZ4ChainCompressor<ALLOC>::emit( const char *src, int len ) {
+	int worst = TW_LZ4_FRAME_HDR + tw_lz4_bound(len);
+	BufBlk<ALLOC> *b = NULL;
+	uint32_t clen;
+	if(_pool && _pool->classSize(worst) >= worst) { // compress straight into the output block
+		if(!(b = tw_lz4_new_blk(_pool, worst)))
+			return false;
+		char *body = b->wr_ptr() + TW_LZ4_FRAME_HDR;
+		clen = (uint32_t) tw_lz4_compress(src, len, body, worst - TW_LZ4_FRAME_HDR);
+		if(clen == 0 || clen >= (uint32_t) len) { // didn't compress - store it
+			ALLOC::memcpy(body, src, len);
+			clen = (uint32_t) len | TW_LZ4_STORED;
+		}
+	} else {
+		if(!_zbuf && !(_zbuf = (char *) ALLOC::malloc(tw_lz4_bound(_chunk))))
+			return false;
+		clen = (uint32_t) tw_lz4_compress(src, len, _zbuf, tw_lz4_bound(_chunk));
+		const char *body = _zbuf;
+		if(clen == 0 || clen >= (uint32_t) len) {
+			body = src;
+			clen = (uint32_t) len | TW_LZ4_STORED;
+		}
+		int blen = (int) (clen & ~TW_LZ4_STORED);
+		if(!(b = tw_lz4_new_blk(_pool, TW_LZ4_FRAME_HDR + blen)))
+			return false;
+		ALLOC::memcpy(b->wr_ptr() + TW_LZ4_FRAME_HDR, body, blen);
+	}
+	int flen = TW_LZ4_FRAME_HDR + (int) (clen & ~TW_LZ4_STORED);
+	tw_lz4_frame_hdr(b->wr_ptr(), clen, (uint32_t) len);
+	b->inc_wr_ptr(flen);
+	_raw += len;
+	_compressed += flen;
+	if(_outTail)
+		_outTail->setNexblk(b);
+	else
+		_out = b;
+	_outTail = b;
+	return true;
+}
+
+template <class ALLOC>
+bool LZ4ChainCompressor<ALLOC>::add( const void *data, int len ) {
+	const char *p = (const char *) data;
+	if(_failed) return false;
+	while(len > 0) {
+		if(_pendingLen == 0 && len >= _chunk) { // a whole chunk in place
+			if(!emit(p, _chunk)) {
+				_failed = true;
+				return false;
+			}
+			p += _chunk;
+			len -= _chunk;
+			continue;
+		}
+		if(!_pending && !(_pending = (char *) ALLOC::malloc(_chunk))) {
+			_failed = true;
+			return false;
+		}
+		int n = _chunk - _pendingLen;
+		if(n > len) n = len;
+		ALLOC::memcpy(_pending + _pendingLen, p, n);
+		_pendingLen += n;
+		p += n;
+		len -= n;
+		if(_pendingLen == _chunk) {
+			_pendingLen = 0;
+			if(!emit(_pending, _chunk)) {
+				_failed = true;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+template <class ALLOC>
+bool LZ4ChainCompressor<ALLOC>::add( BufBlk<ALLOC> *in ) {
+	for(BufBlk<ALLOC> *look = in; look; look = look->nexblk())
+		if(look->isValid() && look->length() > 0 && !add(look->rd_ptr(), look->length()))
+			return false;
+	return !_failed;
+}
+
+template <class ALLOC>
+BufBlk<ALLOC> *LZ4ChainCompressor<ALLOC>::takeOutput() {
+	BufBlk<ALLOC> *ret = _out;
+	_out = NULL;
+	_outTail = NULL;
+	return ret;
+}
+
+template <class ALLOC>
+BufBlk<ALLOC> *LZ4ChainCompressor<ALLOC>::finish() {
+	if(_pendingLen > 0 && !_failed) {
+		if(!emit(_pending, _pendingLen))
+			_failed = true;
+		_pendingLen = 0;
+	}
+	if(_failed) { // frames are missing - what is left is no use
+		if(_out) _out->release();
+		_out = _outTail = NULL;
+	}
+	return takeOutput();
+}
+
+/**
+ * Compresses the readable data of 'in' into a new chain of frames. 'in' is not changed.
+ * @param ok [out] if given, set to false if memory ran out
+ * @return the compressed chain, or NULL if 'in' had no data or memory ran out
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *tw_lz4_compress_chain( BufBlk<ALLOC> *in, BufBlkPool<ALLOC> *pool = NULL, int chunkSize = TW_LZ4_CHUNK_SIZE, bool *ok = NULL ) {
+	LZ4ChainCompressor<ALLOC> c(pool, chunkSize);
+	c.add(in);
+	BufBlk<ALLOC> *ret = c.finish();
+	if(ok) *ok = !c.failed();
+	return ret;
+}
+
+/**
+ * Decompresses a chain of frames made by LZ4ChainCompressor / tw_lz4_compress_chain(). Each frame becomes
+ * one block of the output. Frames which are contiguous in 'in' are decompressed straight from it; frames
+ * which straddle blocks are gathered first.
+ * @param ok [out] if given, set to false if the input was corrupt or truncated, or memory ran out
+ * @return the decompressed chain, or NULL if there was no data, the input was bad, or memory ran out
+ */
+template <class ALLOC>
+BufBlk<ALLOC> *tw_lz4_decompress_chain( BufBlk<ALLOC> *in, BufBlkPool<ALLOC> *pool = NULL, bool *ok = NULL ) {
+	if(ok) *ok = true;
+	if(!in) return NULL;
+	BufBlkIter<ALLOC> iter(*in);
+	BufBlk<ALLOC> *ret = NULL;
+	BufBlk<ALLOC> *tail = NULL;
+	char *scratch = NULL;
+	int scratchLen = 0;
+	bool good = true;
+	while(1) {
+		unsigned char hdr[TW_LZ4_FRAME_HDR];
+		int copied = 0;
+		if(!iter.copyNextChunks((char *) hdr, TW_LZ4_FRAME_HDR, copied) || copied == 0)
+			break; // end of input
+		if(copied != TW_LZ4_FRAME_HDR) {
+			good = false;
+			break;
+		}
+		uint32_t clen = 0, rlen = 0;
+		for(int n=0;n<4;n++) {
+			clen |= (uint32_t) hdr[n] << (8 * n);
+			rlen |= (uint32_t) hdr[4 + n] << (8 * n);
+		}
+		bool stored = (clen & TW_LZ4_STORED) != 0;
+		clen &= ~TW_LZ4_STORED;
+		if(rlen > TW_LZ4_MAX_CHUNK || clen > (uint32_t) tw_lz4_bound(TW_LZ4_MAX_CHUNK) || (stored && clen != rlen)) {
+			good = false;
+			break;
+		}
+		// the frame's data - in place if it is all in one block
+		char *src = NULL;
+		int size = 0;
+		if(iter.previewNextChunk(src, size, (int) clen) && size == (int) clen)
+			iter.getNextChunk(src, size, (int) clen);
+		else {
+			if(scratchLen < (int) clen) {
+				if(scratch) ALLOC::free(scratch);
+				scratchLen = 0;
+				if(!(scratch = (char *) ALLOC::malloc(clen))) {
+					good = false;
+					break;
+				}
+				scratchLen = (int) clen;
+			}
+			if(!iter.copyNextChunks(scratch, (int) clen, copied) || copied != (int) clen) {
+				good = false;
+				break;
+			}
+			src = scratch;
+		}
+		BufBlk<ALLOC> *b = tw_lz4_new_blk(pool, (int) rlen);
+		if(!b) {
+			good = false;
+			break;
+		}
+		if(stored)
+			ALLOC::memcpy(b->wr_ptr(), src, rlen);
+		else if(tw_lz4_decompress(src, (int) clen, b->wr_ptr(), (int) rlen) != (int) rlen) {
+			b->release();
+			good = false;
+			break;
+		}
+		b->inc_wr_ptr(rlen);
+		if(tail)
+			tail->setNexblk(b);
+		else
+			ret = b;
+		tail = b;
+	}
+	if(scratch)
+		ALLOC::free(scratch);
+	if(!good) {
+		if(ret) ret->release();
+		ret = NULL;
+		if(ok) *ok = false;
+	}
+	return ret;
+}
+
+}
+
+#endif /* TW_LZ4_H_ */
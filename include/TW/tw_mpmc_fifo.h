@@ -0,0 +1,366 @@
+// tupperware container lib
+#ifndef _TW_MPMC_FIFO
+#define _TW_MPMC_FIFO
+
+// A bounded, lock-free, multi producer / multi consumer FIFO.
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <new>
+#include <atomic>
+#include <utility>
+
+#include <TW/tw_defs.h>
+#include <TW/tw_utils.h> // TimeVal
+#include <TW/tw_alloc.h>
+
+
+namespace TWlib {
+
+/**
+ * A bounded FIFO for many producer and many consumer threads. This is an alternative to tw_bndSafeFIFO which
+ * does not malloc() a link per item, and takes no mutex on the fast path.
+ *
+ * Based on Dmitry Vyukov's bounded MPMC queue: a preallocated array of slots, each with a sequence number
+ * which tells a producer (or consumer) if the slot is ready for it. Producers and consumers only contend on
+ * the enqueue / dequeue position with a CAS.
+ *
+ * A mutex / condition is used only when a caller must block: remove on an empty FIFO, or add on a full FIFO.
+ * The maximum size is rounded up to the next power of two.
+ *
+ * T must support:
+ * self assignment: operator= (T &a, T &b) (or rvalue assignment if only using the move calls)
+ * default constructor
+ */
+template <class T,class ALLOC>
+class tw_bndMPMCFIFO {
+public:
+	tw_bndMPMCFIFO( int maxsize );
+	tw_bndMPMCFIFO() = delete;
+	tw_bndMPMCFIFO( tw_bndMPMCFIFO<T,ALLOC> &o ) = delete;
+
+	void add( T &d );         // blocks if full
+#if __cplusplus >= 201103L
+	void add( T &&d );
+#endif
+	bool addIfRoom( T &d );   // false if full - wont block
+	bool remove( T &fill ); // true if got data
+#if __cplusplus >= 201103L
+	bool remove_mv( T &fill );
+#endif
+	bool removeOrBlock( T &fill ); // true if removed something
+	bool removeOrBlock( T &fill, TimeVal &t );
+	void unblockRemoveCalls();  // unblock all blocking remove calls
+	void unblockAll(); // unblock all blocking calls
+	void disable();
+	void enable();
+	int remaining();
+	int maxSize() { return (int) _size; }
+	~tw_bndMPMCFIFO();
+protected:
+	struct tw_MPMC_slot {
+		std::atomic<uint32_t> seq;
+		T d;
+	};
+
+	std::atomic<uint32_t> _enqPos;
+	char _pad1[TW_CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>)];
+	std::atomic<uint32_t> _deqPos;
+	char _pad2[TW_CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>)];
+
+	// slow path only - used for blocking
+	std::atomic<int> _waitingAdders;
+	std::atomic<int> _waitingRemovers;
+	std::atomic<bool> enabled; // if enabled the FIFO can take new values
+	pthread_mutex_t _waitMutex;
+	pthread_cond_t _notEmptyCond;
+	pthread_cond_t _notFullCond;
+	int _removerGen; // bumped to wake removers, who then fail
+	int _adderGen;   // bumped to wake adders, who then give up
+
+	uint32_t _size;  // power of two
+	uint32_t _mask;
+	tw_MPMC_slot *_slots;
+
+	static uint32_t roundUpPow2( int n ) {
+		uint32_t r = 1;
+		while(r < (uint32_t) n) r <<= 1;
+		return r;
+	}
+
+	// claims a slot to fill, or NULL if full. Must be followed by commitAdd()
+	tw_MPMC_slot *claimAdd( uint32_t &pos ) {
+		pos = _enqPos.load(std::memory_order_relaxed);
+		while(1) {
+			tw_MPMC_slot *s = &_slots[pos & _mask];
+			int32_t diff = (int32_t) (s->seq.load(std::memory_order_acquire) - pos);
+			if(diff == 0) {
+				if(_enqPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					return s;
+			} else if(diff < 0) {
+				return NULL;
+			} else
+				pos = _enqPos.load(std::memory_order_relaxed);
+		}
+	}
+	void commitAdd( tw_MPMC_slot *s, uint32_t pos ) {
+		s->seq.store(pos + 1, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(_waitingRemovers.load(std::memory_order_relaxed) > 0)
+			wakeup(&_notEmptyCond);
+	}
+	// claims a slot to empty, or NULL if empty. Must be followed by commitRemove()
+	tw_MPMC_slot *claimRemove( uint32_t &pos ) {
+		pos = _deqPos.load(std::memory_order_relaxed);
+		while(1) {
+			tw_MPMC_slot *s = &_slots[pos & _mask];
+			int32_t diff = (int32_t) (s->seq.load(std::memory_order_acquire) - (pos + 1));
+			if(diff == 0) {
+				if(_deqPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					return s;
+			} else if(diff < 0) {
+				return NULL;
+			} else
+				pos = _deqPos.load(std::memory_order_relaxed);
+		}
+	}
+	void commitRemove( tw_MPMC_slot *s, uint32_t pos ) {
+		s->seq.store(pos + _mask + 1, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(_waitingAdders.load(std::memory_order_relaxed) > 0)
+			wakeup(&_notFullCond);
+	}
+
+	void wakeup( pthread_cond_t *c ) {
+		pthread_mutex_lock(&_waitMutex);
+		pthread_cond_signal(c);
+		pthread_mutex_unlock(&_waitMutex);
+	}
+
+	// these are a peek at the next slot - a hint for the blocking calls only
+	bool looksFull() {
+		uint32_t pos = _enqPos.load(std::memory_order_relaxed);
+		return (int32_t) (_slots[pos & _mask].seq.load(std::memory_order_acquire) - pos) < 0;
+	}
+	bool looksEmpty() {
+		uint32_t pos = _deqPos.load(std::memory_order_relaxed);
+		return (int32_t) (_slots[pos & _mask].seq.load(std::memory_order_acquire) - (pos + 1)) < 0;
+	}
+
+	bool waitForRoom();
+	bool waitForData( const struct timespec *abstime );
+};
+
+}
+
+using namespace TWlib;
+
+template <class T,class ALLOC>
+tw_bndMPMCFIFO<T,ALLOC>::tw_bndMPMCFIFO( int maxsize ) :
+	_enqPos(0), _deqPos(0), _waitingAdders(0), _waitingRemovers(0), enabled(true),
+	_removerGen(0), _adderGen(0), _size(roundUpPow2(maxsize)), _mask(0), _slots(NULL) {
+	_mask = _size - 1;
+	pthread_mutex_init( &_waitMutex, NULL );
+	pthread_cond_init( &_notEmptyCond, NULL );
+	pthread_cond_init( &_notFullCond, NULL );
+	_slots = (tw_MPMC_slot *) ALLOC::malloc( _size * sizeof(tw_MPMC_slot) );
+	for(uint32_t n=0;n<_size;n++) {
+		::new((void*)&_slots[n].seq) std::atomic<uint32_t>(n);
+		::new((void*)&_slots[n].d) T(); // must explicity call the constructor
+	}
+}
+
+// blocks until the FIFO looks to have room (true) or unblockAll() was called (false)
+template <class T,class ALLOC>
+bool tw_bndMPMCFIFO<T,ALLOC>::waitForRoom() {
+	bool ret = true;
+	pthread_mutex_lock(&_waitMutex);
+	int gen = _adderGen;
+	_waitingAdders++;
+	std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with fence in commitRemove()
+	while(looksFull()) {
+		if(gen != _adderGen) { ret = false; break; }
+		pthread_cond_wait( &_notFullCond, &_waitMutex );
+	}
+	_waitingAdders--;
+	pthread_mutex_unlock(&_waitMutex);
+	return ret;
+}
+
+// blocks until the FIFO looks to have data (true) or timeout / unblock (false)
+template <class T,class ALLOC>
+bool tw_bndMPMCFIFO<T,ALLOC>::waitForData( const struct timespec *abstime ) {
+	bool ret = true;
+	pthread_mutex_lock(&_waitMutex);
+	int gen = _removerGen;
+	_waitingRemovers++;
+	std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with fence in commitAdd()
+	while(looksEmpty()) {
+		if(gen != _removerGen) { ret = false; break; }
+		int r;
+		if(abstime)
+			r = pthread_cond_timedwait( &_notEmptyCond, &_waitMutex, abstime );
+		else
+			r = pthread_cond_wait( &_notEmptyCond, &_waitMutex );
+		if(r == ETIMEDOUT && looksEmpty()) { ret = false; break; }
+	}
+	_waitingRemovers--;
+	pthread_mutex_unlock(&_waitMutex);
+	return ret;
+}
+
+/**
+ * enables the FIFO, allowing the adding of new items.
+ * Items already in the FIFO can be pulled out irregardless.
+ */
+template <class T,class ALLOC>
+void tw_bndMPMCFIFO<T,ALLOC>::enable() {
+	enabled.store(true);
+}
+
+/**
+ * disables the FIFO, preventing the adding of new items.
+ * Items already in the FIFO can be pulled out.
+ */
+template <class T,class ALLOC>
+void tw_bndMPMCFIFO<T,ALLOC>::disable() {
+	enabled.store(false);
+}
+
+/**
+ * Will block if the FIFO is full
+ */
+template <class T,class ALLOC>
+void tw_bndMPMCFIFO<T,ALLOC>::add( T &the_d ) {
+	uint32_t pos;
+	tw_MPMC_slot *s;
+	if(!enabled.load(std::memory_order_relaxed)) return;
+	while(!(s = claimAdd(pos))) {
+		if(!waitForRoom()) return; // unblocked
+	}
+	s->d = the_d;
+	commitAdd(s, pos);
+}
+
+#if __cplusplus >= 201103L
+template <class T,class ALLOC>
+void tw_bndMPMCFIFO<T,ALLOC>::add( T &&the_d ) {
+	uint32_t pos;
+	tw_MPMC_slot *s;
+	if(!enabled.load(std::memory_order_relaxed)) return;
+	while(!(s = claimAdd(pos))) {
+		if(!waitForRoom()) return; // unblocked
+	}
+	s->d = std::move(the_d);
+	commitAdd(s, pos);
+}
+#endif
+
+template <class T,class ALLOC>
+bool tw_bndMPMCFIFO<T,ALLOC>::addIfRoom( T &the_d ) {
+	uint32_t pos;
+	tw_MPMC_slot *s;
+	if(!enabled.load(std::memory_order_relaxed)) return false;
+	if(!(s = claimAdd(pos))) return false;
+	s->d = the_d;
+	commitAdd(s, pos);
+	return true;
+}
+
+template <class T,class ALLOC>
+bool tw_bndMPMCFIFO<T,ALLOC>::remove( T &fill ) {
+	uint32_t pos;
+	tw_MPMC_slot *s = claimRemove(pos);
+	if(!s) return false;
+	fill = s->d;
+	commitRemove(s, pos);
+	return true;
+}
+
+#if __cplusplus >= 201103L
+template <class T,class ALLOC>
+bool tw_bndMPMCFIFO<T,ALLOC>::remove_mv( T &fill ) {
+	uint32_t pos;
+	tw_MPMC_slot *s = claimRemove(pos);
+	if(!s) return false;
+	fill = std::move(s->d);
+	commitRemove(s, pos);
+	return true;
+}
+#endif
+
+template <class T,class ALLOC>
+bool tw_bndMPMCFIFO<T,ALLOC>::removeOrBlock( T &fill ) {
+	uint32_t pos;
+	tw_MPMC_slot *s;
+	while(!(s = claimRemove(pos))) {
+		if(!waitForData(NULL)) return false;
+	}
+	fill = s->d;
+	commitRemove(s, pos);
+	return true;
+}
+
+/**
+ * Remove or block until the absolute time in 't'
+ */
+template <class T,class ALLOC>
+bool tw_bndMPMCFIFO<T,ALLOC>::removeOrBlock( T &fill, TimeVal &t ) {
+	uint32_t pos;
+	tw_MPMC_slot *s;
+	while(!(s = claimRemove(pos))) {
+		if(!waitForData(t.timespec())) return false;
+	}
+	fill = s->d;
+	commitRemove(s, pos);
+	return true;
+}
+
+/**
+ * Number of items in the FIFO. This is a snapshot, and may be stale by the time it returns.
+ */
+template <class T,class ALLOC>
+int tw_bndMPMCFIFO<T,ALLOC>::remaining() {
+	int32_t r = (int32_t) (_enqPos.load(std::memory_order_acquire) - _deqPos.load(std::memory_order_acquire));
+	if(r < 0) r = 0;
+	return r;
+}
+
+/**
+ * Unblocks all blocking remove calls. Those calls will fail gracefully with a false.
+ */
+template <class T,class ALLOC>
+void tw_bndMPMCFIFO<T,ALLOC>::unblockRemoveCalls() {
+	pthread_mutex_lock(&_waitMutex);
+	_removerGen++;
+	pthread_cond_broadcast(&_notEmptyCond);
+	pthread_mutex_unlock(&_waitMutex);
+}
+
+/**
+ * Unblocks all blocking calls - adds and removes.
+ */
+template <class T,class ALLOC>
+void tw_bndMPMCFIFO<T,ALLOC>::unblockAll() {
+	pthread_mutex_lock(&_waitMutex);
+	_removerGen++;
+	_adderGen++;
+	pthread_cond_broadcast(&_notEmptyCond);
+	pthread_cond_broadcast(&_notFullCond);
+	pthread_mutex_unlock(&_waitMutex);
+}
+
+template <class T,class ALLOC>
+tw_bndMPMCFIFO<T,ALLOC>::~tw_bndMPMCFIFO() { // (and hope someone took care of the data in each of those)
+	unblockAll();
+	for(uint32_t n=0;n<_size;n++) {
+		_slots[n].d.~T();
+	}
+	ALLOC::free(_slots);
+	pthread_cond_destroy(&_notEmptyCond);
+	pthread_cond_destroy(&_notFullCond);
+	pthread_mutex_destroy(&_waitMutex);
+}
+
+#endif // _TW_MPMC_FIFO
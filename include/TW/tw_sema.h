@@ -18,6 +18,10 @@
 #include <pthread.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sched.h>
+#include <stdint.h>
+
+#include <atomic>
 
 #include <TW/tw_utils.h>
 
@@ -130,6 +134,162 @@ public:
 		pthread_mutex_destroy( &localMutex );
 	}
 };
+
+/**
+ * A reader / writer lock, usable as a MUTEX policy. acquire() / release() are the writer (exclusive) side,
+ * so it drops in for TW_Mutex. The containers take the reader side for lookups, through tw_mutex_traits,
+ * so many threads can find() at once.
+ */
+class TW_RWMutex {
+protected:
+	pthread_rwlock_t localLock;
+public:
+	TW_RWMutex() {
+		pthread_rwlock_init( &localLock, NULL );
+	}
+	int acquire() {
+		return pthread_rwlock_wrlock( &localLock );
+	}
+	int acquire(TimeVal &t) {
+#ifdef __APPLE__
+		int ret;
+		while((ret = pthread_rwlock_trywrlock( &localLock )) == EBUSY) {
+			struct timeval now;
+			::gettimeofday(&now, NULL);
+			if(!timercmp(&now, t.timeval(), <)) return ETIMEDOUT;
+			usleep(1000);
+		}
+		return ret;
+#else
+		return pthread_rwlock_timedwrlock( &localLock, t.timespec() );
+#endif
+	}
+	int release() {
+		return pthread_rwlock_unlock( &localLock );
+	}
+	int tryAcquire() {
+		return pthread_rwlock_trywrlock( &localLock );
+	}
+	int acquireRead() {
+		return pthread_rwlock_rdlock( &localLock );
+	}
+	int releaseRead() {
+		return pthread_rwlock_unlock( &localLock );
+	}
+	int tryAcquireRead() {
+		return pthread_rwlock_tryrdlock( &localLock );
+	}
+	~TW_RWMutex() {
+		pthread_rwlock_destroy( &localLock );
+	}
+};
+
+/**
+ * A sequence lock, usable as a MUTEX policy. Writers are serialized on a mutex, and bump a sequence
+ * number going in and coming out - so it is odd while a write is in progress. A reader does not lock
+ * or write to anything shared:
+ *
+ *   uint32_t s;
+ *   do {
+ *       s = lock.readBegin();
+ *       ... copy out what is needed - it may be garbage if a writer is active ...
+ *   } while(!lock.readValidate(s));
+ *
+ * So readers never slow down writers or each other, but must only read memory which can not go away under
+ * them, and must not act on what they read until readValidate() says it was consistent. The containers which
+ * support this (see tw_mutex_traits<>::optimistic) do so; the others treat a TW_SeqLock like a TW_Mutex.
+ */
+class TW_SeqLock {
+protected:
+	pthread_mutex_t localMutex;
+	std::atomic<uint32_t> _seq;
+	void enter() {
+		_seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release); // the odd count is seen before any of the writes
+	}
+	void leave() {
+		_seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+public:
+	TW_SeqLock() : _seq( 0 ) {
+		pthread_mutex_init( &localMutex, NULL );
+	}
+	int acquire() {
+		int ret = pthread_mutex_lock( &localMutex );
+		if(ret == 0) enter();
+		return ret;
+	}
+	int acquire(TimeVal &t) {
+		int ret = pthread_mutex_timedlock( &localMutex, t.timespec() );
+		if(ret == 0) enter();
+		return ret;
+	}
+	int release() {
+		leave();
+		return pthread_mutex_unlock( &localMutex );
+	}
+	int tryAcquire() {
+		int ret = pthread_mutex_trylock( &localMutex );
+		if(ret == 0) enter();
+		return ret;
+	}
+	// a locked read (for lookups which can't be done optimistically) - excludes writers, but does not
+	// change the sequence, so optimistic readers are not disturbed
+	int acquireRead() {
+		return pthread_mutex_lock( &localMutex );
+	}
+	int releaseRead() {
+		return pthread_mutex_unlock( &localMutex );
+	}
+	/**
+	 * starts an optimistic read. Waits out a writer which is in progress.
+	 * @return the sequence to hand to readValidate()
+	 */
+	uint32_t readBegin() {
+		uint32_t s;
+		int spins = 0;
+		while((s = _seq.load(std::memory_order_acquire)) & 1) {
+			if(++spins > 64) sched_yield(); // the writer may not be running
+		}
+		return s;
+	}
+	/**
+	 * @return true if no write happened since readBegin() returned 's' - so what was read is consistent
+	 */
+	bool readValidate( uint32_t s ) {
+		std::atomic_thread_fence(std::memory_order_acquire); // the reads are done before the check
+		return _seq.load(std::memory_order_relaxed) == s;
+	}
+	~TW_SeqLock() {
+		pthread_mutex_destroy( &localMutex );
+	}
+};
+
+/**
+ * How a container takes the reader side of its MUTEX. Any MUTEX w/ acquire() / release() works - it is just
+ * exclusive for readers too. Specialized for TW_RWMutex (shared readers) and TW_SeqLock (optimistic readers,
+ * where the container supports it).
+ */
+template <typename MUTEX>
+struct tw_mutex_traits {
+	static const bool optimistic = false;
+	static int acquireRead( MUTEX &m ) { return m.acquire(); }
+	static int releaseRead( MUTEX &m ) { return m.release(); }
+};
+
+template <>
+struct tw_mutex_traits<TW_RWMutex> {
+	static const bool optimistic = false;
+	static int acquireRead( TW_RWMutex &m ) { return m.acquireRead(); }
+	static int releaseRead( TW_RWMutex &m ) { return m.releaseRead(); }
+};
+
+template <>
+struct tw_mutex_traits<TW_SeqLock> {
+	static const bool optimistic = true;
+	static int acquireRead( TW_SeqLock &m ) { return m.acquireRead(); }
+	static int releaseRead( TW_SeqLock &m ) { return m.releaseRead(); }
+};
 /**
  * A simple sempahore class. I did this b/c I could not get ACE's sempahore stuff to work as expected.
  * When the Semaphore is above zero,
@@ -20,6 +20,9 @@
 #include <sys/time.h>
 
 #include <TW/tw_utils.h>
+#ifdef __linux__
+#include <TW/tw_futex.h>
+#endif
 
 //#define _TW_SEMA2_HEAVY_DEBUG
 
@@ -189,6 +192,41 @@ public:
 		return ret;
 	}
 
+	/**
+	 * Waits until the semaphore is positive, then decrements it by as much as it can, up to 'max'.
+	 * Keeps the lock. Waiters on the decrement are signaled once (broadcast if more than one was taken).
+	 * @param abstime NULL to wait indefinitely
+	 * @return the number acquired, or 0 on error / timeout
+	 */
+	int acquireManyAndKeepLock(int max, const struct timespec *abstime = NULL) {
+		int ret = 0;
+		SEMA2_MUTEX_LOCK( &localMutex );
+		while(cnt < 1) {
+			if(abstime)
+				ret = pthread_cond_timedwait( &gtZeroCond, &localMutex, abstime );
+			else
+				ret = pthread_cond_wait( &gtZeroCond, &localMutex );
+			if(ret) break;
+		}
+		if(ret) return 0;
+		int n = (cnt < max) ? cnt : max;
+		cnt -= n;
+		if(n > 1)
+			pthread_cond_broadcast( &decrementCond );
+		else
+			pthread_cond_signal( &decrementCond );
+		return n;
+	}
+
+	int acquireManyAndKeepLock(int max, const int64_t usec_wait ) {
+		timeval tv;
+		timespec ts;
+		gettimeofday(&tv, NULL);
+		TWlib::add_usec_to_timeval(usec_wait, &tv);
+		TWlib::timeval_to_timespec(&tv,&ts);
+		return acquireManyAndKeepLock( max, &ts );
+	}
+
 	/**
 	 * An easier to use acquire waiting for a given number of microseconds.
 	 * @param usec_wait
@@ -436,6 +474,19 @@ public:
 	}
 
 
+	/**
+	 * Increments the counter by 'n' - the lock must already be held. Alerts waiters once.
+	 * @return
+	 */
+	int releaseManyWithoutLock(int n) {
+		if(n < 1) return 0;
+		cnt += n;
+		if(n > 1)
+			return pthread_cond_broadcast( &gtZeroCond );
+		else
+			return pthread_cond_signal( &gtZeroCond );
+	}
+
 	int releaseWithoutLock() {
 		int ret = 0;
 		cnt++;
@@ -551,6 +602,297 @@ public:
 	}
 };
 
+#ifdef __linux__
+
+/**
+ * Same as TW_SemaTwoWay, but built on an atomic counter, a futex mutex and futex conditions (see tw_futex.h)
+ * instead of pthread mutex / conditions. Locking spins briefly before sleeping, and signaling only enters the
+ * kernel if a waiter is actually registered - so the uncontended case never makes a syscall.
+ *
+ * Use as the SEMA parameter of tw_safeCircular, i.e. tw_safeCircular<T,ALLOC,TW_FutexSemaTwoWay>
+ */
+class TW_FutexSemaTwoWay {
+protected:
+	std::atomic<int> cnt; // only changed with the lock held - but may be read without it
+	int size;
+
+	TW_FutexMutex localMutex;
+	TW_FutexCond gtZeroCond;    // signaled when the count is larger than zero
+	TW_FutexCond decrementCond; // signaled when the count goes down
+
+	// lock must be held. Drops the lock, and spins a short while waiting for a positive count
+	void spinForPositive() {
+		if(!futex::spinCount()) return;
+		localMutex.release();
+		for(int n=0;n<futex::spinCount() && cnt.load(std::memory_order_relaxed) < 1;n++)
+			TW_CPU_RELAX();
+		localMutex.acquire();
+	}
+	// lock must be held. Drops the lock, and spins a short while waiting for a decrement
+	void spinForDecrement() {
+		if(!futex::spinCount()) return;
+		localMutex.release();
+		for(int n=0;n<futex::spinCount() && cnt.load(std::memory_order_relaxed) >= size;n++)
+			TW_CPU_RELAX();
+		localMutex.acquire();
+	}
+	// lock must be held
+	int waitPositive(const struct timespec *abstime) {
+		int ret = 0;
+		if(cnt.load(std::memory_order_relaxed) < 1)
+			spinForPositive();
+		while(cnt.load(std::memory_order_relaxed) < 1) {
+			ret = gtZeroCond.wait( localMutex, abstime ); // wait for change in cnt
+			if(ret) break;
+		}
+		if(ret == 0) {
+			cnt.fetch_sub(1, std::memory_order_relaxed);
+			decrementCond.signal();
+		}
+		return ret;
+	}
+	// lock must be held
+	int waitDecrement(const struct timespec *abstime) {
+		int ret = 0;
+		if(cnt.load(std::memory_order_relaxed) >= size) {
+			spinForDecrement();
+			if(cnt.load(std::memory_order_relaxed) >= size) {
+				ret = decrementCond.wait( localMutex, abstime );
+				if(cnt.load(std::memory_order_relaxed) >= size)
+					ret = -1;
+			}
+		}
+		return ret;
+	}
+	static const struct timespec *usecToAbstime(const int64_t usec_wait, struct timespec *ts) {
+		timeval tv;
+		gettimeofday(&tv, NULL);
+		TWlib::add_usec_to_timeval(usec_wait, &tv);
+		TWlib::timeval_to_timespec(&tv,ts);
+		return ts;
+	}
+public:
+	TW_FutexSemaTwoWay() = delete;
+	TW_FutexSemaTwoWay(int init_count) :
+	cnt( init_count ), size( init_count ) { }
+
+	void reset() {
+		localMutex.acquire();
+		cnt.store(size, std::memory_order_relaxed);
+		localMutex.release();
+	}
+
+	void resetNoLock() {
+		cnt.store(size, std::memory_order_relaxed);
+	}
+
+	/** should be used only if you understand this class well */
+	void cloneFrom(TW_FutexSemaTwoWay &other) {
+		cnt.store(other.cnt.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		size = other.size;
+	}
+
+	int acquire() {
+		localMutex.acquire();
+		int ret = waitPositive(NULL);
+		localMutex.release();
+		return ret;
+	}
+
+	int acquire(const struct timespec *abstime) {
+		localMutex.acquire();
+		int ret = waitPositive(abstime);
+		localMutex.release();
+		return ret;
+	}
+
+	int acquireAndKeepLock() {
+		localMutex.acquire();
+		return waitPositive(NULL);
+	}
+
+	bool acquireAndKeepLockNoBlock() {
+		bool ret = false;
+		localMutex.acquire();
+		if(cnt.load(std::memory_order_relaxed) >= 1) {
+			cnt.fetch_sub(1, std::memory_order_relaxed);
+			decrementCond.signal();
+			ret = true;
+		}
+		return ret;
+	}
+
+	int acquireAndKeepLock(const struct timespec *abstime) {
+		localMutex.acquire();
+		return waitPositive(abstime);
+	}
+
+	int acquire(const int64_t usec_wait ) {
+		timespec ts;
+		return acquire( usecToAbstime(usec_wait, &ts) );
+	}
+
+	int acquireManyAndKeepLock(int max, const struct timespec *abstime = NULL) {
+		int ret = 0;
+		localMutex.acquire();
+		if(cnt.load(std::memory_order_relaxed) < 1)
+			spinForPositive();
+		while(cnt.load(std::memory_order_relaxed) < 1) {
+			ret = gtZeroCond.wait( localMutex, abstime );
+			if(ret) break;
+		}
+		if(ret) return 0;
+		int c = cnt.load(std::memory_order_relaxed);
+		int n = (c < max) ? c : max;
+		cnt.fetch_sub(n, std::memory_order_relaxed);
+		if(n > 1)
+			decrementCond.broadcast();
+		else
+			decrementCond.signal();
+		return n;
+	}
+
+	int acquireManyAndKeepLock(int max, const int64_t usec_wait ) {
+		timespec ts;
+		return acquireManyAndKeepLock( max, usecToAbstime(usec_wait, &ts) );
+	}
+
+	int acquireAndKeepLock(const int64_t usec_wait ) {
+		timespec ts;
+		return acquireAndKeepLock( usecToAbstime(usec_wait, &ts) );
+	}
+
+	void lockSemaOnly() {
+		localMutex.acquire();
+	}
+
+	void releaseSemaLock() {
+		localMutex.release();
+	}
+
+	int waitForAcquirers(bool lock = true) {
+		if(lock)
+			localMutex.acquire();
+		int ret = waitDecrement(NULL);
+		localMutex.release();
+		return ret;
+	}
+
+	int waitForAcquirers(const struct timespec *abstime, bool lock = true) {
+		if(lock)
+			localMutex.acquire();
+		int ret = waitDecrement(abstime);
+		localMutex.release();
+		return ret;
+	}
+
+	int waitForAcquirers(const int64_t usec_wait, bool lock = true ) {
+		timespec ts;
+		return waitForAcquirers( usecToAbstime(usec_wait, &ts), lock );
+	}
+
+	int waitForAcquirersKeepLock(bool lock = true) {
+		if(lock)
+			localMutex.acquire();
+		return waitDecrement(NULL);
+	}
+
+	int waitForAcquirersKeepLock(const struct timespec *abstime, bool lock = true) {
+		if(lock)
+			localMutex.acquire();
+		return waitDecrement(abstime);
+	}
+
+	int waitForAcquirersKeepLock(const int64_t usec_wait, bool lock = true ) {
+		timespec ts;
+		return waitForAcquirersKeepLock( usecToAbstime(usec_wait, &ts), lock );
+	}
+
+	int waitForDecrementKeepLock(const struct timespec *abstime, bool lock = true) {
+		if(lock)
+			localMutex.acquire();
+		return decrementCond.wait( localMutex, abstime );
+	}
+
+	int waitForDecrementKeepLock( const int64_t usec_wait, bool lock = true ) {
+		timespec ts;
+		return waitForDecrementKeepLock( usecToAbstime(usec_wait, &ts), lock );
+	}
+
+	/**
+	 * Increments the counter, and alerts anyone waiting.
+	 * @return
+	 */
+	int release() {
+		localMutex.acquire();
+		cnt.fetch_add(1, std::memory_order_relaxed);
+		int ret = gtZeroCond.signal();
+		localMutex.release();
+		return ret;
+	}
+
+	int releaseManyWithoutLock(int n) {
+		if(n < 1) return 0;
+		cnt.fetch_add(n, std::memory_order_relaxed);
+		if(n > 1)
+			return gtZeroCond.broadcast();
+		else
+			return gtZeroCond.signal();
+	}
+
+	int releaseWithoutLock() {
+		cnt.fetch_add(1, std::memory_order_relaxed);
+		return gtZeroCond.signal();
+	}
+
+	int releaseAndKeepLock() {
+		localMutex.acquire();
+		cnt.fetch_add(1, std::memory_order_relaxed);
+		return gtZeroCond.signal();
+	}
+
+	/**
+	 * Releases all blocking calls on the sema. It's *not safe* to use the sema after this
+	 * as the value of the sema is uknown.
+	 * @return
+	 */
+	int releaseAll() {
+		localMutex.acquire();
+		cnt.fetch_add(1, std::memory_order_relaxed);
+		decrementCond.broadcast();
+		int ret = gtZeroCond.broadcast();
+		localMutex.release();
+		return ret;
+	}
+
+	void releaseAllAcquireLocks() {
+		localMutex.acquire();
+		decrementCond.broadcast();
+		localMutex.release();
+	}
+
+	/**
+	 * returns the current count (value) on the semaphore
+	 * @return
+	 */
+	int count() {
+		return cnt.load(std::memory_order_acquire);
+	}
+
+	int countNoBlock() {
+		return cnt.load(std::memory_order_relaxed);
+	}
+
+	~TW_FutexSemaTwoWay() {
+		localMutex.acquire();
+		gtZeroCond.broadcast();
+		decrementCond.broadcast();
+		localMutex.release();
+	}
+};
+
+#endif // __linux__
+
 } // end namespace
 
 #endif /* TW_SEMA2_H_ */
@@ -0,0 +1,233 @@
+/*
+ * tw_shardedhash.h
+ *
+ *  A lock striped hash map: N independent TW_KHash_32 shards, each w/ its own lock.
+ */
+
+#ifndef TW_SHARDEDHASH_H_
+#define TW_SHARDEDHASH_H_
+
+#include <stdint.h>
+
+#include <new>
+#include <type_traits>
+
+#include <TW/tw_defs.h>
+#include <TW/tw_alloc.h>
+#include <TW/tw_khash.h>
+
+namespace TWlib {
+
+/**
+ TW_ShardedHash has the same template parameters and method names as TW_KHash_32, for tables shared by
+ many threads. Each key maps to one of N shards (N is a power of 2, fixed at construction), and every
+ shard is a TW_KHash_32 w/ its own MUTEX - so threads working on different shards never wait on each
+ other, where a single TW_KHash_32 serializes every call on one lock. Each shard is padded out to its own
+ cache lines, so the locks do not false share.
+
+ A rule of thumb is 2 - 4 shards per thread using the table.
+
+ The shard is picked w/ the top bits of a multiplicative hash of tw_hash<KEY *>, so the keys in one
+ shard still spread over all of its buckets.
+
+ size() and removeAll() go shard by shard - they are not atomic w/ respect to other threads.
+ The HashIterator visits the shards in order. Like TW_KHash_32's it holds no lock while iterating.
+ If ALLOC could not give the shards memory, shards() is 0 and adds / finds / removes all fail.
+*/
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+class TW_ShardedHash {
+	public:
+		typedef TW_KHash_32<KEY,DATA,MUTEX,EQFUNC,ALLOC> Shard;
+
+		// 'shards' is rounded up to a power of 2. 'items' is a size hint for the whole table.
+		TW_ShardedHash(int shards, ALLOC *alloc = NULL, int items=0);
+		~TW_ShardedHash();
+		bool addReplace( const KEY& key, DATA& dat ) { Shard *s = shardFor(key); return s && s->addReplace(key, dat); }
+		bool addReplace( const KEY& key, DATA& dat, DATA& olddat ) { Shard *s = shardFor(key); return s && s->addReplace(key, dat, olddat); }
+		bool addNoreplace( const KEY& key, DATA& dat ) { Shard *s = shardFor(key); return s && s->addNoreplace(key, dat); }
+		DATA *addReplaceNew( const KEY& key ) { Shard *s = shardFor(key); return s ? s->addReplaceNew(key) : NULL; }
+		DATA *addNoreplaceNew( const KEY& key ) { Shard *s = shardFor(key); return s ? s->addNoreplaceNew(key) : NULL; }
+		bool remove( const KEY& key ) { Shard *s = shardFor(key); return s && s->remove(key); }
+		bool remove( const KEY& key, DATA& fill ) { Shard *s = shardFor(key); return s && s->remove(key, fill); }
+		bool find( const KEY& key, DATA& fill ) { Shard *s = shardFor(key); return s && s->find(key, fill); }
+		DATA *find( const KEY& key ) { Shard *s = shardFor(key); return s ? s->find(key) : NULL; }
+		DATA *findOrNew( const KEY& key ) { Shard *s = shardFor(key); return s ? s->findOrNew(key) : NULL; }
+		bool removeAll();
+		int size();
+
+		int shards() { return (int) _count; }
+		Shard &shard( int n ) { return _shards[n].map; }
+		int shardIndex( const KEY& key ) { return _count ? (int) indexOf(key) : -1; }
+		ALLOC *getAllocator() { return _alloc; }
+
+		class HashIterator {
+		public:
+			HashIterator(TW_ShardedHash &map);
+			~HashIterator();
+			KEY *key();
+			DATA *data();
+			void setData(DATA *);
+			bool getNext();
+			bool atEnd();
+			void release();
+		protected:
+			void openShard( uint32_t n );
+			void closeShard();
+			bool skipEmpty();
+			typedef typename Shard::HashIterator ShardIter;
+			typename std::aligned_storage<sizeof(ShardIter), alignof(ShardIter)>::type _store; // a ShardIter, on the current shard
+			ShardIter *_it;
+			uint32_t _shard;
+			TW_ShardedHash &_map;
+		};
+
+	protected:
+		// a shard, padded so no two shards' locks (or anything else) share a cache line
+		struct PaddedShard {
+			Shard map;
+			char _pad[TW_CACHE_LINE_SIZE - (sizeof(Shard) % TW_CACHE_LINE_SIZE)];
+			PaddedShard(ALLOC *alloc, int items) : map(alloc, items) { }
+		};
+
+		inline uint32_t indexOf( const KEY &key ) {
+			TWlib::tw_hash<KEY *> hash;
+			uint64_t full = (uint64_t) hash.operator ()(const_cast<KEY *>(&key)); // size_t may be 64 bits
+			uint32_t h = (uint32_t) full ^ (uint32_t) (full >> 32);
+			return _shift < 32 ? (h * 2654435769U) >> _shift : 0; // Fibonacci hashing - the top bits
+		}
+		// NULL if the shards could not be allocated - then every call fails, like an out of memory TW_KHash_32
+		inline Shard *shardFor( const KEY &key ) { return _count ? &_shards[indexOf(key)].map : NULL; }
+
+		void *_mem;             // what ALLOC gave us - _shards is aligned inside of it
+		PaddedShard *_shards;
+		uint32_t _count;        // a power of 2
+		uint32_t _shift;        // 32 - log2(_count)
+		ALLOC *_alloc;
+};
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::TW_ShardedHash( int shards, ALLOC *alloc, int items ) :
+_mem( NULL ), _shards( NULL ), _count( 1 ), _shift( 32 ), _alloc( alloc )
+{
+	if(!_alloc)
+		_alloc = ALLOC::getInstance();
+	while((int) _count < shards) {
+		_count <<= 1;
+		_shift--;
+	}
+	_mem = ALLOC::malloc(_count * sizeof(PaddedShard) + TW_CACHE_LINE_SIZE);
+	if(!_mem) {
+		TW_PALLOC_ERROR( TW_ALLOC_ERROR_MSG_NO_MEM, __FILE__, __LINE__ );
+		_count = 0;
+		return;
+	}
+	_shards = (PaddedShard *) (((uintptr_t) _mem + TW_CACHE_LINE_SIZE - 1) & ~((uintptr_t) TW_CACHE_LINE_SIZE - 1));
+	int per = (items > 0) ? (int) ((items + _count - 1) / _count) : 0;
+	for(uint32_t n=0;n<_count;n++)
+		::new((void*)&_shards[n]) PaddedShard(alloc, per);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::~TW_ShardedHash() {
+	for(uint32_t n=0;n<_count;n++)
+		_shards[n].~PaddedShard();
+	ALLOC::free(_mem);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::removeAll() {
+	for(uint32_t n=0;n<_count;n++)
+		_shards[n].map.removeAll();
+	return true;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+int TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::size() {
+	int ret = 0;
+	for(uint32_t n=0;n<_count;n++)
+		ret += _shards[n].map.size();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::HashIterator(TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC> &map) :
+_it( NULL ), _shard( 0 ), _map( map ) {
+	if(_map._count) {
+		openShard(0);
+		skipEmpty();
+	}
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::~HashIterator() {
+	closeShard();
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::openShard( uint32_t n ) {
+	_shard = n;
+	_it = ::new((void*)&_store) ShardIter(_map._shards[n].map);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::closeShard() {
+	if(_it) {
+		_it->release();
+		_it->~ShardIter();
+		_it = NULL;
+	}
+}
+
+// moves on to the next shard w/ anything in it, if the current one is used up. false if at the end
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::skipEmpty() {
+	while(_it && _it->atEnd()) {
+		uint32_t next = _shard + 1;
+		closeShard();
+		if(next >= _map._count)
+			return false;
+		openShard(next);
+	}
+	return _it != NULL;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+KEY *TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::key() {
+	return _it ? _it->key() : NULL;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::data() {
+	return _it ? _it->data() : NULL;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::setData(DATA *d) {
+	if(_it)
+		_it->setData(d);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::getNext() {
+	if(!_it)
+		return false;
+	_it->getNext();
+	return skipEmpty();
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::atEnd() {
+	return _it == NULL;
+}
+
+/**
+ * done w/ the iterator - it is at the end after this. (The destructor does this also.)
+ */
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_ShardedHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::release() {
+	closeShard();
+}
+
+} // end namespace
+
+#endif /* TW_SHARDEDHASH_H_ */
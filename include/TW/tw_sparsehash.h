@@ -9,6 +9,7 @@
 #define TW_SPARSEHASH_H_
 
 
+#include <string.h> // sparsetable uses memset() w/o including it
 #include <google/sparse_hash_map>
 
 #include <TW/tw_alloc.h>
@@ -227,7 +228,7 @@ bool TWSparseHash<KEY, DATA, MUTEX, EQFUNC,ALLOC>::removeAll() {
 		if(k) // ...now delete key
 			TW_DELETE_WALLOC( k, KEY, this->_alloc);
 
-		it = values.begin();
+		++it; // erase() leaves iterators valid - starting over at begin() each time was O(n^2)
 	}
 	values.resize(0);
 	//  printf("rec count %d\n",values.size());
@@ -306,7 +307,7 @@ DATA *TWSparseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addReplaceNew( KEY& key ) {
 //	bool iamempty = false;
 	_lock.acquire();
 	TW_NEW_WALLOC(v, DATA, DATA(), this->_alloc);
-	if(!v) return false;
+	if(!v) return NULL;
 //--	ACE_NEW_MALLOC_RETURN
 //--			(v,	(reinterpret_cast<DATA *>
 //--				(this->_alloc->malloc (sizeof (DATA)))),
@@ -318,7 +319,7 @@ DATA *TWSparseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addReplaceNew( KEY& key ) {
 		it = values.find(&key);
 	if (it == values.end()) {
 		TW_NEW_WALLOC(k, KEY, KEY(key), this->_alloc);
-		if(!k) return false;
+		if(!k) return NULL;
 //--		ACE_NEW_MALLOC_RETURN
 //--		(k,	(reinterpret_cast<KEY *>
 //--			(this->_alloc->malloc (sizeof (KEY)))),
@@ -345,7 +346,7 @@ DATA *TWSparseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addNoreplaceNew( KEY& key ) {
 	it = values.find(&key);
 	if(it == values.end()) {
 		TW_NEW_WALLOC(v, DATA, DATA(), this->_alloc);
-		if(!v) return false;
+		if(!v) return NULL;
 //--	ACE_NEW_MALLOC_RETURN
 //--			(v,	(reinterpret_cast<DATA *>
 //--				(this->_alloc->malloc (sizeof (DATA)))),
@@ -355,7 +356,7 @@ DATA *TWSparseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addNoreplaceNew( KEY& key ) {
 //	else
 //	if (it == values.end()) {
 		TW_NEW_WALLOC(k, KEY, KEY(key), this->_alloc);
-		if(!k) return false;
+		if(!k) return NULL;
 //--		ACE_NEW_MALLOC_RETURN
 //--		(k,	(reinterpret_cast<KEY *>
 //--			(this->_alloc->malloc (sizeof (KEY)))),
@@ -382,7 +383,7 @@ DATA *TWSparseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::findOrNew( KEY& key ) {
 	it = values.find(&key);
 	if(it == values.end()) {
 		TW_NEW_WALLOC(v, DATA, DATA(), this->_alloc);
-		if(!v) return false;
+		if(!v) return NULL;
 //--	ACE_NEW_MALLOC_RETURN
 //--			(v,	(reinterpret_cast<DATA *>
 //--				(this->_alloc->malloc (sizeof (DATA)))),
@@ -392,7 +393,7 @@ DATA *TWSparseHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::findOrNew( KEY& key ) {
 //	else
 //	if (it == values.end()) {
 		TW_NEW_WALLOC(k, KEY, KEY(key), this->_alloc);
-		if(!k) return false;
+		if(!k) return NULL;
 
 //--		ACE_NEW_MALLOC_RETURN
 //--		(k,	(reinterpret_cast<KEY *>
@@ -0,0 +1,578 @@
+/*
+ * tw_swisshash.h
+ *
+ *  An open addressing hash table w/ a control byte per bucket, probed 16 buckets at a time
+ *  (the "Swiss table" design).
+ */
+
+#ifndef TW_SWISSHASH_H_
+#define TW_SWISSHASH_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_hashes.h>
+#include <TW/tw_hashcommon.h>
+
+#include <new>
+#include <utility>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ TW_SwissHash has the same template parameters and method names as TW_KHash_32.
+
+ Each bucket has a control byte: empty, deleted, or the low 7 bits of the key's hash. A lookup loads the
+ control bytes of 16 buckets at once and compares all of them against the 7 bit fragment (SSE2, or
+ 8 bytes at a time in 64 bit words on other targets - e.g. the armel build). Only buckets whose fragment
+ matches are compared by key, and a group w/ an empty byte ends the search - so a miss usually costs one
+ 16 byte load.
+
+ KEY and DATA live in the bucket array itself (like TW_KHash_32_Inline): a DATA * from find() etc.
+ is only good until the next add or remove.
+
+ KEY: specialize TWlib::tw_hash<KEY *> as for TW_KHash_32. Any width of hash is fine - it is mixed here.
+*/
+
+#define TW_SWISS_GROUP 16
+
+namespace TWlib {
+
+// control bytes
+#define TW_SWISS_EMPTY ((int8_t) -128)   // 0x80
+#define TW_SWISS_DELETED ((int8_t) -2)   // 0xFE
+// full buckets hold 0..127. Both empty and deleted have the top bit set.
+
+/**
+ * 16 control bytes, and the matching done on them. The masks have bit n set for byte n.
+ */
+struct tw_swiss_group {
+#if defined(__SSE2__)
+	__m128i ctrl;
+	tw_swiss_group( const int8_t *p ) : ctrl( _mm_loadu_si128((const __m128i *) p) ) { }
+	uint32_t match( int8_t h2 ) const {
+		return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+	}
+	uint32_t matchEmpty() const {
+		return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(TW_SWISS_EMPTY)));
+	}
+	uint32_t matchEmptyOrDeleted() const {
+		return (uint32_t) _mm_movemask_epi8(ctrl); // the top bits
+	}
+#else
+	// no SSE2: two 64 bit words, 8 control bytes at a time
+	uint64_t lo, hi;
+	static inline uint64_t load( const int8_t *p ) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+		w = __builtin_bswap64(w);  // so byte n is always bits 8n..8n+7
+#endif
+		return w;
+	}
+	// the top bit of each byte of 'w' -> bit n for byte n
+	static inline uint32_t pack( uint64_t w ) {
+		return (uint32_t) ((((w & 0x8080808080808080ULL) >> 7) * 0x0102040810204080ULL) >> 56);
+	}
+	// may also set a few bits above a real match - fine, as every hit is compared by key anyway
+	static inline uint64_t matchWord( uint64_t w, int8_t h2 ) {
+		uint64_t x = w ^ (0x0101010101010101ULL * (uint8_t) h2);
+		return (x - 0x0101010101010101ULL) & ~x;
+	}
+	// exact: empty (0x80) is the only control byte w/ the top bit set and bit 1 clear
+	static inline uint64_t emptyWord( uint64_t w ) { return w & (~w << 6); }
+	tw_swiss_group( const int8_t *p ) : lo( load(p) ), hi( load(p + 8) ) { }
+	uint32_t match( int8_t h2 ) const {
+		return pack(matchWord(lo, h2)) | (pack(matchWord(hi, h2)) << 8);
+	}
+	uint32_t matchEmpty() const {
+		return pack(emptyWord(lo)) | (pack(emptyWord(hi)) << 8);
+	}
+	uint32_t matchEmptyOrDeleted() const {
+		return pack(lo) | (pack(hi) << 8);
+	}
+#endif
+};
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+class TW_SwissHash {
+	public:
+		// this constructor availble for drop in compatibility with TWDensehash
+		TW_SwissHash(KEY &deletekey, KEY &emptykey, ALLOC *alloc = NULL, int items=0);
+		// normal constructor
+		TW_SwissHash(ALLOC *alloc = NULL, int items=0);
+		~TW_SwissHash();
+		bool addReplace( const KEY& key, DATA& dat );
+		bool addReplace( const KEY& key, DATA& dat, DATA& olddat );
+		bool addNoreplace( const KEY& key, DATA& dat );
+		DATA *addReplaceNew( const KEY& key );
+		DATA *addNoreplaceNew( const KEY& key );
+		bool remove( const KEY& key );
+		bool remove( const KEY& key, DATA& fill );
+		bool find( const KEY& key, DATA& fill );
+		DATA *find( const KEY& key );
+		DATA *findOrNew( const KEY& key );
+		bool removeAll();
+		int size();
+		int buckets() { return (int) _capacity; }
+
+		void releaseIter();
+		ALLOC *getAllocator() { return _alloc; }
+
+		class HashIterator {
+		public:
+			HashIterator(TW_SwissHash &map);
+			KEY *key();
+			DATA *data();
+			void setData(DATA *);  // copies *d into the bucket
+			bool getNext();
+			bool atEnd();
+			void release();
+			friend class TW_SwissHash;
+		protected:
+			uint32_t _iter;
+			TW_SwissHash &_map;
+		};
+
+	protected:
+		// a bucket. Only constructed (key and val, w/ placement new) when its control byte is full
+		struct Slot {
+			KEY key;
+			DATA val;
+		};
+
+		void init(ALLOC *alloc, int items);
+		static inline uint64_t hashKey( const KEY &key ) {
+			TWlib::tw_hash<KEY *> hash;
+			uint64_t h = (uint64_t) hash.operator ()(const_cast<KEY *>(&key));
+			// mix, so the 7 bit fragment and the bucket index both get good bits from any tw_hash
+			h ^= h >> 33;
+			h *= 0xFF51AFD7ED558CCDULL;
+			h ^= h >> 33;
+			return h;
+		}
+		static inline int8_t h2( uint64_t h ) { return (int8_t) (h & 0x7F); }
+		static inline uint32_t h1( uint64_t h ) { return (uint32_t) (h >> 7); }
+		static inline bool keyEqual( const KEY &l, const KEY &r ) {
+			EQFUNC eq;
+			return eq.operator ()(&l,&r);
+		}
+		template<typename T> static void relocate( T *dst, T &src, std::true_type ) { new (dst) T(std::move(src)); }
+		template<typename T> static void relocate( T *dst, T &src, std::false_type ) { new (dst) T(src); }
+		template<typename T> static void relocate( T *dst, T &src ) {
+			relocate(dst, src, typename std::is_constructible<T, T&&>::type());
+			src.~T();
+		}
+		static inline int lowestBit( uint32_t m ) { return __builtin_ctz(m); }
+		void setCtrl( uint32_t i, int8_t c );
+		uint32_t getSlot( const KEY &key );
+		uint32_t findFree( uint64_t hash );
+		uint32_t putSlot( const KEY &key, int *ret );
+		void delSlot( uint32_t i );
+		void resize( uint32_t new_capacity );
+
+		friend class HashIterator;
+		void gotoStart(HashIterator &i);
+
+		int8_t *_ctrl;        // _capacity + TW_SWISS_GROUP bytes. The last group mirrors the first, so a group can be loaded at any bucket
+		Slot *_slots;
+		uint32_t _capacity;   // a power of 2, or 0
+		uint32_t _size;
+		uint32_t _growth_left; // empty buckets we can still fill before resizing (keeps the load <= 7/8)
+		int _iterators_out;
+		ALLOC *_alloc;
+		MUTEX _lock;
+};
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::TW_SwissHash( KEY &deletekey, KEY &emptykey, ALLOC *alloc, int items ) :
+_ctrl( NULL ), _slots( NULL ), _capacity( 0 ), _size( 0 ), _growth_left( 0 ), _iterators_out( 0 ), _lock()
+{
+	init(alloc,items);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::TW_SwissHash( ALLOC *alloc, int items ) :
+_ctrl( NULL ), _slots( NULL ), _capacity( 0 ), _size( 0 ), _growth_left( 0 ), _iterators_out( 0 ), _lock()
+{
+	init(alloc,items);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::init(ALLOC *alloc, int items) {
+	if(!alloc)
+		_alloc = ALLOC::getInstance();
+	else
+		_alloc = alloc;
+	if(items > 0)
+		resize((uint32_t) items + (uint32_t) items / 7 + 1);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::~TW_SwissHash() {
+	removeAll();
+	ALLOC::free(_ctrl);
+	ALLOC::free(_slots);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+inline void TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::setCtrl( uint32_t i, int8_t c ) {
+	_ctrl[i] = c;
+	if(i < TW_SWISS_GROUP)
+		_ctrl[_capacity + i] = c; // the mirror
+}
+
+// the bucket 'key' is in, or _capacity if it is not there
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+uint32_t TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::getSlot( const KEY &key ) {
+	if(!_capacity)
+		return 0;
+	uint64_t h = hashKey(key);
+	int8_t frag = h2(h);
+	uint32_t mask = _capacity - 1;
+	uint32_t pos = h1(h) & mask;
+	uint32_t step = 0;
+	while(1) {
+		tw_swiss_group g(_ctrl + pos);
+		uint32_t m = g.match(frag);
+		while(m) {
+			uint32_t i = (pos + lowestBit(m)) & mask;
+			if(keyEqual(_slots[i].key, key))
+				return i;
+			m &= m - 1;
+		}
+		if(g.matchEmpty())
+			return _capacity;
+		step += TW_SWISS_GROUP; // triangular probing over groups - visits every group of a power of 2 table
+		pos = (pos + step) & mask;
+	}
+}
+
+// the first empty or deleted bucket on the probe sequence of 'hash'. There always is one.
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+uint32_t TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::findFree( uint64_t hash ) {
+	uint32_t mask = _capacity - 1;
+	uint32_t pos = h1(hash) & mask;
+	uint32_t step = 0;
+	while(1) {
+		uint32_t m = tw_swiss_group(_ctrl + pos).matchEmptyOrDeleted();
+		if(m)
+			return (pos + lowestBit(m)) & mask;
+		step += TW_SWISS_GROUP;
+		pos = (pos + step) & mask;
+	}
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::resize( uint32_t new_capacity ) {
+	uint32_t c = TW_SWISS_GROUP;
+	while(c < new_capacity) c <<= 1;
+	if(_size > c - c / 8) return; /* requested size is too small */
+	__TW_HASH_DEBUGL(" -- Rehash: %d\n", c);
+	int8_t *new_ctrl = (int8_t *) ALLOC::malloc(c + TW_SWISS_GROUP);
+	Slot *new_slots = (Slot *) ALLOC::malloc(c * sizeof(Slot));
+	if(!new_ctrl || !new_slots) {
+		TW_PALLOC_ERROR( TW_ALLOC_ERROR_MSG_NO_MEM, __FILE__, __LINE__ );
+		ALLOC::free(new_ctrl);
+		ALLOC::free(new_slots);
+		return;
+	}
+	ALLOC::memset(new_ctrl, TW_SWISS_EMPTY, c + TW_SWISS_GROUP);
+	int8_t *old_ctrl = _ctrl;
+	Slot *old_slots = _slots;
+	uint32_t old_capacity = _capacity;
+	_ctrl = new_ctrl;
+	_slots = new_slots;
+	_capacity = c;
+	for(uint32_t j=0;j<old_capacity;j++) {
+		if(old_ctrl[j] >= 0) {
+			uint64_t h = hashKey(old_slots[j].key);
+			uint32_t i = findFree(h);
+			setCtrl(i, h2(h));
+			relocate(&(_slots[i].key), old_slots[j].key);
+			relocate(&(_slots[i].val), old_slots[j].val);
+		}
+	}
+	ALLOC::free(old_ctrl);
+	ALLOC::free(old_slots);
+	_growth_left = (c - c / 8) - _size;
+}
+
+// finds or makes the bucket for 'key'. If it is new (*ret != 0) the key is constructed, the val is not.
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+uint32_t TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::putSlot( const KEY &key, int *ret ) {
+	uint32_t i = getSlot(key);
+	if(i != _capacity) {
+		*ret = 0; /* present */
+		return i;
+	}
+	uint64_t h = hashKey(key);
+	if(!_capacity)
+		resize(TW_SWISS_GROUP);
+	i = findFree(h);
+	if(_growth_left == 0 && _ctrl[i] == TW_SWISS_EMPTY) { // no room - a deleted bucket could still be reused
+		if(_size < (_capacity - _capacity / 8) / 2)
+			resize(_capacity); // mostly deleted buckets - just clean them out
+		else
+			resize(_capacity * 2);
+		i = findFree(h);
+	}
+	if(_ctrl[i] == TW_SWISS_EMPTY) {
+		_growth_left--;
+		*ret = 1;
+	} else
+		*ret = 2; /* was deleted */
+	setCtrl(i, h2(h));
+	new (&(_slots[i].key)) KEY(key);
+	_size++;
+	return i;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::delSlot( uint32_t i ) {
+	_slots[i].key.~KEY();
+	_slots[i].val.~DATA();
+	_size--;
+	// If there is an empty bucket close enough on both sides, no group load could have seen 16 full
+	// buckets in a row through here - so no probe ever went on past it, and it can go back to empty.
+	uint32_t mask = _capacity - 1;
+	uint32_t before = tw_swiss_group(_ctrl + ((i - TW_SWISS_GROUP) & mask)).matchEmpty();
+	uint32_t after = tw_swiss_group(_ctrl + i).matchEmpty();
+	int emptyAfter = after ? __builtin_ctz(after) : TW_SWISS_GROUP;
+	int emptyBefore = before ? __builtin_clz(before) - (32 - TW_SWISS_GROUP) : TW_SWISS_GROUP;
+	if(emptyBefore + emptyAfter < TW_SWISS_GROUP) {
+		setCtrl(i, TW_SWISS_EMPTY);
+		_growth_left++;
+	} else
+		setCtrl(i, TW_SWISS_DELETED);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::removeAll() {
+	_lock.acquire();
+	int c = 0;
+	for(uint32_t i=0;i<_capacity;i++)
+		if(_ctrl[i] >= 0) {
+			_slots[i].key.~KEY();
+			_slots[i].val.~DATA();
+			c++;
+		}
+	if(_ctrl)
+		ALLOC::memset(_ctrl, TW_SWISS_EMPTY, _capacity + TW_SWISS_GROUP);
+	_size = 0;
+	_growth_left = _capacity - _capacity / 8;
+	_lock.release();
+	__TW_HASH_DEBUG("deleted: %d records\n", c );
+	return true;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+int TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::size() {
+	return (int) _size;
+}
+
+// replace the data if it exists.
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addReplace( const KEY& key, DATA& dat, DATA& oldref ) {
+	_lock.acquire();
+	int r;
+	uint32_t k = putSlot(key, &r);
+	if(!r) { // have this key
+		oldref = _slots[k].val;
+		_slots[k].val.~DATA(); // out w/ the old, in with the new
+	}
+	new (&(_slots[k].val)) DATA(dat);
+	_lock.release();
+	return true;
+}
+
+// replace the data if it exists.
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addReplace( const KEY& key, DATA& dat ) {
+	_lock.acquire();
+	int r;
+	uint32_t k = putSlot(key, &r);
+	if(!r)
+		_slots[k].val.~DATA();
+	new (&(_slots[k].val)) DATA(dat);
+	_lock.release();
+	return true;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addReplaceNew( const KEY& key ) {
+	_lock.acquire();
+	int r;
+	uint32_t k = putSlot(key, &r);
+	if(!r)
+		_slots[k].val.~DATA();
+	DATA *ret = new (&(_slots[k].val)) DATA();
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addNoreplaceNew( const KEY& key ) {
+	DATA *ret = NULL;
+	_lock.acquire();
+	int r;
+	uint32_t k = putSlot(key, &r);
+	if(r)
+		ret = new (&(_slots[k].val)) DATA();
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::findOrNew( const KEY& key ) {
+	_lock.acquire();
+	int r;
+	uint32_t k = putSlot(key, &r);
+	if(r)
+		new (&(_slots[k].val)) DATA();
+	DATA *ret = &(_slots[k].val);
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::addNoreplace( const KEY& key, DATA& dat ) {
+	bool ret = false;
+	_lock.acquire();
+	int r;
+	uint32_t k = putSlot(key, &r);
+	if(r) {
+		new (&(_slots[k].val)) DATA(dat);
+		ret = true;
+	}
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::remove( const KEY& key, DATA& fill ) {
+	bool ret = false;
+	_lock.acquire();
+	uint32_t k = getSlot(key);
+	if(k != _capacity) {
+		fill = _slots[k].val;
+		delSlot(k);
+		ret = true;
+	}
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::remove( const KEY& key ) {
+	bool ret = false;
+	_lock.acquire();
+	uint32_t k = getSlot(key);
+	if(k != _capacity) {
+		delSlot(k);
+		ret = true;
+	}
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( const KEY& key, DATA& fill ) {
+	bool ret = false;
+	_lock.acquire();
+	uint32_t k = getSlot(key);
+	if(k != _capacity) {
+		fill = _slots[k].val; // uses DATA::operator=()
+		ret = true;
+	}
+	_lock.release();
+	return ret;
+}
+
+/**
+ * @return a pointer to the value in the table (good until the next add / remove), or NULL
+ */
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::find( const KEY& key ) {
+	DATA *ret = NULL;
+	_lock.acquire();
+	uint32_t k = getSlot(key);
+	if(k != _capacity)
+		ret = &(_slots[k].val);
+	_lock.release();
+	return ret;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::gotoStart(HashIterator &i) {
+	_lock.acquire();
+	_iterators_out++;
+	i._iter = 0;
+	while(i._iter < _capacity && _ctrl[i._iter] < 0) // skip empty buckets
+		i._iter++;
+	_lock.release();
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::releaseIter() {
+	_lock.acquire();
+	if(_iterators_out > 0)
+		_iterators_out--;
+	_lock.release();
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::HashIterator(TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC> &map) :
+_iter( 0 ), _map( map ) {
+	_map.gotoStart(*this);
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+KEY *TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::key() {
+	if(_iter < _map._capacity)
+		return &(_map._slots[_iter].key);
+	else
+		return NULL;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+DATA *TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::data() {
+	if(_iter < _map._capacity)
+		return &(_map._slots[_iter].val);
+	else
+		return NULL;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::setData(DATA *d) {
+	if(_iter < _map._capacity && d)
+		_map._slots[_iter].val = *d;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::getNext() {
+	if(_iter >= _map._capacity)
+		return false;
+	_iter++;
+	while(_iter < _map._capacity && _map._ctrl[_iter] < 0)
+		_iter++;
+	return _iter < _map._capacity;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+bool TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::atEnd() {
+	return _iter >= _map._capacity;
+}
+
+template<typename KEY, typename DATA, typename MUTEX, typename EQFUNC, typename ALLOC>
+void TW_SwissHash<KEY,DATA,MUTEX,EQFUNC,ALLOC>::HashIterator::release() {
+	_map.releaseIter();
+}
+
+} // end namespace
+
+#endif /* TW_SWISSHASH_H_ */
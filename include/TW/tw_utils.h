@@ -45,6 +45,8 @@ struct timespec *timeval_to_timespec(struct timeval *tv, struct timespec *ts);
 char *convInt( char *out, int val, size_t max );
 char *convIntHex( char *out, unsigned int val, size_t max );
 string &hexDumpToString(char *head, int size, string &out);
+char *tw_hex_encode( char *out, const void *in, int len );
+char *tw_hex_encode_sep( char *out, const void *in, int len, char sep = ',' );
 string &string_printf(string &fillme, const char *fmt, ... );
 
 uint32_t data_hash_Hsieh (const char * data, int len);
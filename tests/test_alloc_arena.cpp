@@ -0,0 +1,132 @@
+// test_alloc_arena.cpp
+// Tests Alloc_Arena - builds request sized containers in an arena, then throws them away with reset(),
+// and compares against building / deleting the same containers with Alloc_Std.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <string.h>
+#include <assert.h>
+
+#include <TW/tw_utils.h>
+#include <TW/tw_alloc.h>
+#include <TW/tw_alloc_arena.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_array.h>
+#include <TW/tw_khash.h>
+
+#define REQUESTS 200
+#define ITEMS 5000
+
+using namespace TWlib;
+
+namespace TWlib {
+	template<>
+	struct tw_hash<int *> {
+		inline size_t operator()(const int *v) const {
+			return (size_t) *v;
+		}
+	};
+}
+
+struct val {
+	int x;
+	char pad[40];
+	val() : x(0) {}
+	val(val &o) : x(o.x) {}
+	val &operator=(const val &o) { x = o.x; return *this; }
+};
+
+typedef Allocator<Alloc_Std> StdAlloc;
+typedef Allocator<Alloc_Arena> ArenaAlloc;
+
+// one 'request' worth of work
+template <class ALLOC>
+void request() {
+	TW_KHash_32<int, val, TW_NoMutex, eqstr_numericP<int>, ALLOC> table;
+	DynArray<int, ALLOC> arr;
+	val v;
+	for(int n=0;n<ITEMS;n++) {
+		v.x = n;
+		table.addReplace(n, v);
+	}
+	arr.resize(ITEMS);
+	for(int n=0;n<ITEMS;n++)
+		arr.put(n, n);
+	val *f = table.find(ITEMS/2);
+	assert(f && f->x == ITEMS/2);
+}
+
+double elapsed(struct timeval &start) {
+	struct timeval end;
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec);
+}
+
+int main()
+{
+	// no current arena - nothing to allocate from
+	assert(Alloc_Arena::current() == NULL);
+	assert(ArenaAlloc::malloc(10) == NULL);
+
+	Alloc_Arena arena(4096);
+	{
+		Alloc_Arena::Scope s(arena);
+		assert(Alloc_Arena::current() == &arena);
+		char *a = (char *) ArenaAlloc::malloc(10);
+		char *b = (char *) ArenaAlloc::malloc(10);
+		assert(a && b && a != b);
+		assert(((uintptr_t) a % TW_ARENA_ALIGN) == 0);
+		assert(((uintptr_t) b % TW_ARENA_ALIGN) == 0);
+		memset(b, 'b', 10);
+		// the last allocation grows in place
+		assert(ArenaAlloc::realloc(b, 100) == b);
+		// anything else is copied
+		memset(a, 'a', 10);
+		char *a2 = (char *) ArenaAlloc::realloc(a, 50);
+		assert(a2 != a);
+		for(int n=0;n<10;n++) assert(a2[n] == 'a');
+		ArenaAlloc::free(a2); // no-op
+		// bigger than the chunk size - gets its own chunk
+		char *big = (char *) ArenaAlloc::malloc(5000);
+		assert(big);
+		memset(big, 0, 5000);
+		int *z = (int *) ArenaAlloc::calloc(10, sizeof(int));
+		for(int n=0;n<10;n++) assert(z[n] == 0);
+		assert(arena.chunks() == 2);
+
+		// the instance path, through Allocator<>
+		ArenaAlloc alloc;
+		void *p;
+		TW_NEW_WALLOC(p, val, val(), (&alloc));
+		assert(p);
+	}
+	assert(Alloc_Arena::current() == NULL);
+	assert(arena.bytesUsed() > 0);
+	arena.reset();
+	assert(arena.bytesUsed() == 0);
+	assert(arena.chunks() == 1);
+
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	for(int r=0;r<REQUESTS;r++)
+		request<StdAlloc>();
+	double s = elapsed(start);
+
+	Alloc_Arena reqArena;
+	gettimeofday(&start, NULL);
+	for(int r=0;r<REQUESTS;r++) {
+		{
+			Alloc_Arena::Scope scope(reqArena);
+			request<ArenaAlloc>();
+		}
+		reqArena.reset();
+	}
+	double a = elapsed(start);
+	printf("%d requests w/ Alloc_Std:   %0.1f usec/request\n", REQUESTS, s / REQUESTS);
+	printf("%d requests w/ Alloc_Arena: %0.1f usec/request\n", REQUESTS, a / REQUESTS);
+
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,169 @@
+// test_alloc_magazine.cpp
+// Tests Alloc_Magazine - producers allocate queue links, consumers free them. Counts how many calls
+// reach the base allocator with and without the magazine layer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+#include <assert.h>
+
+#include <atomic>
+
+#define TWLIB_HAS_MOVE_SEMANTICS 1 // for tw_safeFIFOmv
+
+#include <TW/tw_utils.h>
+#include <TW/tw_alloc.h>
+#include <TW/tw_alloc_magazine.h>
+#include <TW/tw_fifo.h>
+
+#define RUN_SIZE 400000
+#define PRODUCER_THREADS 4
+#define CONSUMER_THREADS 2
+#define PER_PRODUCER (RUN_SIZE / PRODUCER_THREADS)
+#define MAX_DEPTH 1000 // producers back off here, so the queue reaches a steady state
+
+using namespace TWlib;
+
+std::atomic<long> baseMallocs(0);
+
+// Alloc_Std, but counts calls to malloc()
+struct Alloc_Counted : public Alloc_Std {
+	static void *malloc (tw_size nbytes) { baseMallocs++; return Alloc_Std::malloc(nbytes); }
+	static void *realloc(void *d, tw_size s) { baseMallocs++; return Alloc_Std::realloc(d,s); }
+};
+
+typedef Allocator<Alloc_Counted> CountedAlloc;
+typedef Allocator<Alloc_Magazine<Alloc_Counted> > MagAlloc;
+
+TW_Mutex *totalMutex;
+int TOTAL;
+int EXITED;
+volatile bool DONE;
+
+template <class Q>
+void *producer( void *ptr ) {
+	Q *q = reinterpret_cast<Q *>(ptr);
+	for(int n=0;n<PER_PRODUCER;n++) {
+		while(q->remaining() > MAX_DEPTH)
+			usleep(100);
+		int v = n;
+		q->add(v);
+	}
+	return NULL;
+}
+
+template <class Q>
+void *consumer( void *ptr ) {
+	Q *q = reinterpret_cast<Q *>(ptr);
+	int v;
+	int cnt = 0;
+	while(1) {
+		if(q->removeOrBlock(v)) // can return false w/o data, if another consumer got there first
+			cnt++;
+		else if(DONE)
+			break;
+	}
+	totalMutex->acquire();
+	TOTAL += cnt;
+	EXITED++;
+	totalMutex->release();
+	return NULL;
+}
+
+template <class Q>
+double runLoad() {
+	Q q;
+	pthread_t consumert[CONSUMER_THREADS];
+	pthread_t producert[PRODUCER_THREADS];
+	struct timeval start, end;
+	TOTAL = 0;
+	EXITED = 0;
+	DONE = false;
+	gettimeofday(&start, NULL);
+	for (int x=0;x<CONSUMER_THREADS;x++)
+		pthread_create( &consumert[x], NULL, consumer<Q>, reinterpret_cast<void *>(&q));
+	for (int x=0;x<PRODUCER_THREADS;x++)
+		pthread_create( &producert[x], NULL, producer<Q>, reinterpret_cast<void *>(&q));
+	for (int x=0;x<PRODUCER_THREADS;x++)
+		pthread_join( producert[x], NULL);
+	while(q.remaining() > 0)
+		usleep(1000);
+	DONE = true;
+	// a consumer may not be blocked yet when we unblock - so keep at it until all are out
+	while(1) {
+		totalMutex->acquire();
+		int e = EXITED;
+		totalMutex->release();
+		if(e == CONSUMER_THREADS) break;
+		q.unblockAll();
+		usleep(1000);
+	}
+	for (int x=0;x<CONSUMER_THREADS;x++)
+		pthread_join( consumert[x], NULL);
+	gettimeofday(&end, NULL);
+	assert(TOTAL == RUN_SIZE);
+	double usec = (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec);
+	return (usec * 1000.0) / RUN_SIZE;
+}
+
+template <class Q>
+void compare(const char *name) {
+	baseMallocs = 0;
+	double s = runLoad<typename Q::std_q>();
+	long sm = baseMallocs;
+	baseMallocs = 0;
+	double m = runLoad<typename Q::mag_q>();
+	long mm = baseMallocs;
+	printf("%s w/ Alloc_Std:      %0.1f ns/item  %ld base mallocs\n", name, s, sm);
+	printf("%s w/ Alloc_Magazine: %0.1f ns/item  %ld base mallocs\n", name, m, mm);
+	assert(mm < sm / 10);
+}
+
+struct safeFIFO_pair {
+	typedef tw_safeFIFO<int, CountedAlloc> std_q;
+	typedef tw_safeFIFO<int, MagAlloc> mag_q;
+};
+struct safeFIFOmv_pair {
+	typedef tw_safeFIFOmv<int, CountedAlloc> std_q;
+	typedef tw_safeFIFOmv<int, MagAlloc> mag_q;
+};
+
+int main()
+{
+	totalMutex = new TW_Mutex();
+
+	// basic calls
+	void *p = MagAlloc::malloc(20);
+	memset(p, 'x', 20);
+	assert(MagAlloc::realloc(p, 32) == p); // same 32 byte class
+	char *r = (char *) MagAlloc::realloc(p, 3000); // uncached size
+	for(int n=0;n<20;n++) assert(r[n] == 'x');
+	r = (char *) MagAlloc::realloc(r, 5000);
+	for(int n=0;n<20;n++) assert(r[n] == 'x');
+	MagAlloc::free(r);
+	int *z = (int *) MagAlloc::calloc(10, sizeof(int));
+	for(int n=0;n<10;n++) assert(z[n] == 0);
+	MagAlloc::free(z);
+
+	// a freed block comes right back
+	p = MagAlloc::malloc(100);
+	MagAlloc::free(p);
+	assert(MagAlloc::malloc(100) == p);
+	MagAlloc::free(p);
+
+	// blocks freed in this thread stay here, then go back to the depot when released
+	void *blocks[TW_MAGAZINE_ROUNDS * 4];
+	for(int n=0;n<TW_MAGAZINE_ROUNDS * 4;n++) blocks[n] = MagAlloc::malloc(64);
+	for(int n=0;n<TW_MAGAZINE_ROUNDS * 4;n++) MagAlloc::free(blocks[n]);
+	Alloc_Magazine<Alloc_Counted>::releaseThreadCache();
+	assert(Alloc_Magazine<Alloc_Counted>::depotMagazines() >= 4);
+
+	compare<safeFIFO_pair>("tw_safeFIFO  ");
+	compare<safeFIFOmv_pair>("tw_safeFIFOmv");
+
+	printf("OK\n");
+	exit(0);
+}
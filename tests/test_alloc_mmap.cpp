@@ -0,0 +1,114 @@
+// test_alloc_mmap.cpp
+// Tests Alloc_MMap - allocation / coalescing in a mapped file, and a DynArray which is still there
+// after the file is closed and opened again.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_alloc_mmap.h>
+#include <TW/tw_array.h>
+
+#define ITEMS 100000
+
+using namespace TWlib;
+
+typedef Allocator<Alloc_MMap> MMapAlloc;
+typedef DynArray<int, MMapAlloc> IntArray;
+
+struct root {
+	int magic;
+	IntArray *table;
+	char *name;
+};
+
+int main()
+{
+	char path[] = "/tmp/test_alloc_mmapXXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+	unlink(path); // open() should create it
+
+	Alloc_MMap m;
+	assert(m.open(path, 64*1024*1024) == 0);
+	assert(m.open(path) == EBUSY);
+
+	// basic allocation, alignment, and coalescing of freed neighbors
+	void *a = m.i_malloc(100);
+	void *b = m.i_malloc(100);
+	void *c = m.i_malloc(100);
+	assert(a && b && c);
+	assert(((uintptr_t) a % TW_MMAP_ALIGN) == 0);
+	assert(m.contains(a) && m.contains(c));
+	uint64_t freeBefore = m.bytesFree();
+	m.i_free(a);
+	m.i_free(c);
+	m.i_free(b); // a, b, c merge back into one block
+	assert(m.bytesFree() > freeBefore);
+	void *big = m.i_malloc(300);
+	assert(big == a); // first fit, in the merged block
+	m.i_free(big);
+	int *z = (int *) m.i_calloc(10, sizeof(int));
+	for(int n=0;n<10;n++) assert(z[n] == 0);
+	z = (int *) m.i_realloc(z, 1000 * sizeof(int));
+	for(int n=0;n<10;n++) assert(z[n] == 0);
+	m.i_free(z);
+	int notOurs[4];
+	assert(m.i_realloc(notOurs + 2, 100) == NULL); // left alone
+
+	// a container in the file, found again through the root
+	Alloc_MMap::setDefault(&m);
+	root *r = (root *) MMapAlloc::malloc(sizeof(root));
+	r->magic = 0x1234;
+	TW_NEW(r->table, IntArray, IntArray(ITEMS), MMapAlloc);
+	for(int n=0;n<ITEMS;n++)
+		r->table->put(n, n * 3);
+	r->name = (char *) MMapAlloc::malloc(32);
+	strcpy(r->name, "persistent");
+	m.setRoot(r);
+	MMapAlloc::sync(r->name, 32);
+	assert(m.i_sync() == 0);
+	assert(m.fileSize() > ITEMS * sizeof(int));
+	void *base = m.base();
+	m.close();
+	assert(Alloc_MMap::getDefault() == NULL);
+	assert(MMapAlloc::malloc(10) == NULL);
+	assert(m.i_realloc(r, 100) == NULL); // closed
+
+	// 'restart'
+	Alloc_MMap m2;
+	assert(m2.open(path) == 0);
+	assert(m2.base() == base);
+	Alloc_MMap::setDefault(&m2);
+	r = (root *) m2.getRoot();
+	assert(r && r->magic == 0x1234);
+	assert(strcmp(r->name, "persistent") == 0);
+	assert(r->table->size() == ITEMS);
+	for(int n=0;n<ITEMS;n++) {
+		int v;
+		assert(r->table->get(n, v));
+		assert(v == n * 3);
+	}
+	// and it can keep growing
+	r->table->resize(ITEMS * 2);
+	assert(r->table->size() == ITEMS * 2);
+	m2.close();
+
+	// not ours
+	FILE *f = fopen(path, "w");
+	fprintf(f, "garbage garbage garbage garbage garbage garbage garbage garbage garbage garbage\n");
+	fclose(f);
+	Alloc_MMap m3;
+	assert(m3.open(path) == EINVAL);
+
+	unlink(path);
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,146 @@
+// test_alloc_pool.cpp
+// Tests Alloc_Pool - size classes, realloc, and chunks allocated in one thread and freed in another
+// (producer / consumer through a tw_safeFIFO using the pool)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+#include <assert.h>
+
+#include <TW/tw_utils.h>
+#include <TW/tw_alloc.h>
+#include <TW/tw_alloc_pool.h>
+#include <TW/tw_fifo.h>
+
+#define RUN_SIZE 400000
+#define PRODUCER_THREADS 4
+#define CONSUMER_THREADS 2
+#define PER_PRODUCER (RUN_SIZE / PRODUCER_THREADS)
+
+using namespace TWlib;
+
+typedef Allocator<Alloc_Pool> PoolAlloc;
+typedef Allocator<Alloc_Std> StdAlloc;
+
+struct node {
+	int val;
+	char pad[20];
+};
+
+TW_Mutex *totalMutex;
+int TOTAL;
+int EXITED;
+volatile bool DONE;
+
+template <class Q>
+void *producer( void *ptr ) {
+	Q *q = reinterpret_cast<Q *>(ptr);
+	for(int n=0;n<PER_PRODUCER;n++)
+		q->add(n);
+	return NULL;
+}
+
+template <class Q>
+void *consumer( void *ptr ) {
+	Q *q = reinterpret_cast<Q *>(ptr);
+	int v;
+	int cnt = 0;
+	while(1) {
+		if(q->removeOrBlock(v)) // can return false w/o data, if another consumer got there first
+			cnt++;
+		else if(DONE)
+			break;
+	}
+	totalMutex->acquire();
+	TOTAL += cnt;
+	EXITED++;
+	totalMutex->release();
+	return NULL;
+}
+
+template <class ALLOC>
+double runLoad() {
+	typedef tw_safeFIFO<int, ALLOC> Q;
+	Q q;
+	pthread_t consumert[CONSUMER_THREADS];
+	pthread_t producert[PRODUCER_THREADS];
+	struct timeval start, end;
+	TOTAL = 0;
+	EXITED = 0;
+	DONE = false;
+	gettimeofday(&start, NULL);
+	for (int x=0;x<CONSUMER_THREADS;x++)
+		pthread_create( &consumert[x], NULL, consumer<Q>, reinterpret_cast<void *>(&q));
+	for (int x=0;x<PRODUCER_THREADS;x++)
+		pthread_create( &producert[x], NULL, producer<Q>, reinterpret_cast<void *>(&q));
+	for (int x=0;x<PRODUCER_THREADS;x++)
+		pthread_join( producert[x], NULL);
+	while(q.remaining() > 0)
+		usleep(1000);
+	DONE = true;
+	// a consumer may not be blocked yet when we unblock - so keep at it until all are out
+	while(1) {
+		totalMutex->acquire();
+		int e = EXITED;
+		totalMutex->release();
+		if(e == CONSUMER_THREADS) break;
+		q.unblockAll();
+		usleep(1000);
+	}
+	for (int x=0;x<CONSUMER_THREADS;x++)
+		pthread_join( consumert[x], NULL);
+	gettimeofday(&end, NULL);
+	assert(TOTAL == RUN_SIZE);
+	double usec = (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec);
+	return (usec * 1000.0) / RUN_SIZE;
+}
+
+int main()
+{
+	totalMutex = new TW_Mutex();
+
+	// size classes
+	void *p = PoolAlloc::malloc(1);
+	assert(p);
+	assert(((uintptr_t) p % TW_POOL_ALIGN) == 0);
+	assert(Alloc_Pool::usableSize(p) == TW_POOL_ALIGN);
+	PoolAlloc::free(p);
+	p = PoolAlloc::malloc(17);
+	assert(Alloc_Pool::usableSize(p) == 32);
+	// realloc within the class keeps the chunk
+	assert(PoolAlloc::realloc(p, 30) == p);
+	memset(p, 'x', 30);
+	char *r = (char *) PoolAlloc::realloc(p, 100);
+	assert(r && Alloc_Pool::usableSize(r) == 112);
+	for(int n=0;n<30;n++) assert(r[n] == 'x');
+	// and on into a large (::malloc) block
+	r = (char *) PoolAlloc::realloc(r, 4000);
+	assert(Alloc_Pool::usableSize(r) == 4000);
+	for(int n=0;n<30;n++) assert(r[n] == 'x');
+	PoolAlloc::free(r);
+	int *z = (int *) PoolAlloc::calloc(10, sizeof(int));
+	for(int n=0;n<10;n++) assert(z[n] == 0);
+	PoolAlloc::free(z);
+
+	// freed chunks are reused, not carved again
+	node *nodes[1000];
+	for(int n=0;n<1000;n++) TW_NEW(nodes[n], node, node(), PoolAlloc);
+	size_t slabs = Alloc_Pool::slabBytes();
+	for(int n=0;n<1000;n++) TW_DELETE(nodes[n], node, PoolAlloc);
+	for(int n=0;n<1000;n++) TW_NEW(nodes[n], node, node(), PoolAlloc);
+	assert(Alloc_Pool::slabBytes() == slabs);
+	for(int n=0;n<1000;n++) TW_DELETE(nodes[n], node, PoolAlloc);
+
+	// links allocated by producers, freed by consumers
+	double s = runLoad<StdAlloc>();
+	double pl = runLoad<PoolAlloc>();
+	printf("tw_safeFIFO w/ Alloc_Std:  %0.1f ns/item\n", s);
+	printf("tw_safeFIFO w/ Alloc_Pool: %0.1f ns/item\n", pl);
+	printf("slab bytes: %lu\n", (unsigned long) Alloc_Pool::slabBytes());
+
+	printf("OK\n");
+	exit(0);
+}
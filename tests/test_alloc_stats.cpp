@@ -0,0 +1,111 @@
+// test_alloc_stats.cpp
+// Tests Alloc_Stats - counts, live / peak bytes, histogram, threads folding in on exit, and dump()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <assert.h>
+
+#include <string>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_alloc_stats.h>
+
+#define THREADS 4
+#define PER_THREAD 10000
+
+using namespace TWlib;
+
+struct TableTag {};
+struct QueueTag {};
+
+typedef Alloc_Stats<Alloc_Std, TableTag> TableStats;
+typedef Alloc_Stats<Alloc_Std, QueueTag> QueueStats;
+typedef Allocator<TableStats> TableAlloc;
+typedef Allocator<QueueStats> QueueAlloc;
+
+void *worker( void *ptr ) {
+	void **blocks = (void **) ::malloc(sizeof(void *) * PER_THREAD);
+	for(int n=0;n<PER_THREAD;n++)
+		blocks[n] = QueueAlloc::malloc(24);
+	// keep half
+	for(int n=0;n<PER_THREAD;n+=2)
+		QueueAlloc::free(blocks[n]);
+	return blocks;
+}
+
+int main()
+{
+	tw_alloc_stats s;
+
+	TableStats::setName("table");
+	void *a = TableAlloc::malloc(100);
+	void *b = TableAlloc::malloc(1000);
+	void *c = TableAlloc::calloc(10, 10);
+	TableStats::snapshot(s);
+	assert(s.allocs == 3);
+	assert(s.frees == 0);
+	assert(s.allocBytes == 1200);
+	assert(s.liveBytes == 1200);
+	assert(s.liveBlocks == 3);
+	assert(s.hist[7] == 2);  // (64,128]
+	assert(s.hist[10] == 1); // (512,1024]
+	assert(s.threads == 1);
+	b = TableAlloc::realloc(b, 2000);
+	TableAlloc::free(a);
+	TableAlloc::free(c);
+	TableStats::snapshot(s);
+	assert(s.liveBytes == 2000);
+	assert(s.liveBlocks == 1);
+	assert(s.peakBytes >= 2000);
+	// one big allocation pushes the peak past the flush threshold
+	void *big = TableAlloc::malloc(TW_ALLOC_STATS_FLUSH_BYTES * 2);
+	TableAlloc::free(big);
+	TableStats::snapshot(s);
+	assert(s.peakBytes >= TW_ALLOC_STATS_FLUSH_BYTES * 2);
+	assert(s.liveBytes == 2000);
+	TableAlloc::free(b);
+
+	// threads exit, and their counts are kept. Blocks freed by another thread count too.
+	pthread_t t[THREADS];
+	void *kept[THREADS];
+	for(int x=0;x<THREADS;x++)
+		pthread_create(&t[x], NULL, worker, NULL);
+	for(int x=0;x<THREADS;x++)
+		pthread_join(t[x], &kept[x]);
+	QueueStats::snapshot(s);
+	assert(s.allocs == THREADS * PER_THREAD);
+	assert(s.liveBlocks == THREADS * PER_THREAD / 2);
+	assert(s.liveBytes == THREADS * PER_THREAD / 2 * 24);
+	assert(s.hist[5] == THREADS * PER_THREAD); // (16,32]
+	for(int x=0;x<THREADS;x++) {
+		void **blocks = (void **) kept[x];
+		for(int n=1;n<PER_THREAD;n+=2)
+			QueueAlloc::free(blocks[n]);
+		::free(blocks);
+	}
+	QueueStats::snapshot(s);
+	assert(s.liveBytes == 0);
+	assert(s.frees == THREADS * PER_THREAD);
+
+	// tags don't share counters
+	TableStats::snapshot(s);
+	assert(s.allocs == 5); // realloc() counts as a free and an alloc
+
+	std::string d = TableStats::dump();
+	printf("%s\n", d.c_str());
+	assert(d.find("\"name\":\"table\"") != std::string::npos);
+	assert(d.find("\"liveBytes\":0") != std::string::npos);
+	d = QueueStats::dump();
+	printf("%s\n", d.c_str());
+	assert(d.find("\"32\":40000") != std::string::npos);
+
+	// the name is escaped in the JSON
+	QueueStats::setName("q \"main\" C:\\tmp\n");
+	d = QueueStats::dump();
+	assert(d.find("{\"name\":\"q \\\"main\\\" C:\\\\tmp\\u000a\",\"allocs\"") == 0);
+
+	printf("OK\n");
+	exit(0);
+}
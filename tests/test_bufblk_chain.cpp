@@ -0,0 +1,176 @@
+// test_bufblk_chain.cpp
+// Tests chain length / tail / block count on a BufBlk head - which must stay right however the chain is
+// changed - and that assembling a message out of many small segments w/ a BufBlkChain is linear.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include <type_traits>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+
+using namespace TWlib;
+
+typedef BufBlk<Alloc_Std> Buf;
+
+// two owners of one chain would release it twice
+static_assert(!std::is_copy_constructible<BufBlkChain<Alloc_Std> >::value && !std::is_copy_assignable<BufBlkChain<Alloc_Std> >::value, "");
+
+// what the head says vs. walking the chain
+void check(Buf *head) {
+	int len = 0, cap = 0, blks = 0;
+	Buf *last = NULL;
+	for(Buf *b = head; b; b = b->nexblk()) {
+		len += b->length();
+		cap += b->capacity();
+		blks++;
+		last = b;
+	}
+	assert(head->total_length() == len);
+	assert(head->total_capacity() == cap);
+	assert(head->total_blocks() == blks);
+	assert(head->tail() == last);
+}
+
+// shows how many blocks append() walked
+struct CountedChain : public BufBlkChain<Alloc_Std> {
+	uint64_t stepped() { return _stepped; }
+};
+
+// 'n' segments of 16 bytes, checking total_length() after each one - like our framing does.
+// @return the blocks walked to do it
+uint64_t assemble(int n) {
+	CountedChain chain;
+	for(int x=0;x<n;x++) {
+		Buf *b = new Buf(16);
+		b->copyFrom("0123456789abcdef", 16);
+		chain.append(b);
+		assert(chain.total_length() == (x + 1) * 16);
+	}
+	assert(chain.total_blocks() == n);
+	return chain.stepped();
+}
+
+int main()
+{
+	Buf *head = new Buf(10);
+	check(head);
+	head->copyFrom("abc", 3);
+	check(head);
+	Buf *b = new Buf(20);
+	head->addToEnd(b);
+	check(head);
+	b->copyFrom("defgh", 5);   // writing to the tail
+	check(head);
+	head->copyFrom("ij", 2);   // and to the head
+	check(head);
+	Buf *c = new Buf(30);
+	c->copyFrom("klm", 3);
+	Buf *d = new Buf(40);
+	d->copyFrom("nopq", 4);
+	c->addToEnd(d);
+	head->addToEnd(c);          // a chain at once
+	check(head);
+	assert(head->total_length() == 17 && head->total_blocks() == 4);
+	head->inc_rd_ptr(1);
+	check(head);
+	assert(b->total_length() == 12 && b->tail() == d);
+
+	// eating bytes
+	head = head->eatBytes(0, 4);   // the whole head block
+	assert(head == b);
+	check(head);
+	assert(c->total_length() == 7);
+	head = head->eatBytes(3, 5);   // end of b, and all of c
+	check(head);
+	assert(head->total_blocks() == 2 && head->nexblk() == d);
+	assert(d->total_length() == 4);
+	head = head->eatBytes(0, 3);   // b
+	check(head);
+	assert(head == d && head->total_length() == 4);
+	head = head->eatBytes(0, 1);
+	check(head);
+
+	// a mid chain edit done directly
+	Buf *e = new Buf(10);
+	e->copyFrom("rs", 2);
+	Buf *f = new Buf(10);
+	f->copyFrom("tu", 2);
+	head->addToEnd(e);
+	head->addToEnd(f);
+	check(head);
+	e->copyFrom("xyz", 3);
+	check(head);
+	assert(head->total_length() == 10);
+
+	// readFrom() / writeTo() through the head
+	int p[2];
+	assert(pipe(p) == 0);
+	assert(head->writeTo(p[1]) == 10);
+	check(head);
+	assert(head->total_length() == 0);
+	assert(head->readFrom(p[0]) > 0);
+	check(head);
+	close(p[0]);
+	close(p[1]);
+	head->release();
+
+	// changed through blocks other than the head
+	{
+		Buf *h = new Buf(8);
+		Buf *m = new Buf(8);
+		Buf *t = new Buf(8);
+		h->addToEnd(m);
+		h->addToEnd(t);
+		assert(h->total_length() == 0);
+		h->nexblk()->copyFrom("abcdefgh", 8);
+		assert(h->total_length() == 8);
+		check(h);
+		h->nexblk()->setNexblk(NULL); // t is cut off, and gone
+		t->release();
+		Buf *n = new Buf(8);
+		n->copyFrom("ij", 2);
+		h->addToEnd(n);
+		check(h);
+		assert(h->total_length() == 10 && h->tail() == n && h->total_blocks() == 3);
+		h->release();
+	}
+
+	// BufBlkChain
+	{
+		BufBlkChain<Alloc_Std> chain;
+		assert(chain.empty() && chain.total_length() == 0 && chain.total_blocks() == 0 && chain.take() == NULL);
+		chain.append(NULL);
+		assert(chain.empty());
+		Buf *x = new Buf(10);
+		x->copyFrom("abc", 3);
+		chain.append(x);
+		check(chain.head());
+		assert(chain.tail() == x && chain.total_length() == 3 && chain.total_blocks() == 1);
+		chain.tail()->copyFrom("de", 2); // writing into the tail
+		Buf *y = new Buf(20);
+		y->copyFrom("fgh", 3);
+		Buf *z = new Buf(30);
+		y->addToEnd(z);
+		chain.append(y);                // a chain at once
+		z->copyFrom("ijkl", 4);
+		assert(chain.total_length() == 12 && chain.total_capacity() == 60 && chain.total_blocks() == 3);
+		assert(chain.tail() == z && chain.head()->total_length() == chain.total_length());
+		Buf *all = chain.take();
+		assert(chain.empty() && all == x);
+		BufBlkChain<Alloc_Std> again(all); // picks up an existing chain - and releases it
+		assert(again.total_length() == 12 && again.tail() == z && again.total_blocks() == 3);
+	}
+
+	// linear reassembly: each block is walked past once, when the next one is added
+	assert(assemble(1) == 0);
+	assert(assemble(4000) == 3999);
+	assert(assemble(32000) == 31999);
+
+	printf("OK\n");
+	exit(0);
+}
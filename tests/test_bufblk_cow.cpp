@@ -0,0 +1,149 @@
+// test_bufblk_cow.cpp
+// Tests copy-on-write of shared BufBlks, and slice() views.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+
+using namespace TWlib;
+
+typedef BufBlk<Alloc_Std> Buf;
+
+// "hello " "big " "world"
+Buf *makeChain() {
+	Buf *a = new Buf(16);
+	a->copyFrom("hello ", 6);
+	Buf *b = new Buf(16);
+	b->copyFrom("big ", 4);
+	a->addToEnd(b);
+	Buf *c = new Buf(16);
+	c->copyFrom("world", 5);
+	a->addToEnd(c);
+	return a;
+}
+
+bool chainIs(Buf *b, const char *s) {
+	char out[64];
+	int n = 0;
+	for(; b; b = b->nexblk()) {
+		memcpy(out + n, b->rd_ptr(), b->length());
+		n += b->length();
+	}
+	return n == (int) strlen(s) && memcmp(out, s, n) == 0;
+}
+
+int main()
+{
+	// fan out, then one subscriber writes - nobody else sees it
+	Buf *msg = makeChain();
+	Buf *sub1 = msg->duplicate();
+	Buf *sub2 = msg->duplicate();
+	assert(msg->getRefCount() == 3 && msg->isShared());
+	void *oldbase = sub1->base();
+	assert(sub1->copyFrom("!!", 2) == 2);
+	assert(sub1->base() != oldbase);           // sub1 got its own copy of the first block...
+	assert(sub1->nexblk()->memblk() == msg->nexblk()->memblk()); // ...and only the first block
+	assert(msg->getRefCount() == 2 && sub1->getRefCount() == 1);
+	assert(!sub1->isShared());
+	assert(chainIs(sub1, "hello !!big world"));
+	assert(chainIs(msg, "hello big world"));
+	assert(chainIs(sub2, "hello big world"));
+	// nobody shares it now, so writing again doesn't copy
+	void *mine = sub1->base();
+	sub1->copyFrom("?", 1);
+	assert(sub1->base() == mine);
+
+	// eatBytes() from the middle of a shared block
+	sub2 = sub2->eatBytes(1, 3); // "hello " -> "ho "
+	assert(chainIs(sub2, "ho big world"));
+	assert(chainIs(msg, "hello big world"));
+
+	// fillWith / resize
+	Buf *d = msg->duplicate();
+	d->nexblk()->fillWith('x');
+	assert(chainIs(msg, "hello big world"));
+	assert(chainIs(d, "hello xxxxworld"));
+	Buf *e = msg->duplicate();
+	assert(e->resize(4096));
+	assert(e->capacity() == 4096 && msg->capacity() == 16);
+	assert(chainIs(e, "hello big world"));
+	d->release();
+	e->release();
+	sub1->release();
+	sub2->release();
+
+	// explicit, for writing through the pointers
+	Buf *f = msg->duplicate();
+	assert(f->makeWritable());
+	f->rd_ptr()[0] = 'j';
+	assert(chainIs(f, "jello big world"));
+	assert(chainIs(msg, "hello big world"));
+	f->release();
+
+	// slices
+	Buf *s = msg->slice(4, 8); // "o big wo"
+	assert(s);
+	assert(chainIs(s, "o big wo"));
+	assert(s->memblk() == msg->memblk());
+	assert(s->nexblk()->nexblk()->memblk() == msg->nexblk()->nexblk()->memblk());
+	assert(msg->getRefCount() == 2);
+	Buf *s2 = msg->slice(6, 4); // exactly the middle block
+	assert(chainIs(s2, "big ") && s2->nexblk() == NULL);
+	Buf *s3 = msg->slice(0, 15);
+	assert(chainIs(s3, "hello big world"));
+	assert(msg->slice(10, 6) == NULL); // past the end
+	assert(msg->slice(0, 0) == NULL);
+	// a slice of a slice
+	Buf *s4 = s->slice(2, 3);
+	assert(chainIs(s4, "big"));
+	// writing to a slice leaves the original alone
+	s4->rewind(0);
+	s4->makeWritable();
+	s4->rd_ptr()[0] = 'B';
+	assert(chainIs(s4, "Big"));
+	assert(chainIs(msg, "hello big world"));
+	s->release();
+	s2->release();
+	s3->release();
+	s4->release();
+	assert(msg->getRefCount() == 1);
+	msg->release();
+
+	// reading / writing into a slice's free space - which is the rest of its source's data
+	{
+		Buf *a = new Buf(16);
+		a->copyFrom("ABCDEFGHIJKLMNOP", 16);
+		Buf *sl = a->slice(0, 4);
+		assert(sl->freespace() == 12);
+		int p[2];
+		assert(pipe(p) == 0);
+		assert(write(p[1], "xxxxxxxxxxxx", 12) == 12);
+		assert(sl->readFrom(p[0]) == 12);
+		assert(chainIs(sl, "ABCDxxxxxxxxxxxx"));
+		assert(chainIs(a, "ABCDEFGHIJKLMNOP"));
+		sl->release();
+		sl = a->slice(2, 4);
+		assert(sl->copyFrom("yy", 2) == 2);
+		assert(chainIs(sl, "CDEFyy") && chainIs(a, "ABCDEFGHIJKLMNOP"));
+		sl->release();
+		sl = a->slice(0, 4);
+		struct iovec iov[2];
+		int bytes = 0;
+		assert(sl->getFreeIovecs(iov, 2, &bytes) == 1 && bytes == 12);
+		memset(iov[0].iov_base, 'z', iov[0].iov_len);
+		sl->inc_wr_ptr(12);
+		assert(chainIs(sl, "ABCDzzzzzzzzzzzz") && chainIs(a, "ABCDEFGHIJKLMNOP"));
+		sl->release();
+		close(p[0]);
+		close(p[1]);
+		a->release();
+	}
+
+	printf("OK\n");
+	exit(0);
+}
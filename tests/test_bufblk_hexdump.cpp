@@ -0,0 +1,172 @@
+// test_bufblk_hexdump.cpp
+// Tests tw_hex_encode() and BufBlk::hexDump() - the output is the same as the old ostringstream version,
+// the max byte cap covers the whole chain, and dumping into a small buffer never overruns it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <assert.h>
+
+#include <string>
+#include <sstream>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+#include <TW/tw_utils.h>
+
+using namespace TWlib;
+
+typedef BufBlk<Alloc_Std> Buf;
+
+// the old MemBlk::_concatHexDump() / BufBlk::hexDump(), w/o a max
+void oldBlkDump(std::ostringstream &outs, char *base, int size, char *rdptr, char *wrtptr) {
+	char buf[8];
+	char *walk = base;
+	int c = 0;
+	snprintf(buf,8,"(%d",size);
+	outs << buf;
+	outs << ")[";
+	while(c < size) {
+		if(rdptr == walk) {
+			if(rdptr == wrtptr)
+				outs << "R*W";
+			else
+				outs << "RD*";
+		} else if(wrtptr == walk)
+			outs << "WR*";
+		snprintf(buf,8,"%02X",(unsigned char) *walk);
+		outs << buf;
+		c++;
+		walk++;
+		if(c < size)
+			outs << ",";
+	}
+	if(walk == wrtptr)
+		outs << "WR*";
+	outs << "]";
+}
+
+std::string oldDump(Buf *b) {
+	std::ostringstream outs;
+	for(; b; b = b->nexblk()) {
+		oldBlkDump(outs, (char *) b->base(), b->capacity(), b->rd_ptr(), b->wr_ptr());
+		outs << "->";
+	}
+	outs << "END";
+	return outs.str();
+}
+
+double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main()
+{
+	unsigned char all[256];
+	for(int n=0;n<256;n++) all[n] = (unsigned char) n;
+	char hex[600];
+	char *e = tw_hex_encode(hex, all, 256);
+	assert(e - hex == 512);
+	for(int n=0;n<256;n++) {
+		char want[3];
+		snprintf(want, 3, "%02X", n);
+		assert(hex[2 * n] == want[0] && hex[2 * n + 1] == want[1]);
+	}
+	for(int len=0;len<40;len++) { // the SIMD and tail parts agree
+		char a[100], b[100];
+		tw_hex_encode(a, all + 200 - len, len);
+		tw_hex_encode(b, all + 200 - len, 0);
+		for(int n=0;n<len;n++)
+			tw_hex_encode(b + 2 * n, all + 200 - len + n, 1);
+		assert(!memcmp(a, b, 2 * len));
+	}
+	e = tw_hex_encode_sep(hex, "\x01\xAB\xFF", 3, ':');
+	*e = '\0';
+	assert(!strcmp(hex, "01:AB:FF"));
+	assert(tw_hex_encode_sep(hex, all, 0) == hex);
+	for(int len=1;len<70;len++) { // across the 16 byte runs
+		char want[300];
+		char *w = want;
+		for(int n=0;n<len;n++)
+			w += sprintf(w, (n < len - 1) ? "%02X," : "%02X", all[150 + n]);
+		e = tw_hex_encode_sep(hex, all + 150, len, ',');
+		assert(e - hex == w - want && !memcmp(hex, want, w - want));
+	}
+
+	// every rd / wr position in a block
+	for(int r=0;r<=8;r++)
+		for(int w=r;w<=8;w++) {
+			Buf *b = new Buf(8);
+			b->copyFrom(all + 0x40, 8);
+			b->rewind(0);
+			b->inc_rd_ptr(r);
+			b->wr_ptr(b->rd_ptr() + (w - r));
+			std::string s;
+			b->hexDump(s);
+			assert(s == oldDump(b));
+			b->release();
+		}
+	// a chain
+	Buf *head = new Buf(5);
+	head->copyFrom(all + 0xA0, 5);
+	Buf *mid = new Buf(7);
+	mid->fillWith(0);
+	mid->copyFrom(all, 3);
+	head->addToEnd(mid);
+	Buf *last = new Buf(1);
+	last->fillWith(0);
+	head->addToEnd(last);
+	std::string s;
+	head->hexDump(s);
+	assert(s == oldDump(head));
+	printf("%s\n", s.c_str());
+	assert(s == "(5)[RD*A0,A1,A2,A3,A4WR*]->(7)[RD*00,01,02,WR*00,00,00,00]->(1)[R*W00]->END");
+
+	// max is in bytes, over the whole chain
+	head->hexDump(s, 7);
+	assert(s == "(5)[RD*A0,A1,A2,A3,A4WR*]->(7)[RD*00,01]->END");
+	head->hexDump(s, 3);
+	assert(s == "(5)[RD*A0,A1,A2]->END");
+
+	// into a buffer - cut short, never past the end
+	char buf[200];
+	int l = head->hexDump(buf, sizeof(buf));
+	assert(l == (int) strlen(buf) && s.assign(buf) == oldDump(head));
+	for(int space=0;space<=l + 1;space++) {
+		memset(buf, '#', sizeof(buf));
+		int n = head->hexDump(buf, space);
+		assert(buf[space] == '#');
+		if(space >= 4) {
+			assert(n == (int) strlen(buf) && n < space);
+			assert(!strcmp(buf + n - 3, "END"));
+		}
+	}
+
+	// speed - a 64K packet
+	Buf *pkt = new Buf(64 * 1024);
+	for(int n=0;n<64 * 1024;n++) pkt->wr_ptr()[n] = (char) (n * 31);
+	pkt->inc_wr_ptr(64 * 1024);
+	double t = now();
+	for(int n=0;n<20;n++)
+		pkt->hexDump(s);
+	double tnew = now() - t;
+	t = now();
+	for(int n=0;n<20;n++)
+		assert(oldDump(pkt).size() == s.size());
+	double told = now() - t;
+	printf("64K dump: %.3f ms  (ostringstream: %.3f ms)\n", tnew * 1000 / 20, told * 1000 / 20);
+	assert(tnew < told);
+	pkt->release();
+
+	std::string m;
+	head->memblk()->hexDump(m);
+	assert(m == "(5)[A0,A1,A2,A3,A4]");
+	head->release();
+
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,85 @@
+// test_bufblk_inline.cpp
+// Tests BufBlk::newInline() - the MemBlk and its memory in one allocation, and resize() moving the
+// memory out when it grows.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+
+using namespace TWlib;
+
+// counts calls, so we can tell how many allocations a block takes
+struct Alloc_Counted : public Alloc_Std {
+	static int mallocs;
+	static int frees;
+	static void *malloc(tw_size n) { mallocs++; return ::malloc(n); }
+	static void *realloc(void *d, tw_size s) { if(!d) mallocs++; return ::realloc(d, s); }
+	static void free(void *p) { if(p) frees++; ::free(p); }
+};
+int Alloc_Counted::mallocs = 0;
+int Alloc_Counted::frees = 0;
+
+typedef BufBlk<Alloc_Counted> Buf;
+typedef MemBlk<Alloc_Counted> Mem;
+
+int main()
+{
+	// MemBlk(size) is two allocations - the object (new) and the memory. Inline is one.
+	Buf *b = Buf::newInline(100);
+	assert(b);
+	assert(Alloc_Counted::mallocs == 1);
+	assert(b->memblk()->isInline());
+	assert(b->getRefCount() == 1);
+	assert(b->capacity() == 100 && b->length() == 0 && b->freespace() == 100);
+	assert(((uintptr_t) b->base() % 16) == 0);
+	assert((char *) b->base() > (char *) b->memblk()); // right behind the header
+	assert((char *) b->base() - (char *) b->memblk() < (int) sizeof(Mem) + 16);
+	assert(b->mark() == b->rd_ptr());
+
+	b->copyFrom("0123456789", 10);
+	Buf *d = b->duplicate();
+	assert(b->getRefCount() == 2);
+	b->release();
+	assert(Alloc_Counted::frees == 0);
+	assert(memcmp(d->rd_ptr(), "0123456789", 10) == 0);
+	d->release();
+	assert(Alloc_Counted::frees == 1); // one free() for both
+
+	// shrinking stays in place
+	b = Buf::newInline(64);
+	void *base = b->base();
+	b->copyFrom("abcdef", 6);
+	assert(b->resize(32));
+	assert(b->base() == base && b->capacity() == 32);
+	// growing moves the memory to its own allocation, pointers follow
+	b->inc_rd_ptr(2);
+	assert(b->resize(4096));
+	assert(b->base() != base);
+	assert(b->capacity() == 4096);
+	assert(b->length() == 4 && memcmp(b->rd_ptr(), "cdef", 4) == 0);
+	assert(Alloc_Counted::mallocs == 3);
+	// and after that it is a normal realloc
+	assert(b->resize(8192));
+	assert(memcmp(b->rd_ptr(), "cdef", 4) == 0);
+	int frees = Alloc_Counted::frees;
+	b->release();
+	assert(Alloc_Counted::frees == frees + 2); // the moved memory, and the header allocation
+
+	// deep copies of an inline block are regular blocks
+	b = Buf::newInline(16);
+	b->copyFrom("xyz", 3);
+	Buf *c = b->deepCopy();
+	assert(!c->memblk()->isInline());
+	assert(memcmp(c->rd_ptr(), "xyz", 3) == 0);
+	c->release();
+	b->release();
+
+	assert(Alloc_Counted::mallocs == Alloc_Counted::frees); // nothing leaked
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,106 @@
+// test_bufblk_iovec.cpp
+// Tests BufBlk iovec export, and writeTo() / readFrom() over a pipe - including partial transfers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+
+#define BIG 10000
+
+using namespace TWlib;
+
+typedef BufBlk<Alloc_Std> Buf;
+
+int main()
+{
+	int p[2];
+	assert(pipe(p) == 0);
+
+	// a 3 block chain, the middle one empty
+	Buf *a = new Buf(16);
+	a->copyFrom("hello ", 6);
+	a->addToEnd(new Buf(16));
+	Buf *c = new Buf(16);
+	c->copyFrom("world", 5);
+	a->addToEnd(c);
+
+	struct iovec iov[8];
+	int bytes = 0;
+	assert(a->getIovecs(iov, 8, &bytes) == 2);
+	assert(bytes == 11);
+	assert(iov[0].iov_base == a->rd_ptr() && iov[0].iov_len == 6);
+	assert(iov[1].iov_base == c->rd_ptr() && iov[1].iov_len == 5);
+	assert(a->getIovecs(iov, 1, &bytes) == 1 && bytes == 6);
+	assert(a->getFreeIovecs(iov, 8, &bytes) == 3);
+	assert(bytes == 10 + 16 + 11);
+
+	assert(a->writeTo(p[1]) == 11);
+	assert(a->total_length() == 0);
+	assert(a->writeTo(p[1]) == 0); // nothing left
+
+	// read into a chain of small blocks - spans all of them
+	Buf *r = new Buf(4);
+	r->addToEnd(new Buf(4));
+	r->addToEnd(new Buf(100));
+	assert(r->readFrom(p[0]) == 11);
+	assert(r->length() == 4 && r->nexblk()->length() == 4 && r->nexblk()->nexblk()->length() == 3);
+	char out[32];
+	int copied = 0;
+	BufBlkIter<Alloc_Std> it(*r);
+	it.copyNextChunks(out, sizeof(out), copied);
+	assert(copied == 11);
+	assert(memcmp(out, "hello world", 11) == 0);
+	a->release();
+
+	// partial read - more space than data, the next read continues in the same block
+	assert(write(p[1], "ab", 2) == 2);
+	assert(r->readFrom(p[0]) == 2);
+	assert(r->nexblk()->nexblk()->length() == 5);
+	r->release();
+
+	// partial write - a non blocking pipe which can't take everything
+	fcntl(p[1], F_SETFL, O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+	fcntl(p[1], F_SETPIPE_SZ, 4096);
+#endif
+	Buf *big = new Buf(BIG / 2);
+	big->addToEnd(new Buf(BIG / 2));
+	for(int n=0;n<BIG;n++) {
+		char v = (char) (n % 251);
+		if(n < BIG / 2) big->copyFrom(&v, 1);
+		else big->nexblk()->copyFrom(&v, 1);
+	}
+	char *in = (char *) malloc(BIG);
+	int got = 0;
+	int rounds = 0;
+	while(big->total_length() > 0) {
+		int w = big->writeTo(p[1]);
+		if(w < 0) assert(errno == EAGAIN);
+		int x = read(p[0], in + got, BIG - got);
+		if(x > 0) got += x;
+		rounds++;
+	}
+	while(got < BIG) {
+		int x = read(p[0], in + got, BIG - got);
+		assert(x > 0);
+		got += x;
+	}
+	printf("partial write rounds: %d\n", rounds);
+	assert(rounds > 1);
+	for(int n=0;n<BIG;n++)
+		assert(in[n] == (char) (n % 251));
+	big->release();
+	free(in);
+
+	close(p[0]);
+	close(p[1]);
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,165 @@
+// test_bufblk_pool.cpp
+// Tests BufBlkPool - size classes, recycling on the last release() (including from another thread),
+// the per class limit, and the hit / miss counters.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/time.h>
+#include <assert.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+#include <TW/tw_bufblk_pool.h>
+
+#define MSGS 200000
+
+using namespace TWlib;
+
+typedef BufBlk<Alloc_Std> Buf;
+typedef BufBlkPool<Alloc_Std> Pool;
+
+// Alloc_Std, which runs out of memory after 'left' more malloc()s (-1: never)
+struct Alloc_Failing : public Alloc_Std {
+	static int left;
+	static void *malloc( tw_size nbytes ) {
+		if(left == 0) return NULL;
+		if(left > 0) left--;
+		return ::malloc((size_t) nbytes);
+	}
+};
+int Alloc_Failing::left = -1;
+
+Buf *handoff = NULL;
+
+void *releaser( void *ptr ) {
+	handoff->release();
+	return NULL;
+}
+
+double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main()
+{
+	tw_bufblk_pool_stats s;
+	Pool pool(64, 4096, 4);
+
+	assert(pool.classSize(1) == 64);
+	assert(pool.classSize(64) == 64);
+	assert(pool.classSize(65) == 128);
+	assert(pool.classSize(1500) == 2048);
+	assert(pool.classSize(4096) == 4096);
+	assert(pool.classSize(4097) == -1);
+
+	Buf *a = pool.get(1500);
+	assert(a->capacity() == 2048);
+	assert(a->getRefCount() == 1);
+	assert(a->length() == 0 && a->mark() == a->rd_ptr());
+	a->copyFrom("abc", 3);
+	void *mem = a->base();
+	a->release();
+	pool.getStats(s);
+	assert(s.misses == 1 && s.hits == 0 && s.recycled == 1 && s.cached == 1);
+
+	// same class - same memory back, reset
+	Buf *b = pool.get(1025);
+	assert(b->base() == mem);
+	assert(b->length() == 0 && b->freespace() == 2048);
+	assert(b->getRefCount() == 1);
+	// duplicates keep it out of the pool until the last release()
+	Buf *d = b->duplicate();
+	b->release();
+	pool.getStats(s);
+	assert(s.hits == 1 && s.cached == 0);
+	// ...which can come from another thread
+	handoff = d;
+	pthread_t t;
+	pthread_create(&t, NULL, releaser, NULL);
+	pthread_join(t, NULL);
+	pool.getStats(s);
+	assert(s.cached == 1 && s.recycled == 2);
+
+	// too big for the pool
+	Buf *big = pool.get(10000);
+	assert(big->capacity() == 10000);
+	big->release();
+	pool.getStats(s);
+	assert(s.oversize == 1 && s.cached == 1);
+
+	// a chain of pooled blocks, more than a class holds
+	Buf *chain = pool.get(100);
+	for(int n=0;n<5;n++)
+		chain->addToEnd(pool.get(100));
+	chain->release();
+	pool.getStats(s);
+	assert(s.dropped == 2); // 6 released, 4 kept
+	assert(s.cached == 5);
+
+	// resized off its class - not put back
+	Buf *r = pool.get(100);
+	r->resize(300);
+	r->release();
+	pool.getStats(s);
+	assert(s.dropped == 3);
+
+	pool.trim();
+	pool.getStats(s);
+	assert(s.cached == 0);
+
+	// out of memory while building the pool - no classes, or a class w/o its cache. It still works,
+	// it just doesn't keep blocks.
+	for(int fail=0;fail<5;fail++) {
+		Alloc_Failing::left = fail;
+		BufBlkPool<Alloc_Failing> *fp = new BufBlkPool<Alloc_Failing>(64, 256, 4);
+		Alloc_Failing::left = -1;
+		for(int r=0;r<2;r++) {
+			BufBlk<Alloc_Failing> *b = fp->get(100);
+			assert(b && b->capacity() >= 100);
+			b->copyFrom("pool", 4);
+			b->release();
+		}
+		tw_bufblk_pool_stats fs;
+		fp->getStats(fs);
+		if(fail == 0)
+			assert(fs.oversize == 2);
+		else if(fail < 3) // no cache for the 128 class, where 100 goes
+			assert(fs.misses == 2 && fs.hits == 0 && fs.cached == 0 && fs.dropped == 2);
+		else
+			assert(fs.misses == 1 && fs.hits == 1 && fs.cached == 1);
+		delete fp;
+	}
+
+	// steady state message churn
+	Pool pool2;
+	double t0 = now();
+	for(int n=0;n<MSGS;n++) {
+		Buf *m = pool2.get(512 + (n % 8) * 128);
+		m->inc_wr_ptr(64);
+		Buf *m2 = m->duplicate();
+		m->release();
+		m2->release();
+	}
+	double tp = now() - t0;
+	t0 = now();
+	for(int n=0;n<MSGS;n++) {
+		Buf *m = new Buf(512 + (n % 8) * 128);
+		m->inc_wr_ptr(64);
+		Buf *m2 = m->duplicate();
+		m->release();
+		m2->release();
+	}
+	double tn = now() - t0;
+	pool2.getStats(s);
+	printf("pool: %.0f msgs/sec  plain: %.0f msgs/sec  hits %llu misses %llu\n", MSGS / tp, MSGS / tn,
+		(unsigned long long) s.hits, (unsigned long long) s.misses);
+	assert(s.hits + s.misses == MSGS);
+	assert(s.misses == 3); // the 512, 1024 and 2048 classes
+
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,237 @@
+// test_bufblk_reader.cpp
+// Tests BufBlkReader - integers, varints, delimiters and frames, w/ the data split into blocks at every
+// possible place.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <assert.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+#include <TW/tw_bufblk_reader.h>
+
+using namespace TWlib;
+
+typedef BufBlk<Alloc_Std> Buf;
+typedef BufBlkReader<Alloc_Std> Reader;
+
+// data, in blocks cut at 'a' and 'b'
+Buf *split(const char *d, int len, int a, int b) {
+	int cuts[4] = { 0, a, b, len };
+	Buf *head = NULL;
+	for(int n=0;n<3;n++) {
+		Buf *blk = new Buf(cuts[n+1] - cuts[n] + 1);
+		blk->copyFrom(d + cuts[n], cuts[n+1] - cuts[n]);
+		if(head) head->addToEnd(blk);
+		else head = blk;
+	}
+	return head;
+}
+
+// data in blocks of 'blksz'
+Buf *chainOf(const char *d, int len, int blksz) {
+	Buf *head = NULL;
+	while(len > 0) {
+		int l = (len < blksz) ? len : blksz;
+		Buf *b = new Buf(l);
+		b->copyFrom(d, l);
+		if(head) head->addToEnd(b);
+		else head = b;
+		d += l;
+		len -= l;
+	}
+	return head;
+}
+
+bool chainIs(Buf *b, const char *s, int len) {
+	int n = 0;
+	for(; b; b = b->nexblk()) {
+		if(n + b->length() > len || memcmp(b->rd_ptr(), s + n, b->length())) return false;
+		n += b->length();
+	}
+	return n == len;
+}
+
+int putVarint(unsigned char *p, uint64_t v) {
+	int n = 0;
+	while(v >= 0x80) {
+		p[n++] = (unsigned char) (v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (unsigned char) v;
+	return n;
+}
+
+double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main()
+{
+	// fixed fields, then varints, then a delimited line, then a length prefixed frame
+	unsigned char msg[128];
+	int len = 0;
+	msg[len++] = 0xAB;
+	msg[len++] = 0x34; msg[len++] = 0x12;                                          // LE 0x1234
+	msg[len++] = 0xDE; msg[len++] = 0xAD; msg[len++] = 0xBE; msg[len++] = 0xEF;    // BE 0xDEADBEEF
+	for(int n=0;n<8;n++) msg[len++] = (unsigned char) (0x01 + n);                  // LE 0x0807060504030201
+	len += putVarint(msg + len, 300);
+	len += putVarint(msg + len, 0xFFFFFFFFFFFFFFFFULL);
+	len += putVarint(msg + len, 3);                                                 // zigzag -2
+	memcpy(msg + len, "GET / HTTP/1.1\r\n", 16);
+	len += 16;
+	msg[len++] = 0; msg[len++] = 0; msg[len++] = 0; msg[len++] = 5;
+	memcpy(msg + len, "hello", 5);
+	len += 5;
+	memcpy(msg + len, "rest", 4);
+	len += 4;
+
+	for(int a=0;a<=len;a++)
+		for(int b=a;b<=len;b++) {
+			Reader r(split((const char *) msg, len, a, b));
+			assert(r.available() == len);
+			uint8_t u8; uint16_t u16; uint32_t u32; uint64_t u64; int64_t i64;
+			assert(r.readLE(u8) && u8 == 0xAB);
+			assert(r.peekLE(u16) && u16 == 0x1234 && r.position() == 1);
+			assert(r.readLE(u16) && u16 == 0x1234);
+			assert(r.readBE(u32) && u32 == 0xDEADBEEF);
+			assert(r.readLE(u64) && u64 == 0x0807060504030201ULL);
+			assert(r.readVarint(u64) && u64 == 300);
+			assert(r.readVarint(u64) && u64 == 0xFFFFFFFFFFFFFFFFULL);
+			assert(r.readVarintSigned(i64) && i64 == -2);
+			int at = r.find("\r\n", 2);
+			assert(at == 14);
+			assert(r.find('/') == 4);
+			assert(r.find('/', 4) == -1);
+			assert(r.find("\r\n", 2, 15) == -1 && r.find("\r\n", 2, 16) == 14);
+			assert(r.find("HTTP/2", 6) == -1);
+			Buf *line = r.takeFrame(at);
+			assert(chainIs(line, "GET / HTTP/1.1", 14));
+			line->release();
+			assert(r.position() == 0 && r.available() == 2 + 4 + 5 + 4);
+			assert(r.skip(2));
+			assert(r.peekBE(u32) && u32 == 5);
+			assert(r.skip(4));
+			Buf *frame = r.takeFrame(5);
+			assert(chainIs(frame, "hello", 5));
+			assert(r.available() == 4);
+			assert(!r.peekLE(u64));                 // not enough - and the cursor stays
+			assert(r.position() == 0);
+			assert(r.takeFrame(5) == NULL);
+			frame->release();
+			char rest[4];
+			assert(r.readBytes(rest, 4) && !memcmp(rest, "rest", 4));
+			assert(r.available() == 0 && !r.readLE(u8));
+			r.consume();
+			assert(r.chain() == NULL);
+		}
+
+	// incomplete varints wait for more data
+	{
+		unsigned char v[10];
+		int vl = putVarint(v, 1ULL << 40);
+		Buf *first = new Buf(16);
+		first->copyFrom(v, 3);
+		Reader r(first);
+		uint64_t x;
+		assert(!r.peekVarint(x));
+		Buf *more = new Buf(16);
+		more->copyFrom(v + 3, vl - 3);
+		r.append(more);
+		assert(r.readVarint(x) && x == (1ULL << 40));
+		unsigned char bad[11];
+		memset(bad, 0x80, 11);
+		Buf *junk = new Buf(16);
+		junk->copyFrom(bad, 11);
+		r.append(junk);
+		assert(!r.readVarint(x)); // too long
+	}
+
+	// a stream of length prefixed frames, arriving in odd sized reads - the ingest loop
+	int nframes = 20000;
+	char *stream = (char *) malloc(nframes * 40);
+	int slen = 0;
+	for(int n=0;n<nframes;n++) {
+		int fl = 1 + (n % 33);
+		stream[slen++] = 0; stream[slen++] = 0; stream[slen++] = 0; stream[slen++] = (char) fl;
+		for(int x=0;x<fl;x++) stream[slen++] = (char) (n + x);
+	}
+	int readsz[] = { 1, 7, 100, 1500 };
+	for(int rs=0;rs<4;rs++) {
+		double t = now();
+		Reader r;
+		int got = 0;
+		int fed = 0;
+		while(fed < slen) {
+			int l = (slen - fed < readsz[rs]) ? slen - fed : readsz[rs];
+			Buf *b = new Buf(l);
+			b->copyFrom(stream + fed, l);
+			fed += l;
+			r.append(b);
+			uint32_t fl;
+			while(r.peekBE(fl) && r.available() >= 4 + (int) fl) {
+				r.skip(4);
+				Buf *f = r.takeFrame(fl);
+				assert(f && f->total_length() == (int) fl);
+				assert((int) fl == 1 + (got % 33));
+				assert(f->rd_ptr()[0] == (char) got);
+				f->release();
+				got++;
+			}
+		}
+		assert(got == nframes && r.available() == 0);
+		printf("reads of %d: %d frames in %.2f ms\n", readsz[rs], got, (now() - t) * 1000);
+	}
+
+	// many small fields out of a chain of many small reads, w/o consuming - available() is kept by the
+	// reader, and has to agree w/ the chain through partial consume()s and an empty block at the end
+	{
+		Reader r(chainOf(stream, 3000, 1));
+		assert(r.available() == 3000);
+		for(int n=3000;n<6000;n+=3)
+			r.append(chainOf(stream + n, 3, 1));
+		r.append(new Buf(8)); // empty
+		for(int n=0;n<6000;n++) {
+			uint8_t v;
+			assert(r.readLE(v) && v == (uint8_t) stream[n]);
+			assert(r.available() == 6000 - n - 1);
+			if(n % 1000 == 500) {
+				r.consume();
+				assert(r.available() == r.chain()->total_length());
+			}
+		}
+		r.append(chainOf("cd", 2, 1)); // goes in after the empty block
+		assert(r.available() == 2 && r.chain()->total_length() - r.position() == 2);
+		char cd[2];
+		assert(r.readBytes(cd, 2) && !memcmp(cd, "cd", 2));
+		r.consume();
+		assert(r.available() == 0 && r.chain() == NULL);
+		r.append(chainOf("efg", 3, 2));
+		assert(r.available() == 3 && r.skip(1));
+		Buf *d = r.detach();
+		assert(r.available() == 0 && d->total_length() == 3);
+		d->release();
+	}
+
+	// a line protocol over a big chain
+	Buf *lines = chainOf("alpha\nbeta\ngamma\n", 17, 4);
+	Reader lr(lines);
+	const char *want[] = { "alpha", "beta", "gamma" };
+	for(int n=0;n<3;n++) {
+		int at = lr.find('\n');
+		assert(at >= 0);
+		Buf *l = lr.takeFrame(at);
+		assert(chainIs(l, want[n], strlen(want[n])));
+		l->release();
+		lr.skip(1);
+	}
+	assert(lr.find('\n') == -1 && lr.available() == 0);
+
+	free(stream);
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,97 @@
+// test_bufblk_refcount.cpp
+// Tests MemBlk reference counting - fans a BufBlk chain out to several threads with duplicate(), which
+// release() their copies concurrently. The last release has to free the payload exactly once.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <assert.h>
+
+#include <atomic>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+
+#define THREADS 4
+#define ROUNDS 20000
+
+using namespace TWlib;
+
+// counts frees, so we can tell the memory went away exactly once per block
+struct Alloc_Counted : public Alloc_Std {
+	static std::atomic<int> frees;
+	static void free(void *p) { if(p) frees++; ::free(p); }
+};
+std::atomic<int> Alloc_Counted::frees( 0 );
+
+typedef BufBlk<Alloc_Counted> Buf;
+
+Buf *shared[THREADS];
+pthread_barrier_t barrier;
+
+void *worker( void *ptr ) {
+	int id = *((int *) ptr);
+	for(int n=0;n<ROUNDS;n++) {
+		pthread_barrier_wait(&barrier); // main thread has set up shared[]
+		Buf *mine = shared[id];
+		Buf *extra = mine->duplicate(); // more churn on the same counts
+		assert(extra->getRefCount() >= 2);
+		extra->release();
+		assert(mine->rd_ptr()[0] == (char) (n & 0x7F));
+		mine->release();
+		pthread_barrier_wait(&barrier); // all released
+	}
+	return NULL;
+}
+
+int main()
+{
+	// single threaded counting
+	Buf *a = new Buf(64);
+	a->setNexblk(new Buf(64));
+	assert(a->getRefCount() == 1);
+	Buf *b = a->duplicate();
+	assert(a->getRefCount() == 2);
+	assert(a->nexblk()->getRefCount() == 2);
+	b->release();
+	assert(a->getRefCount() == 1);
+	assert(Alloc_Counted::frees == 0);
+	a->release();
+	assert(Alloc_Counted::frees == 2);
+
+	// unmanaged memory is left alone
+	char stackbuf[16];
+	Buf *u = new Buf(stackbuf, sizeof(stackbuf), false);
+	u->release();
+	assert(Alloc_Counted::frees == 2);
+
+	// fan out
+	Alloc_Counted::frees = 0;
+	pthread_barrier_init(&barrier, NULL, THREADS + 1);
+	pthread_t t[THREADS];
+	int ids[THREADS];
+	for(int x=0;x<THREADS;x++) {
+		ids[x] = x;
+		pthread_create(&t[x], NULL, worker, &ids[x]);
+	}
+	for(int n=0;n<ROUNDS;n++) {
+		Buf *msg = new Buf(32);
+		msg->setNexblk(new Buf(32));
+		char c = (char) (n & 0x7F);
+		msg->copyFrom(&c, 1);
+		for(int x=0;x<THREADS;x++)
+			shared[x] = msg->duplicate();
+		msg->release(); // workers hold the only references now
+		pthread_barrier_wait(&barrier);
+		pthread_barrier_wait(&barrier);
+	}
+	for(int x=0;x<THREADS;x++)
+		pthread_join(t[x], NULL);
+	printf("frees: %d\n", Alloc_Counted::frees.load());
+	assert(Alloc_Counted::frees == ROUNDS * 2);
+	pthread_barrier_destroy(&barrier);
+
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,159 @@
+// test_bufblk_sendfile.cpp
+// Tests file backed BufBlks (BufBlk::newFile()) and sendTo() - sendfile() for file blocks, writev()
+// for memory blocks, the write() fallback, and partial sends on a non-blocking socket.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <assert.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+
+#define FILESZ 100000
+#define OFFSET 1234
+#define LEN 50000
+
+using namespace TWlib;
+
+typedef BufBlk<Alloc_Std> Buf;
+
+char expect[16 + LEN + 16];
+int expectLen = 0;
+
+struct reader {
+	int fd;
+	int want;
+	char *got;
+};
+
+void *readAll( void *ptr ) {
+	reader *r = (reader *) ptr;
+	int n = 0;
+	while(n < r->want) {
+		int x = read(r->fd, r->got + n, r->want - n);
+		if(x <= 0) break;
+		n += x;
+	}
+	r->want = n;
+	return NULL;
+}
+
+char filebyte(int n) { return (char) ((n * 7) % 253); }
+
+// "HDR:" + file range + ":END"
+Buf *makeChain(int fd) {
+	Buf *b = new Buf(16);
+	b->copyFrom("HDR:", 4);
+	Buf *f = Buf::newFile(fd, OFFSET, LEN);
+	assert(f);
+	b->addToEnd(f);
+	Buf *t = new Buf(16);
+	t->copyFrom(":END", 4);
+	b->addToEnd(t);
+	return b;
+}
+
+int main()
+{
+	char path[] = "/tmp/test_bufblk_sendfileXXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	unlink(path);
+	char *data = (char *) malloc(FILESZ);
+	for(int n=0;n<FILESZ;n++)
+		data[n] = filebyte(n);
+	assert(write(fd, data, FILESZ) == FILESZ);
+
+	memcpy(expect, "HDR:", 4);
+	memcpy(expect + 4, data + OFFSET, LEN);
+	memcpy(expect + 4 + LEN, ":END", 4);
+	expectLen = LEN + 8;
+
+	// a file block reads like memory
+	Buf *f = Buf::newFile(fd, OFFSET, LEN);
+	assert(f->isFileBlk() && f->memblk()->isFile());
+	assert(f->length() == LEN && f->freespace() == 0);
+	assert(f->fileOffset() == OFFSET);
+	assert(memcmp(f->rd_ptr(), data + OFFSET, LEN) == 0);
+	f->inc_rd_ptr(100);
+	assert(f->fileOffset() == OFFSET + 100);
+	assert(!f->resize(LEN * 2));
+	Buf *d = f->duplicate();
+	f->release();
+	assert(d->rd_ptr()[0] == filebyte(OFFSET + 100));
+	d->release();
+
+	// over a socket
+	int sv[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	reader r;
+	r.fd = sv[1];
+	r.want = expectLen;
+	r.got = (char *) malloc(expectLen);
+	pthread_t t;
+	pthread_create(&t, NULL, readAll, &r);
+	Buf *c = makeChain(fd);
+	int sent = 0;
+	while(c->total_length() > 0) {
+		int x = c->sendTo(sv[0]);
+		assert(x > 0);
+		sent += x;
+	}
+	pthread_join(t, NULL);
+	assert(sent == expectLen && r.want == expectLen);
+	assert(memcmp(r.got, expect, expectLen) == 0);
+	c->release();
+
+	// non-blocking - partial sends, picked up where they left off
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	int bufsz = 4096;
+	setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &bufsz, sizeof(bufsz));
+	c = makeChain(fd);
+	int got = 0;
+	int rounds = 0;
+	while(got < expectLen) {
+		int x = c->sendTo(sv[0]);
+		if(x < 0) assert(errno == EAGAIN);
+		x = recv(sv[1], r.got + got, expectLen - got, MSG_DONTWAIT);
+		if(x > 0) got += x;
+		rounds++;
+	}
+	printf("non-blocking rounds: %d\n", rounds);
+	assert(rounds > 1);
+	assert(c->total_length() == 0);
+	assert(memcmp(r.got, expect, expectLen) == 0);
+	c->release();
+
+	// sendfile() refuses O_APPEND targets - falls back to write() from the mapping
+	char path2[] = "/tmp/test_bufblk_sendfile2XXXXXX";
+	int out = mkstemp(path2);
+	assert(out >= 0);
+	fcntl(out, F_SETFL, O_APPEND);
+	c = makeChain(fd);
+	assert(c->sendTo(out) == expectLen);
+	c->release();
+	assert(pread(out, r.got, expectLen, 0) == expectLen);
+	assert(memcmp(r.got, expect, expectLen) == 0);
+	close(out);
+	unlink(path2);
+
+	// closefd - the block owns the descriptor
+	int fd2 = dup(fd);
+	f = Buf::newFile(fd2, 0, 10, true);
+	f->release();
+	assert(fcntl(fd2, F_GETFD) < 0 && errno == EBADF);
+
+	close(sv[0]);
+	close(sv[1]);
+	close(fd);
+	free(data);
+	free(r.got);
+	printf("OK\n");
+	exit(0);
+}
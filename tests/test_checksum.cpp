@@ -0,0 +1,101 @@
+// test_checksum.cpp
+// Tests tw_crc32c() / tw_hash64() against known values, and the BufBlk chain versions against the
+// flat results for every way of splitting the data.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <assert.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+#include <TW/tw_checksum.h>
+
+#define DATASZ 1000
+#define BENCHSZ (64*1024*1024)
+
+using namespace TWlib;
+
+typedef BufBlk<Alloc_Std> Buf;
+
+char data[DATASZ];
+
+// data split into blocks at 'a' and 'b', w/ some junk in front of each rd_ptr
+Buf *split(int a, int b) {
+	int cuts[4] = { 0, a, b, DATASZ };
+	Buf *head = NULL;
+	for(int n=0;n<3;n++) {
+		int l = cuts[n+1] - cuts[n];
+		Buf *blk = new Buf(l + 3);
+		blk->copyFrom("xyz", 3);
+		blk->inc_rd_ptr(3);
+		blk->copyFrom(data + cuts[n], l);
+		if(head) head->addToEnd(blk);
+		else head = blk;
+	}
+	return head;
+}
+
+double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main()
+{
+	for(int n=0;n<DATASZ;n++)
+		data[n] = (char) ((n * 7) % 253);
+
+	printf("crc32c hw: %s\n", tw_crc32c_hw() ? "yes" : "no");
+	assert(tw_crc32c(0, "123456789", 9) == 0xE3069283);
+	assert(tw_crc32c_sw(0, "123456789", 9) == 0xE3069283);
+	assert(tw_crc32c(0, "", 0) == 0);
+	// hw and table agree, at any alignment and length
+	for(int off=0;off<9;off++)
+		for(int len=0;len<200;len++)
+			assert(tw_crc32c(0, data + off, len) == tw_crc32c_sw(0, data + off, len));
+	// running crc
+	assert(tw_crc32c(tw_crc32c(0, data, 300), data + 300, 700) == tw_crc32c(0, data, DATASZ));
+
+	assert(tw_hash64("", 0) == 0xEF46DB3751D8E999ULL);
+	assert(tw_hash64("abc", 3) == 0x44BC2CF5AD770999ULL);
+	assert(tw_hash64(data, DATASZ) == 0xF61AC9ADAFF4C35EULL);
+	assert(tw_hash64(data, DATASZ, 12345) == 0x4C3BFFF41C72B157ULL);
+
+	uint32_t crc = tw_crc32c(0, data, DATASZ);
+	uint64_t h = tw_hash64(data, DATASZ);
+	for(int a=0;a<=DATASZ;a+=37)
+		for(int b=a;b<=DATASZ;b+=41) {
+			Buf *chain = split(a, b);
+			assert(tw_crc32c_chain(chain) == crc);
+			assert(tw_hash64_chain(chain) == h);
+			chain->release();
+		}
+
+	// sub ranges, starting past the first block
+	Buf *chain = split(100, 500);
+	assert(tw_crc32c_chain(chain, 0, 250, 400) == tw_crc32c(0, data + 250, 400));
+	assert(tw_hash64_chain(chain, 7, 99, 2) == tw_hash64(data + 99, 2, 7));
+	assert(tw_hash64_chain(chain, 0, 600) == tw_hash64(data + 600, DATASZ - 600));
+	assert(tw_crc32c_chain(chain, 0, DATASZ) == 0);
+	chain->release();
+
+	char *big = (char *) malloc(BENCHSZ);
+	memset(big, 0x5A, BENCHSZ);
+	double t = now();
+	crc = tw_crc32c(0, big, BENCHSZ);
+	double thw = now() - t;
+	t = now();
+	assert(tw_crc32c_sw(0, big, BENCHSZ) == crc);
+	double tsw = now() - t;
+	t = now();
+	h = tw_hash64(big, BENCHSZ);
+	double th = now() - t;
+	printf("crc32c: %.0f MB/s  table: %.0f MB/s  hash64: %.0f MB/s\n", BENCHSZ / thw / 1e6, BENCHSZ / tsw / 1e6, BENCHSZ / th / 1e6);
+	free(big);
+
+	printf("OK\n");
+	exit(0);
+}
@@ -4,6 +4,7 @@
 // Author: ed
 
 #include <iostream>
+#include <assert.h>
 
 #include <TW/tw_densehash.h>
 #include <TW/tw_log.h>
@@ -179,6 +180,18 @@ int main() {
 		delete zstrs1[x];
 	}
 
+	// addNoreplace() stores a copy of the data it is given
+	{
+		string k("noreplace");
+		testdat d;
+		d.x = 42;
+		assert(testhash.addNoreplace(k, d));
+		d.x = 43;
+		assert(!testhash.addNoreplace(k, d));
+		assert(testhash.find(k, fill) && fill.x == 42);
+		cout << "addNoreplace: " << k << " = " << fill.x << endl;
+	}
+
 
 /*	cout << "iterate backward..." << endl;
 	ZSparseHash<ZString, testdat, ACE_Thread_Mutex, ZStrP_eqstr>::ZHashIterator iter2(testhash);
@@ -0,0 +1,135 @@
+/*
+ * test_khash_findmany.cpp
+ *
+ * Tests TW_KHash_32::findMany() against find() - hits, misses, an empty table, and batches which are not
+ * a multiple of TW_KHASH_PREFETCH_BATCH - and compares its speed w/ one find() per key on a table much
+ * bigger than the L2 cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_utils.h>
+#include <TW/tw_khash.h>
+
+using namespace TWlib;
+
+struct int_eqstrP {
+	inline int operator() (const int *l, const int *r) const { return (*l==*r); }
+};
+
+// a two part key (TW_KHash_32 moves its keys as bytes when it resizes, so keys are kept POD)
+struct EventKey {
+	int source;
+	int id;
+};
+
+struct event_eqstrP {
+	inline int operator() (const EventKey *l, const EventKey *r) const { return l->source == r->source && l->id == r->id; }
+};
+
+namespace TWlib {
+	template<>
+	struct tw_hash<int *> {
+		inline size_t operator()(int const * s) const { return (size_t) *s; }
+	};
+	template<>
+	struct tw_hash<EventKey *> {
+		inline size_t operator()(const EventKey *k) const {
+			return (size_t) TWlib::data_hash_Hsieh((const char *) k, sizeof(EventKey));
+		}
+	};
+}
+
+typedef Allocator<Alloc_Std> TESTAlloc;
+
+double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+#define BIG 2000000
+#define BATCH 128
+
+int main()
+{
+	{
+		TW_KHash_32<int, int, TW_Mutex, int_eqstrP, TESTAlloc> h;
+		int keys[300];
+		int *out[300];
+		for(int n=0;n<300;n++) keys[n] = n;
+		assert(h.findMany(keys, out, 300) == 0); // empty table
+		for(int n=0;n<300;n++)
+			assert(out[n] == NULL);
+		for(int n=0;n<1000;n+=3)
+			h.addNoreplace(n, n);
+		for(int len=0;len<=300;len+=37) {
+			int got = h.findMany(keys, out, len);
+			int want = 0;
+			for(int n=0;n<len;n++) {
+				assert(out[n] == h.find(keys[n]));
+				if(out[n]) {
+					assert(*out[n] == keys[n]);
+					want++;
+				}
+			}
+			assert(got == want);
+		}
+	}
+
+	{
+		TW_KHash_32<EventKey, int, TW_RWMutex, event_eqstrP, TESTAlloc> h;
+		EventKey keys[100];
+		int *out[100];
+		for(int n=0;n<100;n++) {
+			keys[n].source = n % 7;
+			keys[n].id = n;
+			if(n % 2) h.addNoreplace(keys[n], n);
+		}
+		assert(h.findMany(keys, out, 100) == 50);
+		for(int n=0;n<100;n++)
+			assert((n % 2) ? (out[n] && *out[n] == n) : out[n] == NULL);
+	}
+
+	// speed, on a table well past the L2 cache
+	{
+		TW_KHash_32<int, int, TW_NoMutex, int_eqstrP, TESTAlloc> h(NULL, BIG);
+		for(int n=0;n<BIG;n++)
+			h.addNoreplace(n, n);
+		int *keys = new int[BIG];
+		int **out = new int*[BATCH];
+		unsigned int r = 1;
+		for(int n=0;n<BIG;n++) {
+			r = r * 1103515245 + 12345;
+			keys[n] = (int) ((r >> 4) % (BIG + BIG / 4)); // ~20% misses
+		}
+		long long s1 = 0, s2 = 0;
+		double t = now();
+		for(int n=0;n<BIG;n++) {
+			int *d = h.find(keys[n]);
+			if(d) s1 += *d;
+		}
+		double tone = now() - t;
+		t = now();
+		for(int n=0;n<BIG;n+=BATCH) {
+			int c = (BIG - n < BATCH) ? BIG - n : BATCH;
+			h.findMany(keys + n, out, c);
+			for(int j=0;j<c;j++)
+				if(out[j]) s2 += *out[j];
+		}
+		double tmany = now() - t;
+		assert(s1 == s2);
+		printf("%d lookups in a %d entry table: find() %.1f ns  findMany(%d) %.1f ns per key\n", BIG, BIG,
+				tone * 1e9 / BIG, BATCH, tmany * 1e9 / BIG);
+		delete[] keys;
+		delete[] out;
+	}
+
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,178 @@
+/*
+ * test_khash_inline.cpp
+ *
+ * Tests TW_KHash_32_Inline against a std::map, checks every value it constructs is destroyed, and compares
+ * its memory use and lookup speed with TW_KHash_32.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include <map>
+#include <string>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_alloc_stats.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_utils.h>
+#include <TW/tw_khash.h>
+#include <TW/tw_khash_inline.h>
+
+using namespace TWlib;
+using namespace std;
+
+// counts live objects - and only has a TESTD(TESTD &) copy constructor, like the tests in test_hashes.cpp
+int live = 0;
+class TESTD {
+public:
+	int x;
+	TESTD() : x(0) { live++; }
+	TESTD(TESTD &d) : x(d.x) { live++; }
+	TESTD &operator=(const TESTD &o) { x = o.x; return *this; }
+	~TESTD() { live--; }
+};
+
+struct int_eqstrP {
+	inline int operator() (const int *l, const int *r) const { return (*l==*r); }
+};
+
+struct string_eqstrP {
+	inline int operator() (const string *l, const string *r) const { return (l->compare(*r) == 0); }
+};
+
+namespace TWlib {
+	template<>
+	struct tw_hash<int *> {
+		inline size_t operator()(int const * s) const { return (size_t) *s; }
+	};
+	template<>
+	struct tw_hash<std::string *> {
+		inline size_t operator()(const std::string *s) const {
+			return (size_t) TWlib::data_hash_Hsieh(s->c_str(),s->length());
+		}
+	};
+}
+
+struct InlineTag {};
+struct PtrTag {};
+typedef Allocator<Alloc_Std> TESTAlloc;
+typedef Allocator<Alloc_Stats<Alloc_Std, InlineTag> > InlineAlloc;
+typedef Allocator<Alloc_Stats<Alloc_Std, PtrTag> > PtrAlloc;
+
+double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+#define BENCH_N 1000000
+
+int main()
+{
+	{
+		TW_KHash_32_Inline<int, TESTD, TW_Mutex, int_eqstrP, TESTAlloc> h;
+		for(int n=0;n<100000;n++) {
+			TESTD *d = h.addNoreplaceNew(n);
+			assert(d);
+			d->x = n * 3;
+		}
+		assert(h.addNoreplaceNew(5) == NULL);
+		assert(h.size() == 100000 && live == 100000);
+		for(int n=0;n<100000;n++)
+			assert(h.find(n)->x == n * 3);
+		assert(h.find(-1) == NULL);
+		TESTD t;
+		t.x = 7;
+		assert(!h.addNoreplace(1, t));
+		assert(h.addReplace(1, t) && h.find(1)->x == 7);
+		TESTD old;
+		t.x = 8;
+		assert(h.addReplace(1, t, old) && old.x == 7);
+		for(int n=0;n<100000;n+=2)
+			assert(h.remove(n));
+		assert(!h.remove(0));
+		assert(h.size() == 50000 && live == 50000 + 2);
+		TESTD fill;
+		assert(h.remove(3, fill) && fill.x == 9);
+		assert(h.find(5, fill) && fill.x == 15);
+		assert(h.findOrNew(5)->x == 15);
+		assert(h.findOrNew(4)->x == 0);
+		assert(h.addReplaceNew(5)->x == 0);
+		// iterate
+		int c = 0;
+		TW_KHash_32_Inline<int, TESTD, TW_Mutex, int_eqstrP, TESTAlloc>::HashIterator it(h);
+		while(!it.atEnd()) {
+			assert(h.find(*it.key()) == it.data());
+			c++;
+			it.getNext();
+		}
+		it.release();
+		assert(c == h.size());
+		assert(h.removeAll() && h.size() == 0 && live == 3);
+		h.findOrNew(12)->x = 1;
+	}
+	assert(live == 0);
+
+	// non trivial keys and values, across many resizes and deletes, against std::map
+	{
+		TW_KHash_32_Inline<string, string, TW_NoMutex, string_eqstrP, TESTAlloc> h;
+		map<string, string> ref;
+		srand(7);
+		char k[32], v[64];
+		for(int n=0;n<200000;n++) {
+			snprintf(k, sizeof(k), "key-%d", rand() % 5000);
+			string key(k);
+			int op = rand() % 4;
+			if(op < 2) {
+				snprintf(v, sizeof(v), "value %d of a string long enough to be on the heap", n);
+				string val(v);
+				h.addReplace(key, val);
+				ref[key] = val;
+			} else if(op == 2) {
+				assert(h.remove(key) == (ref.erase(key) == 1));
+			} else {
+				string *s = h.find(key);
+				map<string, string>::iterator i = ref.find(key);
+				assert((s == NULL) == (i == ref.end()));
+				if(s) assert(*s == i->second);
+			}
+		}
+		assert(h.size() == (int) ref.size());
+	}
+
+	// memory and speed vs. TW_KHash_32, int -> int
+	{
+		tw_alloc_stats si, sp;
+		TW_KHash_32_Inline<int, int, TW_NoMutex, int_eqstrP, InlineAlloc> hi;
+		TW_KHash_32<int, int, TW_NoMutex, int_eqstrP, PtrAlloc> hp;
+		for(int n=0;n<BENCH_N;n++) {
+			int v = n;
+			hi.addNoreplace(n * 7, v);
+			hp.addNoreplace(n * 7, v);
+		}
+		Alloc_Stats<Alloc_Std, InlineTag>::snapshot(si);
+		Alloc_Stats<Alloc_Std, PtrTag>::snapshot(sp);
+		printf("%d entries: inline %lld bytes in %llu allocations, TW_KHash_32 %lld bytes in %llu allocations\n", BENCH_N,
+				(long long) si.liveBytes, (unsigned long long) si.allocs, (long long) sp.liveBytes, (unsigned long long) sp.allocs);
+		// at least half, w/ a (low) 16 bytes of malloc overhead per allocation
+		assert(2 * (si.liveBytes + 16 * si.liveBlocks) <= sp.liveBytes + 16 * sp.liveBlocks);
+		long long sum = 0;
+		double t = now();
+		for(int r=0;r<4;r++)
+			for(int n=0;n<BENCH_N;n++)
+				sum += *hi.find((int) (((long long) n * 7919) % BENCH_N) * 7);
+		double ti = now() - t;
+		t = now();
+		for(int r=0;r<4;r++)
+			for(int n=0;n<BENCH_N;n++)
+				sum -= *hp.find((int) (((long long) n * 7919) % BENCH_N) * 7);
+		double tp = now() - t;
+		assert(sum == 0);
+		printf("lookups: inline %.1f ns  TW_KHash_32 %.1f ns\n", ti * 1e9 / (4.0 * BENCH_N), tp * 1e9 / (4.0 * BENCH_N));
+	}
+
+	printf("OK\n");
+	exit(0);
+}
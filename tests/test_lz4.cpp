@@ -0,0 +1,279 @@
+// test_lz4.cpp
+// Tests the built in LZ4 block codec, and compressing / decompressing BufBlk chains in chunks.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_bufblk.h>
+#include <TW/tw_bufblk_pool.h>
+#include <TW/tw_lz4.h>
+
+#define TEXTSZ 300000
+
+using namespace TWlib;
+
+typedef BufBlk<Alloc_Std> Buf;
+typedef BufBlkPool<Alloc_Std> Pool;
+
+char *text;
+
+// Alloc_Std, which runs out of memory after 'left' more malloc()s (-1: never)
+struct Alloc_Failing : public Alloc_Std {
+	static int left;
+	static void *malloc( tw_size nbytes ) {
+		if(left == 0) return NULL;
+		if(left > 0) left--;
+		return ::malloc((size_t) nbytes);
+	}
+};
+int Alloc_Failing::left = -1;
+
+// something like our payloads - repetitive text, w/ some numbers changing
+void makeText() {
+	text = (char *) malloc(TEXTSZ);
+	int n = 0;
+	int rec = 0;
+	while(n < TEXTSZ) {
+		char line[128];
+		int l = snprintf(line, sizeof(line), "{\"id\":%d,\"name\":\"sensor-%d\",\"value\":%d,\"status\":\"ok\"}\n", rec, rec % 17, (rec * 7919) % 1000);
+		if(n + l > TEXTSZ) l = TEXTSZ - n;
+		memcpy(text + n, line, l);
+		n += l;
+		rec++;
+	}
+}
+
+// the data in blocks of 'blksz'
+Buf *chainOf(const char *d, int len, int blksz) {
+	Buf *head = NULL;
+	while(len > 0) {
+		int l = (len < blksz) ? len : blksz;
+		Buf *b = new Buf(l);
+		b->copyFrom(d, l);
+		if(head) head->addToEnd(b);
+		else head = b;
+		d += l;
+		len -= l;
+	}
+	return head;
+}
+
+bool chainEquals(Buf *b, const char *d, int len) {
+	if(!b) return len == 0;
+	if(b->total_length() != len) return false;
+	for(; b; b = b->nexblk()) {
+		if(memcmp(b->rd_ptr(), d, b->length())) return false;
+		d += b->length();
+	}
+	return true;
+}
+
+void roundtrip(const char *d, int len, int blksz, int chunk, Pool *pool) {
+	Buf *in = chainOf(d, len, blksz);
+	Buf *z = tw_lz4_compress_chain(in, pool, chunk);
+	bool ok = false;
+	Buf *out = tw_lz4_decompress_chain(z, pool, &ok);
+	assert(ok);
+	assert(chainEquals(out, d, len));
+	// and when the compressed frames are cut up at odd places
+	if(z) {
+		int zl = z->total_length();
+		char *flat = (char *) malloc(zl);
+		int c = 0;
+		BufBlkIter<Alloc_Std> it(*z);
+		it.copyNextChunks(flat, zl, c);
+		Buf *z2 = chainOf(flat, zl, 777);
+		Buf *out2 = tw_lz4_decompress_chain(z2, pool, &ok);
+		assert(ok);
+		assert(chainEquals(out2, d, len));
+		out2->release();
+		z2->release();
+		free(flat);
+		z->release();
+	}
+	if(out) out->release();
+	if(in) in->release();
+}
+
+int main()
+{
+	makeText();
+
+	// raw block codec
+	char *z = (char *) malloc(tw_lz4_bound(TEXTSZ));
+	char *back = (char *) malloc(TEXTSZ);
+	int zl = tw_lz4_compress(text, TEXTSZ, z, tw_lz4_bound(TEXTSZ));
+	printf("block: %d -> %d\n", TEXTSZ, zl);
+	assert(zl > 0 && zl < TEXTSZ / 3);
+	assert(tw_lz4_decompress(z, zl, back, TEXTSZ) == TEXTSZ);
+	assert(memcmp(back, text, TEXTSZ) == 0);
+	assert(tw_lz4_decompress(z, zl, back, TEXTSZ - 1) == -1); // too small a destination
+	assert(tw_lz4_compress(text, TEXTSZ, z, 100) == 0);        // too small a destination
+	for(int len=0;len<40;len++) { // short inputs are all literals
+		int l = tw_lz4_compress(text, len, z, tw_lz4_bound(len));
+		assert(l > 0);
+		assert(tw_lz4_decompress(z, l, back, len) == len);
+		assert(memcmp(back, text, len) == 0);
+	}
+	// overlapping matches - runs
+	memset(back, 'a', 1000);
+	zl = tw_lz4_compress(back, 1000, z, tw_lz4_bound(1000));
+	assert(zl < 20);
+	char run[1000];
+	assert(tw_lz4_decompress(z, zl, run, 1000) == 1000);
+	assert(memcmp(run, back, 1000) == 0);
+	// garbage doesn't crash
+	srand(1);
+	for(int n=0;n<1000;n++) {
+		for(int x=0;x<64;x++) z[x] = (char) rand();
+		tw_lz4_decompress(z, 64, back, TEXTSZ);
+	}
+
+	// chains, with and without a pool
+	Pool pool;
+	roundtrip(text, TEXTSZ, 1500, TW_LZ4_CHUNK_SIZE, &pool);
+	roundtrip(text, TEXTSZ, 100000, 4096, &pool);
+	roundtrip(text, TEXTSZ, 333, 1000, NULL);
+	roundtrip(text, 10, 3, 4, NULL);
+	roundtrip(text, 0, 3, 4, NULL);
+	char *noise = (char *) malloc(50000);
+	for(int n=0;n<50000;n++) noise[n] = (char) rand();
+	roundtrip(noise, 50000, 4096, 8192, &pool);
+
+	// w/ the default chunk size and pool, output blocks are pooled - sized to their frame, not the worst case
+	{
+		Pool dp;
+		Buf *in = chainOf(text, 256 * 1024, 4096);
+		for(int r=0;r<3;r++) {
+			Buf *z = tw_lz4_compress_chain(in, &dp);
+			for(Buf *look = z; look; look = look->nexblk())
+				assert(look->capacity() < 2 * look->length() + TW_BUFBLK_POOL_MIN);
+			z->release();
+		}
+		in->release();
+		tw_bufblk_pool_stats st;
+		dp.getStats(st);
+		printf("default pool: hits %llu misses %llu oversize %llu\n", (unsigned long long) st.hits,
+				(unsigned long long) st.misses, (unsigned long long) st.oversize);
+		assert(st.oversize == 0 && st.hits > 0);
+	}
+
+	// chunks whose worst case fits a pool class are compressed straight into pooled blocks
+	{
+		Pool dp;
+		Buf *in = chainOf(text, 100000, 4096);
+		Buf *z = tw_lz4_compress_chain(in, &dp, 4096);
+		for(Buf *look = z; look; look = look->nexblk())
+			assert(look->capacity() == dp.classSize(TW_LZ4_FRAME_HDR + tw_lz4_bound(4096)) || look->nexblk() == NULL);
+		tw_bufblk_pool_stats st;
+		dp.getStats(st);
+		assert(st.oversize == 0);
+		bool ok;
+		Buf *out = tw_lz4_decompress_chain(z, &dp, &ok);
+		assert(ok && chainEquals(out, text, 100000));
+		out->release();
+		z->release();
+		in->release();
+	}
+
+	// out of memory at every allocation, in and out - w/ and w/o a pool
+	{
+		BufBlkPool<Alloc_Failing> fp(TW_BUFBLK_POOL_MIN, TW_BUFBLK_POOL_MAX, 0); // nothing cached - every get() allocates
+		BufBlk<Alloc_Failing> *in = new BufBlk<Alloc_Failing>(30000);
+		in->copyFrom(text, 30000);
+		BufBlk<Alloc_Failing> *front = new BufBlk<Alloc_Failing>(30000);
+		BufBlk<Alloc_Failing> *back2 = new BufBlk<Alloc_Failing>(30000);
+		int fails = 0;
+		for(int p=0;p<2;p++) {
+			BufBlkPool<Alloc_Failing> *pool = p ? &fp : NULL;
+			for(int n=0;;n++) {
+				bool ok;
+				Alloc_Failing::left = n;
+				BufBlk<Alloc_Failing> *z = tw_lz4_compress_chain(in, pool, 4096, &ok);
+				Alloc_Failing::left = -1;
+				if(!ok) {
+					assert(z == NULL);
+					fails++;
+					continue;
+				}
+				assert(z);
+				// frames straddling blocks need the scratch buffer on the way back
+				int half = z->total_length() / 2 + 3;
+				front->reset();
+				back2->reset();
+				for(BufBlk<Alloc_Failing> *look = z; look; look = look->nexblk()) {
+					int l = look->length();
+					int f = (front->length() + l <= half) ? l : half - front->length();
+					front->copyFrom(look->rd_ptr(), f);
+					back2->copyFrom(look->rd_ptr() + f, l - f);
+				}
+				front->setNexblk(back2);
+				for(int m=0;;m++) {
+					Alloc_Failing::left = m;
+					BufBlk<Alloc_Failing> *out = tw_lz4_decompress_chain(front, pool, &ok);
+					Alloc_Failing::left = -1;
+					if(ok) {
+						assert(out && out->total_length() == 30000);
+						out->release();
+						break;
+					}
+					assert(out == NULL);
+					fails++;
+				}
+				front->setNexblk(NULL);
+				z->release();
+				break;
+			}
+		}
+		assert(fails > 4);
+		front->release();
+		back2->release();
+		in->release();
+	}
+
+	// random data is stored, not grown
+	Buf *in = chainOf(noise, 50000, 4096);
+	Buf *zc = tw_lz4_compress_chain(in, &pool, 8192);
+	assert(zc->total_length() <= 50000 + 7 * TW_LZ4_FRAME_HDR);
+	zc->release();
+	in->release();
+
+	// compressing while producing
+	LZ4ChainCompressor<Alloc_Std> c(&pool, 16384);
+	Buf *all = NULL;
+	for(int n=0;n<TEXTSZ;n+=1000) {
+		c.add(text + n, (TEXTSZ - n < 1000) ? TEXTSZ - n : 1000);
+		Buf *part = c.takeOutput();
+		if(part) {
+			if(all) all->addToEnd(part);
+			else all = part;
+		}
+	}
+	assert(all); // frames come out before finish()
+	all->addToEnd(c.finish());
+	printf("stream: %llu -> %llu\n", (unsigned long long) c.rawBytes(), (unsigned long long) c.compressedBytes());
+	assert((int) c.compressedBytes() == all->total_length());
+	bool ok;
+	Buf *out = tw_lz4_decompress_chain(all, &pool, &ok);
+	assert(ok && chainEquals(out, text, TEXTSZ));
+	out->release();
+
+	// corrupt / truncated input
+	all->nexblk()->rd_ptr()[20] ^= 0x55;
+	out = tw_lz4_decompress_chain(all, &pool, &ok);
+	if(out) out->release(); // a flipped byte may still decode - but never past its frame
+	all->eatBytes(all->total_length() - 5, 5);
+	out = tw_lz4_decompress_chain(all, &pool, &ok);
+	assert(!ok && out == NULL);
+	all->release();
+
+	free(noise);
+	free(z);
+	free(back);
+	free(text);
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,228 @@
+/*
+ * test_rwlock_hash.cpp
+ *
+ * Tests TW_RWMutex and TW_SeqLock, and the hash tables using them as their MUTEX: shared find()s w/ a
+ * TW_RWMutex, and lock free find()s in TW_KHash_32_Inline w/ a TW_SeqLock - which must never return a
+ * torn value, or miss a key which is there, while writers add, remove and resize under it.
+ * Then compares read mostly throughput w/ TW_Mutex, TW_RWMutex and TW_SeqLock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <atomic>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_utils.h>
+#include <TW/tw_khash.h>
+#include <TW/tw_khash_inline.h>
+#include <TW/tw_stringmap.h>
+
+using namespace TWlib;
+
+struct int_eqstrP {
+	inline int operator() (const int *l, const int *r) const { return (*l==*r); }
+};
+
+namespace TWlib {
+	template<>
+	struct tw_hash<int *> {
+		inline size_t operator()(int const * s) const { return (size_t) *s; }
+	};
+}
+
+typedef Allocator<Alloc_Std> TESTAlloc;
+
+// a value which shows if it was read while half written
+struct Pair {
+	long a;
+	long b; // always ~a
+};
+
+typedef TW_KHash_32_Inline<int, Pair, TW_SeqLock, int_eqstrP, TESTAlloc> SeqMap;
+static_assert(SeqMap::optimisticFind, "TW_SeqLock + POD types should read w/o a lock");
+static_assert(!TW_KHash_32_Inline<int, Pair, TW_RWMutex, int_eqstrP, TESTAlloc>::optimisticFind, "");
+
+double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+TW_RWMutex rw;
+void *tryRead( void * ) {
+	int r = rw.tryAcquireRead();
+	if(r == 0) rw.releaseRead();
+	return (void *) (long) r;
+}
+void *tryWrite( void * ) {
+	int r = rw.tryAcquire();
+	if(r == 0) rw.release();
+	return (void *) (long) r;
+}
+long inThread( void *(*f)(void *) ) {
+	pthread_t t;
+	void *r;
+	pthread_create(&t, NULL, f, NULL);
+	pthread_join(t, &r);
+	return (long) r;
+}
+
+#define STABLE 5000      // keys 0..STABLE-1 are always in the table
+#define READERS 3
+std::atomic<bool> stop(false);
+
+// rewrites the stable keys' values, and adds / removes churn keys - growing and rehashing the table
+void *seqWriter( void *ptr ) {
+	SeqMap *m = (SeqMap *) ptr;
+	long x = 0;
+	while(!stop.load()) {
+		for(int n=0;n<STABLE && !stop.load();n+=7) {
+			Pair p;
+			p.a = ++x;
+			p.b = ~p.a;
+			m->addReplace(n, p);
+		}
+		for(int n=0;n<20000;n++) {
+			Pair p = { n, ~(long) n };
+			m->addReplace(STABLE + (int) ((x + n) % 100000), p);
+		}
+		for(int n=0;n<20000;n++)
+			m->remove(STABLE + (int) ((x + n) % 100000));
+	}
+	return NULL;
+}
+
+void *seqReader( void *ptr ) {
+	SeqMap *m = (SeqMap *) ptr;
+	long reads = 0;
+	unsigned int k = 1;
+	double end = now() + 1.0;
+	while(now() < end) {
+		for(int n=0;n<1000;n++) {
+			k = k * 1103515245 + 12345;
+			Pair p;
+			int key = (int) ((k >> 8) % STABLE);
+			assert(m->find(key, p));
+			assert(p.b == ~p.a);
+			reads++;
+		}
+	}
+	return (void *) reads;
+}
+
+// read mostly - 1 write per 100 finds
+template<typename MUTEX>
+struct Bench {
+	typedef TW_KHash_32<int, int, MUTEX, int_eqstrP, TESTAlloc> Map;
+	static void *run( void *ptr ) {
+		Map *m = (Map *) ptr;
+		unsigned int k = 7;
+		int found = 0;
+		for(int n=0;n<400000;n++) {
+			k = k * 1103515245 + 12345;
+			int key = (int) ((k >> 8) % 50000);
+			int v;
+			if(n % 100 == 0)
+				m->addReplace(key, key);
+			else if(m->find(key, v))
+				found++;
+		}
+		return (void *) (long) found;
+	}
+	static double mops() {
+		Map m;
+		for(int n=0;n<50000;n+=2)
+			m.addReplace(n, n);
+		pthread_t t[4];
+		double start = now();
+		for(int n=0;n<4;n++)
+			pthread_create(&t[n], NULL, run, &m);
+		for(int n=0;n<4;n++)
+			pthread_join(t[n], NULL);
+		return 4 * 400000 / (now() - start) / 1e6;
+	}
+};
+
+int main()
+{
+	// TW_RWMutex: readers share, a writer excludes
+	assert(rw.acquireRead() == 0);
+	assert(inThread(tryRead) == 0);
+	assert(inThread(tryWrite) != 0);
+	rw.releaseRead();
+	assert(rw.acquire() == 0);
+	assert(inThread(tryRead) != 0);
+	rw.release();
+	assert(inThread(tryWrite) == 0);
+
+	// TW_SeqLock
+	{
+		TW_SeqLock sl;
+		uint32_t s = sl.readBegin();
+		assert(sl.readValidate(s));
+		sl.acquireRead(); // a locked reader does not invalidate optimistic ones
+		sl.releaseRead();
+		assert(sl.readValidate(s));
+		sl.acquire();
+		assert(!sl.readValidate(s));
+		sl.release();
+		assert(!sl.readValidate(s));
+		s = sl.readBegin();
+		assert(sl.readValidate(s));
+		assert(sl.tryAcquire() == 0);
+		sl.release();
+		assert(!sl.readValidate(s));
+	}
+
+	// drop in MUTEX for the existing tables
+	{
+		TW_KHash_32<int, int, TW_RWMutex, int_eqstrP, TESTAlloc> h;
+		for(int n=0;n<1000;n++)
+			h.addNoreplace(n, n);
+		int v = 0;
+		assert(h.find(10, v) && v == 10 && *h.find(20) == 20 && !h.find(-1));
+		TW_StringMapGeneric<int, TW_RWMutex, TESTAlloc> sm;
+		const char *k = "key";
+		int one = 1;
+		sm.addReplace(k, one);
+		assert(sm.find(k, v) && v == 1);
+		TW_KHash_32_Inline<int, Pair, TW_SeqLock, int_eqstrP, TESTAlloc> si; // locked paths of the seqlock map
+		Pair p = { 1, ~1L };
+		si.addReplace(3, p);
+		assert(si.find(3)->a == 1 && si.find(3, p) && p.b == ~1L && !si.find(4, p));
+		assert(si.remove(3) && !si.find(3, p));
+	}
+
+	// lock free find()s, w/ a writer resizing the table under them
+	{
+		SeqMap m;
+		for(int n=0;n<STABLE;n++) {
+			Pair p = { n, ~(long) n };
+			m.addReplace(n, p);
+		}
+		pthread_t w, r[READERS];
+		pthread_create(&w, NULL, seqWriter, &m);
+		for(int n=0;n<READERS;n++)
+			pthread_create(&r[n], NULL, seqReader, &m);
+		long reads = 0;
+		for(int n=0;n<READERS;n++) {
+			void *c;
+			pthread_join(r[n], &c);
+			reads += (long) c;
+		}
+		stop.store(true);
+		pthread_join(w, NULL);
+		printf("%ld optimistic reads w/ a concurrent writer, %d buckets\n", reads, m.buckets());
+		assert(reads > 0 && m.size() >= STABLE);
+	}
+
+	printf("4 threads, read mostly, TW_KHash_32: TW_Mutex %.2f  TW_RWMutex %.2f Mops/s\n",
+			Bench<TW_Mutex>::mops(), Bench<TW_RWMutex>::mops());
+	printf("OK\n");
+	exit(0);
+}
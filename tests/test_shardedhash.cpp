@@ -0,0 +1,219 @@
+/*
+ * test_shardedhash.cpp
+ *
+ * Tests TW_ShardedHash: against a std::map, key spread over the shards, iteration across (empty) shards,
+ * many threads adding / finding / removing at once, and read mostly throughput vs. a single locked table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <map>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_utils.h>
+#include <TW/tw_khash.h>
+#include <TW/tw_shardedhash.h>
+
+using namespace TWlib;
+using namespace std;
+
+struct int_eqstrP {
+	inline int operator() (const int *l, const int *r) const { return (*l==*r); }
+};
+
+namespace TWlib {
+	template<>
+	struct tw_hash<int *> {
+		inline size_t operator()(int const * s) const { return (size_t) *s; }
+	};
+}
+
+typedef Allocator<Alloc_Std> TESTAlloc;
+
+// an allocator which can be told to run out of memory
+struct Alloc_Flaky : public Alloc_Std {
+	static bool fail;
+	static void *malloc (tw_size nbytes) { return fail ? NULL : ::malloc((size_t) nbytes); }
+};
+bool Alloc_Flaky::fail = false;
+typedef TW_ShardedHash<int, int, TW_Mutex, int_eqstrP, TESTAlloc> ShardedMap;
+
+double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+#define THREADS 8
+#define PER_THREAD 20000
+
+struct threadinfo {
+	int threadnum;
+	ShardedMap *map;
+	int ops;
+};
+
+// each thread adds, checks and removes its own keys - and reads the shared keys 0..PER_THREAD-1
+void *worker( void *ptr ) {
+	threadinfo *inf = (threadinfo *) ptr;
+	int base = (inf->threadnum + 1) * PER_THREAD;
+	for(int n=0;n<PER_THREAD;n++) {
+		int v = n + base;
+		assert(inf->map->addNoreplace(n + base, v));
+		int *shared = inf->map->find(n);
+		assert(shared && *shared == n);
+	}
+	for(int n=0;n<PER_THREAD;n++) {
+		int fill = 0;
+		assert(inf->map->find(n + base, fill) && fill == n + base);
+		if(n % 2)
+			assert(inf->map->remove(n + base));
+	}
+	return NULL;
+}
+
+// 99 finds : 1 replace
+void *readMostly( void *ptr ) {
+	threadinfo *inf = (threadinfo *) ptr;
+	unsigned int k = inf->threadnum * 7919;
+	int found = 0;
+	for(int n=0;n<inf->ops;n++) {
+		k = k * 1103515245 + 12345;
+		int key = (int) ((k >> 8) % 100000);
+		if(n % 100 == 0)
+			inf->map->addReplace(key, key);
+		else if(inf->map->find(key))
+			found++;
+	}
+	assert(found > 0);
+	return NULL;
+}
+
+double runThreads( ShardedMap &map, void *(*func)(void *), int ops ) {
+	pthread_t threads[THREADS];
+	threadinfo infos[THREADS];
+	double t = now();
+	for(int n=0;n<THREADS;n++) {
+		infos[n].threadnum = n;
+		infos[n].map = &map;
+		infos[n].ops = ops;
+		pthread_create(&threads[n], NULL, func, &infos[n]);
+	}
+	for(int n=0;n<THREADS;n++)
+		pthread_join(threads[n], NULL);
+	return now() - t;
+}
+
+int main()
+{
+	{
+		ShardedMap h(12); // -> 16
+		assert(h.shards() == 16);
+		map<int, int> ref;
+		srand(5);
+		for(int n=0;n<200000;n++) {
+			int k = rand() % 20000;
+			int op = rand() % 3;
+			if(op == 0) {
+				h.addReplace(k, n);
+				ref[k] = n;
+			} else if(op == 1) {
+				assert(h.remove(k) == (ref.erase(k) == 1));
+			} else {
+				int *d = h.find(k);
+				map<int, int>::iterator i = ref.find(k);
+				assert((d == NULL) == (i == ref.end()));
+				if(d) assert(*d == i->second);
+			}
+		}
+		assert(h.size() == (int) ref.size());
+		// sequential keys spread evenly
+		h.removeAll();
+		assert(h.size() == 0);
+		for(int n=0;n<160000;n++)
+			h.addNoreplace(n, n);
+		for(int s=0;s<h.shards();s++) {
+			int c = h.shard(s).size();
+			assert(c > 10000 / 2 && c < 10000 * 2);
+		}
+		assert(h.shardIndex(5) == h.shardIndex(5) && h.shard(h.shardIndex(5)).find(5));
+		// and it is all in the shards' own tables
+		int sum = 0;
+		for(int s=0;s<h.shards();s++)
+			sum += h.shard(s).size();
+		assert(sum == 160000);
+	}
+
+	// iterate over more shards than keys
+	{
+		ShardedMap h(64, NULL, 100);
+		ShardedMap::HashIterator e(h);
+		assert(e.atEnd() && e.key() == NULL && !e.getNext());
+		for(int n=0;n<10;n++)
+			h.addNoreplace(n * 3, n);
+		int c = 0, keys = 0;
+		ShardedMap::HashIterator it(h);
+		while(!it.atEnd()) {
+			assert(*it.data() == *it.key() / 3);
+			keys += *it.key();
+			c++;
+			it.getNext();
+		}
+		it.release();
+		assert(c == 10 && keys == 3 * 45);
+		ShardedMap::HashIterator it2(h); // released by the destructor
+		*it2.data() = 12;
+		assert(*h.find(*it2.key()) == 12);
+	}
+
+	// no memory for the shards - everything fails, nothing crashes
+	{
+		Alloc_Flaky::fail = true;
+		TW_ShardedHash<int, int, TW_Mutex, int_eqstrP, Allocator<Alloc_Flaky> > h(8);
+		Alloc_Flaky::fail = false;
+		int v = 1;
+		assert(h.shards() == 0 && h.shardIndex(1) == -1);
+		assert(!h.addNoreplace(1, v) && !h.addReplace(1, v) && h.addReplaceNew(1) == NULL && h.findOrNew(1) == NULL);
+		assert(h.find(1) == NULL && !h.find(1, v) && !h.remove(1));
+		assert(h.size() == 0 && h.removeAll());
+		TW_ShardedHash<int, int, TW_Mutex, int_eqstrP, Allocator<Alloc_Flaky> >::HashIterator it(h);
+		assert(it.atEnd());
+	}
+
+	// many threads at once
+	{
+		ShardedMap h(32);
+		for(int n=0;n<PER_THREAD;n++)
+			h.addNoreplace(n, n);
+		runThreads(h, worker, 0);
+		assert(h.size() == PER_THREAD + THREADS * PER_THREAD / 2);
+		for(int t=0;t<THREADS;t++) {
+			int base = (t + 1) * PER_THREAD;
+			for(int n=0;n<PER_THREAD;n++)
+				assert((h.find(n + base) != NULL) == (n % 2 == 0));
+		}
+	}
+
+	// read mostly throughput: one shard (the same as one TW_KHash_32 and its lock) vs. many
+	{
+		int ops = 500000;
+		double t[2];
+		int counts[2] = { 1, 64 };
+		for(int c=0;c<2;c++) {
+			ShardedMap h(counts[c]);
+			for(int n=0;n<100000;n+=2)
+				h.addNoreplace(n, n);
+			t[c] = runThreads(h, readMostly, ops);
+		}
+		printf("%d threads, read mostly: 1 shard %.2f Mops/s  %d shards %.2f Mops/s\n", THREADS,
+				THREADS * ops / t[0] / 1e6, counts[1], THREADS * ops / t[1] / 1e6);
+	}
+
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,247 @@
+/*
+ * test_swisshash.cpp
+ *
+ * Tests TW_SwissHash against a std::map - including heavy delete churn, which leaves deleted buckets
+ * behind - checks every value it constructs is destroyed, and benchmarks hit and miss lookups against
+ * TW_KHash_32 and TW_KHash_32_Inline (and TWDenseHash / TWSparseHash, where the google sparsehash
+ * headers are installed).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include <map>
+#include <string>
+
+#include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_utils.h>
+#include <TW/tw_khash.h>
+#include <TW/tw_khash_inline.h>
+#include <TW/tw_swisshash.h>
+
+#if defined(__has_include)
+#if __has_include(<google/dense_hash_map>) && __has_include(<google/sparse_hash_map>)
+#define HAVE_GOOGLE_HASH
+#include <TW/tw_densehash.h>
+#include <TW/tw_sparsehash.h>
+#endif
+#endif
+
+using namespace TWlib;
+using namespace std;
+
+// counts live objects - and only has a TESTD(TESTD &) copy constructor, like the tests in test_hashes.cpp
+int live = 0;
+class TESTD {
+public:
+	int x;
+	TESTD() : x(0) { live++; }
+	TESTD(TESTD &d) : x(d.x) { live++; }
+	TESTD &operator=(const TESTD &o) { x = o.x; return *this; }
+	~TESTD() { live--; }
+};
+
+struct int_eqstrP {
+	inline int operator() (const int *l, const int *r) const { return (*l==*r); }
+};
+
+struct string_eqstrP {
+	inline int operator() (const string *l, const string *r) const { return (l->compare(*r) == 0); }
+};
+
+namespace TWlib {
+	template<>
+	struct tw_hash<int *> {
+		inline size_t operator()(int const * s) const { return (size_t) *s; }
+	};
+	template<>
+	struct tw_hash<std::string *> {
+		inline size_t operator()(const std::string *s) const {
+			return (size_t) TWlib::data_hash_Hsieh(s->c_str(),s->length());
+		}
+	};
+}
+
+typedef Allocator<Alloc_Std> TESTAlloc;
+
+double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+#define BENCH_N 1000000
+#define BENCH_R 4
+
+// scattered, distinct keys - so the identity tw_hash<int *> does not hand the tables sequential buckets
+static inline int benchKey( int n ) { return (int) ((unsigned int) n * 2654435761U); }
+
+// ns per lookup, for hits (keys 0..N-1) and misses (keys N..2N-1)
+template<typename MAP>
+void bench( const char *name, MAP &h ) {
+	for(int n=0;n<BENCH_N;n++) {
+		int k = benchKey(n);
+		int v = n;
+		h.addNoreplace(k, v);
+	}
+	long long sum = 0;
+	double t = now();
+	for(int r=0;r<BENCH_R;r++)
+		for(int n=0;n<BENCH_N;n++) {
+			int k = benchKey((int) (((long long) n * 7919) % BENCH_N));
+			sum += *h.find(k);
+		}
+	double thit = now() - t;
+	assert(sum == (long long) BENCH_R * BENCH_N * (BENCH_N - 1) / 2);
+	int found = 0;
+	t = now();
+	for(int r=0;r<BENCH_R;r++)
+		for(int n=0;n<BENCH_N;n++) {
+			int k = benchKey(BENCH_N + n);
+			if(h.find(k)) found++;
+		}
+	double tmiss = now() - t;
+	assert(found == 0);
+	printf("%-20s hit %6.1f ns  miss %6.1f ns\n", name, thit * 1e9 / ((double) BENCH_R * BENCH_N), tmiss * 1e9 / ((double) BENCH_R * BENCH_N));
+}
+
+int main()
+{
+	{
+		TW_SwissHash<int, TESTD, TW_Mutex, int_eqstrP, TESTAlloc> h;
+		assert(h.find(1) == NULL && !h.remove(1) && h.size() == 0);
+		for(int n=0;n<100000;n++) {
+			TESTD *d = h.addNoreplaceNew(n);
+			assert(d);
+			d->x = n * 3;
+		}
+		assert(h.addNoreplaceNew(5) == NULL);
+		assert(h.size() == 100000 && live == 100000);
+		for(int n=0;n<100000;n++)
+			assert(h.find(n)->x == n * 3);
+		assert(h.find(-1) == NULL);
+		TESTD t;
+		t.x = 7;
+		assert(!h.addNoreplace(1, t));
+		assert(h.addReplace(1, t) && h.find(1)->x == 7);
+		TESTD old;
+		t.x = 8;
+		assert(h.addReplace(1, t, old) && old.x == 7);
+		for(int n=0;n<100000;n+=2)
+			assert(h.remove(n));
+		assert(!h.remove(0));
+		assert(h.size() == 50000 && live == 50000 + 2);
+		TESTD fill;
+		assert(h.remove(3, fill) && fill.x == 9);
+		assert(h.find(5, fill) && fill.x == 15);
+		assert(h.findOrNew(5)->x == 15);
+		assert(h.findOrNew(4)->x == 0);
+		assert(h.addReplaceNew(5)->x == 0);
+		// iterate
+		int c = 0;
+		TW_SwissHash<int, TESTD, TW_Mutex, int_eqstrP, TESTAlloc>::HashIterator it(h);
+		while(!it.atEnd()) {
+			assert(h.find(*it.key()) == it.data());
+			c++;
+			it.getNext();
+		}
+		it.release();
+		assert(c == h.size());
+		assert(h.removeAll() && h.size() == 0 && live == 3);
+		h.findOrNew(12)->x = 1;
+	}
+	assert(live == 0);
+
+	// churn in a small table: the same few keys added and removed over and over. Deleted buckets
+	// must get reused or cleaned out by a rehash - the table must not grow w/o bound.
+	{
+		TW_SwissHash<int, int, TW_NoMutex, int_eqstrP, TESTAlloc> h;
+		srand(3);
+		map<int, int> ref;
+		for(int n=0;n<500000;n++) {
+			int k = rand();
+			if(ref.size() < 100) {
+				h.addReplace(k, n);
+				ref[k] = n;
+			} else {
+				map<int, int>::iterator i = ref.begin();
+				assert(h.remove(i->first));
+				ref.erase(i);
+			}
+		}
+		assert(h.size() == (int) ref.size());
+		for(map<int, int>::iterator i = ref.begin(); i != ref.end(); i++)
+			assert(*h.find(i->first) == i->second);
+		assert(h.buckets() <= 256);
+	}
+
+	// non trivial keys and values, across many resizes and deletes, against std::map
+	{
+		TW_SwissHash<string, string, TW_NoMutex, string_eqstrP, TESTAlloc> h(NULL, 100);
+		map<string, string> ref;
+		srand(7);
+		char k[32], v[64];
+		for(int n=0;n<200000;n++) {
+			snprintf(k, sizeof(k), "key-%d", rand() % 5000);
+			string key(k);
+			int op = rand() % 4;
+			if(op < 2) {
+				snprintf(v, sizeof(v), "value %d of a string long enough to be on the heap", n);
+				string val(v);
+				h.addReplace(key, val);
+				ref[key] = val;
+			} else if(op == 2) {
+				assert(h.remove(key) == (ref.erase(key) == 1));
+			} else {
+				string *s = h.find(key);
+				map<string, string>::iterator i = ref.find(key);
+				assert((s == NULL) == (i == ref.end()));
+				if(s) assert(*s == i->second);
+			}
+		}
+		assert(h.size() == (int) ref.size());
+		int c = 0;
+		TW_SwissHash<string, string, TW_NoMutex, string_eqstrP, TESTAlloc>::HashIterator it(h);
+		while(!it.atEnd()) {
+			assert(ref[*it.key()] == *it.data());
+			c++;
+			it.getNext();
+		}
+		it.release();
+		assert(c == (int) ref.size());
+	}
+
+	// speed, int -> int
+	{
+		TW_SwissHash<int, int, TW_NoMutex, int_eqstrP, TESTAlloc> hs;
+		bench("TW_SwissHash", hs);
+	}
+	{
+		TW_KHash_32_Inline<int, int, TW_NoMutex, int_eqstrP, TESTAlloc> hi;
+		bench("TW_KHash_32_Inline", hi);
+	}
+	{
+		TW_KHash_32<int, int, TW_NoMutex, int_eqstrP, TESTAlloc> hk;
+		bench("TW_KHash_32", hk);
+	}
+#ifdef HAVE_GOOGLE_HASH
+	{
+		int del = -1, empty = -2;
+		TWDenseHash<int, int, TW_NoMutex, int_eqstrP, TESTAlloc> hd(del, empty);
+		bench("TWDenseHash", hd);
+	}
+	{
+		int empty = -2;
+		TWSparseHash<int, int, TW_NoMutex, int_eqstrP, TESTAlloc> hsp(empty);
+		bench("TWSparseHash", hsp);
+	}
+#else
+	printf("(no google sparsehash headers - TWDenseHash / TWSparseHash not compared)\n");
+#endif
+
+	printf("OK\n");
+	exit(0);
+}
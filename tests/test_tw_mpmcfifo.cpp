@@ -0,0 +1,135 @@
+// test_tw_mpmcfifo.cpp
+// Tests tw_bndMPMCFIFO - many producers fanning into a few consumers, through a small bounded FIFO.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+#include <TW/tw_utils.h>
+#include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_mpmc_fifo.h>
+
+#include "tests/testutils.h"
+
+#define QUEUE_SIZE 10  // rounded up to 16
+#define RUN_SIZE 400000
+
+#define CONSUMER_THREADS 2
+#define PRODUCER_THREADS 8
+
+#define PER_PRODUCER (RUN_SIZE / PRODUCER_THREADS)
+
+using namespace TWlib;
+
+typedef Allocator<Alloc_Std> TESTAlloc;
+
+TW_Mutex *totalMutex;
+int verify[PRODUCER_THREADS];
+int lastSeen[CONSUMER_THREADS][PRODUCER_THREADS];
+int EXITED = 0;
+
+class threadinfo {
+public:
+	int threadnum;
+	void *p; // some data
+};
+
+void *producer( void *ptr ) {
+	threadinfo *inf = reinterpret_cast<threadinfo *>(ptr);
+	tw_bndMPMCFIFO<int, TESTAlloc > *Q = reinterpret_cast<tw_bndMPMCFIFO<int, TESTAlloc > *>(inf->p);
+	for(int n=0;n<PER_PRODUCER;n++) {
+		int val = inf->threadnum * PER_PRODUCER + n;
+		Q->add(val);
+	}
+	return NULL;
+}
+
+void *consumer( void *ptr ) {
+	threadinfo *inf = reinterpret_cast<threadinfo *>(ptr);
+	tw_bndMPMCFIFO<int, TESTAlloc > *Q = reinterpret_cast<tw_bndMPMCFIFO<int, TESTAlloc > *>(inf->p);
+	int val = 0;
+	int cnt = 0;
+	while(Q->removeOrBlock(val)) { // fails once unblockRemoveCalls() is called
+		int p = val / PER_PRODUCER;
+		int seq = val % PER_PRODUCER;
+		// each producer's values must come out in order
+		assert(seq > lastSeen[inf->threadnum][p]);
+		lastSeen[inf->threadnum][p] = seq;
+		cnt++;
+		totalMutex->acquire();
+		verify[p]++;
+		totalMutex->release();
+	}
+	printf("Consumer %d: removed %d\n", inf->threadnum, cnt);
+	totalMutex->acquire();
+	EXITED++;
+	totalMutex->release();
+	return NULL;
+}
+
+int main()
+{
+	pthread_t consumert[CONSUMER_THREADS];
+	pthread_t producert[PRODUCER_THREADS];
+	totalMutex = new TW_Mutex();
+	memset(verify, 0, sizeof(verify));
+	for(int c=0;c<CONSUMER_THREADS;c++)
+		for(int p=0;p<PRODUCER_THREADS;p++)
+			lastSeen[c][p] = -1;
+
+	tw_bndMPMCFIFO<int, TESTAlloc > theQ( QUEUE_SIZE );
+	assert(theQ.maxSize() == 16);
+
+	// non blocking calls
+	int v = 0;
+	assert(!theQ.remove(v));
+	for(int n=0;n<16;n++)
+		assert(theQ.addIfRoom(n));
+	assert(!theQ.addIfRoom(v));
+	assert(theQ.remaining() == 16);
+	for(int n=0;n<16;n++) {
+		assert(theQ.remove(v));
+		assert(v == n);
+	}
+	TimeVal t;
+	t.gettimeofday().addUsec(1000);
+	assert(!theQ.removeOrBlock(v, t)); // empty - should time out
+
+	threadinfo *inf;
+	for (int x=0;x<CONSUMER_THREADS;x++) {
+		inf = new threadinfo;
+		inf->p = reinterpret_cast<void *>(&theQ);
+		inf->threadnum = x;
+		pthread_create( &consumert[x], NULL, consumer, reinterpret_cast<void *>(inf));
+	}
+	for (int x=0;x<PRODUCER_THREADS;x++) {
+		inf = new threadinfo;
+		inf->p = reinterpret_cast<void *>(&theQ);
+		inf->threadnum = x;
+		pthread_create( &producert[x], NULL, producer, reinterpret_cast<void *>(inf));
+	}
+
+	for (int x=0;x<PRODUCER_THREADS;x++) {
+		pthread_join( producert[x], NULL);
+	}
+	while(theQ.remaining() > 0)
+		usleep(1000);
+	unblockUntilExited(totalMutex, EXITED, CONSUMER_THREADS, [&]() { theQ.unblockRemoveCalls(); });
+	for (int x=0;x<CONSUMER_THREADS;x++) {
+		pthread_join( consumert[x], NULL);
+	}
+
+	for(int n=0;n<PRODUCER_THREADS;n++) {
+		printf("verify[%d] == %d\n", n, verify[n]);
+		assert(verify[n] == PER_PRODUCER);
+	}
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,137 @@
+// test_twcircular_batch.cpp
+// Tests the tw_safeCircular batch calls: addMany() / removeMany() / removeManyOrBlock()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+#include <TW/tw_utils.h>
+#include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_circular.h>
+
+#include "tests/testutils.h"
+
+#define QUEUE_SIZE 100
+#define RUN_SIZE 400000
+#define UNIQUE_VALUES (RUN_SIZE/PRODUCER_THREADS)
+#define BURST 16
+#define DRAIN 32
+
+#define CONSUMER_THREADS 2
+#define PRODUCER_THREADS 4
+
+using namespace TWlib;
+
+typedef Allocator<Alloc_Std> TESTAlloc;
+
+TW_Mutex *totalMutex;
+int verify[UNIQUE_VALUES];
+int TOTAL;
+int EXITED;
+
+template <class Q>
+void *producer( void *ptr ) {
+	Q *q = reinterpret_cast<Q *>(ptr);
+	int burst[BURST];
+	for(int n=0;n<UNIQUE_VALUES;n+=BURST) {
+		int k = 0;
+		for(;k<BURST && n+k < UNIQUE_VALUES;k++)
+			burst[k] = n+k;
+		int added = q->addMany(burst, k);
+		assert(added == k);
+	}
+	return NULL;
+}
+
+template <class Q>
+void *consumer( void *ptr ) {
+	Q *q = reinterpret_cast<Q *>(ptr);
+	int drain[DRAIN];
+	while(1) {
+		int got = q->removeManyOrBlock(drain, DRAIN);
+		if(got < 1) break; // unblocked
+		totalMutex->acquire();
+		for(int x=0;x<got;x++) {
+			assert(drain[x] >= 0 && drain[x] < UNIQUE_VALUES);
+			verify[drain[x]]++;
+		}
+		TOTAL += got;
+		totalMutex->release();
+	}
+	totalMutex->acquire();
+	EXITED++;
+	totalMutex->release();
+	return NULL;
+}
+
+template <class Q>
+void runLoad( Q &q ) {
+	pthread_t consumert[CONSUMER_THREADS];
+	pthread_t producert[PRODUCER_THREADS];
+	memset(verify,0,sizeof(verify));
+	TOTAL = 0;
+	EXITED = 0;
+	for (int x=0;x<CONSUMER_THREADS;x++)
+		pthread_create( &consumert[x], NULL, consumer<Q>, reinterpret_cast<void *>(&q));
+	for (int x=0;x<PRODUCER_THREADS;x++)
+		pthread_create( &producert[x], NULL, producer<Q>, reinterpret_cast<void *>(&q));
+	for (int x=0;x<PRODUCER_THREADS;x++)
+		pthread_join( producert[x], NULL);
+	while(q.remaining() > 0)
+		usleep(1000);
+	unblockUntilExited(totalMutex, EXITED, CONSUMER_THREADS, [&]() { q.unblockAllRemovers(); });
+	for (int x=0;x<CONSUMER_THREADS;x++)
+		pthread_join( consumert[x], NULL);
+	assert(TOTAL == RUN_SIZE);
+	for(int n=0;n<UNIQUE_VALUES;n++)
+		assert(verify[n] == PRODUCER_THREADS);
+}
+
+template <class Q>
+void singleThread( Q &q ) {
+	int in[10], out[10];
+	for(int n=0;n<10;n++) in[n] = n;
+	assert(q.addMany(in, 10) == 10);
+	assert(q.remaining() == 10);
+	assert(q.removeMany(out, 4) == 4);
+	for(int n=0;n<4;n++) assert(out[n] == n);
+	assert(q.removeMany(out, 10, 1000) == 6);
+	for(int n=0;n<6;n++) assert(out[n] == n + 4);
+	assert(q.removeMany(out, 10) == 0);
+	// more than the capacity (16) - times out after adding what fits
+	int big[20];
+	assert(q.addMany(big, 20, 1000) == 16);
+	assert(q.removeManyOrBlock(big, 20) == 16);
+	assert(q.remaining() == 0);
+}
+
+int main()
+{
+	totalMutex = new TW_Mutex();
+
+	tw_safeCircular<int, TESTAlloc > smallQ( 16 );
+	singleThread(smallQ);
+
+	tw_safeCircular<int, TESTAlloc, TW_FutexSemaTwoWay > smallFQ( 16 );
+	singleThread(smallFQ);
+	int out[4];
+	assert(smallFQ.removeMany(out, 4, 1000) == 0); // empty - should time out
+
+	tw_safeCircular<int, TESTAlloc > theQ( QUEUE_SIZE );
+	runLoad(theQ);
+	printf("TW_SemaTwoWay batch OK\n");
+
+	tw_safeCircular<int, TESTAlloc, TW_FutexSemaTwoWay > futexQ( QUEUE_SIZE );
+	runLoad(futexQ);
+	printf("TW_FutexSemaTwoWay batch OK\n");
+
+	printf("OK\n");
+	exit(0);
+}
@@ -0,0 +1,172 @@
+// test_twcircular_futex.cpp
+// Runs tw_safeCircular over TW_FutexSemaTwoWay with several producers and consumers,
+// and compares it with the default (pthread) TW_SemaTwoWay.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+#include <TW/tw_utils.h>
+#include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_circular.h>
+
+#define QUEUE_SIZE 64
+#define RUN_SIZE 400000
+#define UNIQUE_VALUES (RUN_SIZE/PRODUCER_THREADS)
+
+#define CONSUMER_THREADS 4
+#define PRODUCER_THREADS 4
+
+using namespace TWlib;
+
+typedef Allocator<Alloc_Std> TESTAlloc;
+
+TW_Mutex *totalMutex;
+int verify[UNIQUE_VALUES];
+
+class data {
+public:
+	int x;
+	data() : x(-1000) {}
+	data(data &o) : x(o.x) {}
+	data &operator=(const data &o) { x = o.x; return *this; }
+};
+
+template <class Q>
+void *producer( void *ptr ) {
+	Q *q = reinterpret_cast<Q *>(ptr);
+	data D;
+	for(int n=0;n<UNIQUE_VALUES;n++) {
+		D.x = n;
+		q->add(D);
+	}
+	return NULL;
+}
+
+template <class Q>
+void *consumer( void *ptr ) {
+	Q *q = reinterpret_cast<Q *>(ptr);
+	data D;
+	int x = RUN_SIZE / CONSUMER_THREADS;
+	while(x > 0) {
+		if(q->removeOrBlock(D)) {
+			assert(D.x >= 0);
+			totalMutex->acquire();
+			verify[D.x]++;
+			totalMutex->release();
+			x--;
+		}
+	}
+	return NULL;
+}
+
+template <class Q>
+double runLoad( Q &q ) {
+	pthread_t consumert[CONSUMER_THREADS];
+	pthread_t producert[PRODUCER_THREADS];
+	struct timeval start, end;
+	memset(verify,0,sizeof(verify));
+	gettimeofday(&start, NULL);
+	for (int x=0;x<CONSUMER_THREADS;x++)
+		pthread_create( &consumert[x], NULL, consumer<Q>, reinterpret_cast<void *>(&q));
+	for (int x=0;x<PRODUCER_THREADS;x++)
+		pthread_create( &producert[x], NULL, producer<Q>, reinterpret_cast<void *>(&q));
+	for (int x=0;x<PRODUCER_THREADS;x++)
+		pthread_join( producert[x], NULL);
+	for (int x=0;x<CONSUMER_THREADS;x++)
+		pthread_join( consumert[x], NULL);
+	gettimeofday(&end, NULL);
+	for(int n=0;n<UNIQUE_VALUES;n++)
+		assert(verify[n] == PRODUCER_THREADS);
+	double usec = (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec);
+	return (usec * 1000.0) / RUN_SIZE; // nsec per item
+}
+
+TW_FutexMutex condMutex;
+TW_FutexCond cond;
+int condEntered = 0;
+int condSignaled = 0;
+
+// waits on cond w/ a short timeout
+void *condWaiter( void *ptr ) {
+	struct timespec until;
+	clock_gettime(CLOCK_REALTIME, &until);
+	until.tv_nsec += 300 * 1000000;
+	if(until.tv_nsec >= 1000000000) { until.tv_sec++; until.tv_nsec -= 1000000000; }
+	condMutex.acquire();
+	condEntered++;
+	if(cond.wait(condMutex, &until) == 0)
+		condSignaled++;
+	condMutex.release();
+	return NULL;
+}
+
+int main()
+{
+	totalMutex = new TW_Mutex();
+
+	// basic sema behavior
+	TW_FutexSemaTwoWay sema(2);
+	assert(sema.acquire() == 0);
+	assert(sema.acquire() == 0);
+	assert(sema.count() == 0);
+	assert(sema.acquire((int64_t) 1000) == ETIMEDOUT);
+	sema.release();
+	assert(sema.count() == 1);
+	assert(sema.acquireAndKeepLockNoBlock());
+	sema.releaseSemaLock();
+	assert(!sema.acquireAndKeepLockNoBlock());
+	sema.releaseSemaLock();
+	sema.reset();
+	assert(sema.count() == 2);
+	assert(sema.waitForAcquirers((int64_t) 1000) != 0); // nothing acquired - times out
+
+	// one signal, two waiters w/ a timeout - the one not woken times out, and its registration goes too
+	for(int r=0;r<3;r++) {
+		pthread_t w[2];
+		condEntered = condSignaled = 0;
+		for(int n=0;n<2;n++)
+			pthread_create(&w[n], NULL, condWaiter, NULL);
+		while(1) {
+			condMutex.acquire();
+			if(condEntered == 2) break; // both are inside wait() - it let go of the mutex
+			condMutex.release();
+			usleep(1000);
+		}
+		assert(cond.hasWaiters());
+		cond.signal();
+		condMutex.release();
+		for(int n=0;n<2;n++)
+			pthread_join(w[n], NULL);
+		assert(condSignaled >= 1); // (the timed out one may be woken spuriously too)
+		assert(!cond.hasWaiters());
+	}
+
+	// timeouts through the circular buffer
+	tw_safeCircular<data, TESTAlloc, TW_FutexSemaTwoWay > smallQ( 2, true );
+	data D;
+	assert(smallQ.add(D, 1000));
+	assert(smallQ.add(D, 1000));
+	assert(!smallQ.add(D, 1000)); // full
+	assert(smallQ.remove(D));
+	assert(smallQ.remove(D));
+	assert(!smallQ.removeOrBlock(D, 1000)); // empty
+
+	tw_safeCircular<data, TESTAlloc, TW_FutexSemaTwoWay > futexQ( QUEUE_SIZE, true );
+	double f = runLoad(futexQ);
+	printf("tw_safeCircular w/ TW_FutexSemaTwoWay: %0.1f ns/item\n", f);
+
+	tw_safeCircular<data, TESTAlloc > pthreadQ( QUEUE_SIZE, true );
+	double p = runLoad(pthreadQ);
+	printf("tw_safeCircular w/ TW_SemaTwoWay:      %0.1f ns/item\n", p);
+
+	printf("OK\n");
+	exit(0);
+}
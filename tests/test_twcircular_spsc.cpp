@@ -0,0 +1,121 @@
+// test_twcircular_spsc.cpp
+// Tests tw_spscCircular - one producer thread, one consumer thread.
+// Also runs the same load through tw_safeCircular for a rough per item comparison.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+#include <TW/tw_utils.h>
+#include <TW/tw_alloc.h>
+#include <TW/tw_sema.h>
+#include <TW/tw_circular.h>
+#include <TW/tw_circular_spsc.h>
+
+#define QUEUE_SIZE 20   // rounded up to 32 by tw_spscCircular
+#define RUN_SIZE 2000000
+
+using namespace TWlib;
+
+typedef Allocator<Alloc_Std> TESTAlloc;
+
+class data {
+public:
+	int x;
+	data() : x(-1000) {}
+	data(data &o) : x(o.x) {}
+	data &operator=(const data &o) { x = o.x; return *this; }
+};
+
+template <class Q>
+void *producer( void *ptr ) {
+	Q *q = reinterpret_cast<Q *>(ptr);
+	data D;
+	for(int n=0;n<RUN_SIZE;n++) {
+		D.x = n;
+		q->add(D);
+	}
+	return NULL;
+}
+
+template <class Q>
+void *consumer( void *ptr ) {
+	Q *q = reinterpret_cast<Q *>(ptr);
+	data D;
+	for(int n=0;n<RUN_SIZE;n++) {
+		bool ok = q->removeOrBlock(D);
+		assert(ok);
+		assert(D.x == n); // single producer - order must be preserved
+	}
+	return NULL;
+}
+
+template <class Q>
+double runLoad( Q &q ) {
+	pthread_t prod, cons;
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	pthread_create( &cons, NULL, consumer<Q>, reinterpret_cast<void *>(&q));
+	pthread_create( &prod, NULL, producer<Q>, reinterpret_cast<void *>(&q));
+	pthread_join( prod, NULL);
+	pthread_join( cons, NULL);
+	gettimeofday(&end, NULL);
+	double usec = (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec);
+	return (usec * 1000.0) / RUN_SIZE; // nsec per item
+}
+
+void *unblocker( void *ptr ) {
+	tw_spscCircular<data, TESTAlloc > *q = reinterpret_cast<tw_spscCircular<data, TESTAlloc > *>(ptr);
+	usleep(200000);
+	q->unblockAllRemovers();
+	return NULL;
+}
+
+int main()
+{
+	data D;
+	tw_spscCircular<data, TESTAlloc > theQ( QUEUE_SIZE, true );
+	assert(theQ.capacity() == 32);
+
+	// non blocking calls
+	assert(!theQ.remove(D));
+	for(int n=0;n<32;n++) {
+		D.x = n;
+		assert(theQ.addIfRoom(D));
+	}
+	assert(!theQ.addIfRoom(D));
+	assert(!theQ.add(D, 1000)); // full - should time out
+	assert(theQ.remaining() == 32);
+	for(int n=0;n<32;n++) {
+		assert(theQ.removeMv(D));
+		assert(D.x == n);
+	}
+	assert(theQ.remaining() == 0);
+
+	// timeout on empty
+	assert(!theQ.removeOrBlock(D, 1000));
+
+	// unblock a blocked remover
+	pthread_t ub;
+	pthread_create( &ub, NULL, unblocker, reinterpret_cast<void *>(&theQ));
+	assert(!theQ.removeOrBlock(D));
+	pthread_join( ub, NULL);
+	printf("unblockAllRemovers OK\n");
+
+	tw_spscCircular<data, TESTAlloc > bigQ( 1024, true );
+	double spsc = runLoad(bigQ);
+	printf("tw_spscCircular: %0.1f ns/item\n", spsc);
+
+	tw_safeCircular<data, TESTAlloc > safeQ( 1024, true );
+	double safe = runLoad(safeQ);
+	printf("tw_safeCircular: %0.1f ns/item\n", safe);
+
+	printf("OK\n");
+	exit(0);
+}
@@ -15,10 +15,28 @@
 #define TESTUTILS_H_
 
 #include <string>
+#include <unistd.h>
 
 using namespace std;
 
 string &dumpHexMem(string &out, char *area, int size);
+
+/**
+ * Shuts down blocked consumer threads: calls unblock() until 'exited' (counted under 'mutex' by the
+ * consumers as they leave) reaches 'threads'. A consumer may not be blocked yet when unblock() is first
+ * called - so keep at it until all are out.
+ */
+template <class MUTEX, class UNBLOCK>
+void unblockUntilExited( MUTEX *mutex, int &exited, int threads, UNBLOCK unblock ) {
+	while(1) {
+		mutex->acquire();
+		int e = exited;
+		mutex->release();
+		if(e == threads) break;
+		unblock();
+		usleep(1000);
+	}
+}
 /*
 void disconnectBlocks(ACE_Message_Block *in, ACE_Message_Block **parts, int numblks );
 void equalBlocks(ACE_Message_Block *in, ACE_Message_Block **parts, int blksize );
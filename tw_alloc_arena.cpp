@@ -0,0 +1,150 @@
+// tupperware container lib
+// tw_alloc_arena.cpp
+
+#include <stdint.h>
+
+#include <TW/tw_alloc_arena.h>
+
+using namespace TWlib;
+
+const char *TWlib::Alloc_Arena::ALLOC_NOMEM_ERROR_MESSAGE = "*** MEMORY TWlib::Allocator FAILURE using ALLOC (Alloc_Arena - no current arena?): %s:%d ***\n";
+
+namespace {
+
+__thread Alloc_Arena *arenaCurrent = NULL;
+
+// each allocation has its size just in front of it, so realloc() knows how much to copy
+#define ARENA_SIZE_HDR sizeof(size_t)
+#define ARENA_CHUNK_HDR ((sizeof(void *) * 3 + TW_ARENA_ALIGN - 1) & ~(TW_ARENA_ALIGN - 1))
+
+inline size_t align_up(size_t n) { return (n + TW_ARENA_ALIGN - 1) & ~((size_t) TW_ARENA_ALIGN - 1); }
+inline size_t &size_of(void *p) { return *((size_t *) ((char *) p - ARENA_SIZE_HDR)); }
+
+}
+
+Alloc_Arena *Alloc_Arena::current() {
+	return arenaCurrent;
+}
+
+void Alloc_Arena::setCurrent(Alloc_Arena *a) {
+	arenaCurrent = a;
+}
+
+Alloc_Arena::Alloc_Arena(tw_size chunksize) :
+	_head(NULL), _chunksize(chunksize), _used(0), _nchunks(0), _last(NULL) { }
+
+Alloc_Arena::~Alloc_Arena() {
+	while(_head) {
+		chunk *c = _head;
+		_head = c->next;
+		::free(c);
+	}
+	if(arenaCurrent == this)
+		arenaCurrent = NULL;
+}
+
+Alloc_Arena::chunk *Alloc_Arena::newChunk(size_t size) {
+	chunk *c = (chunk *) ::malloc(ARENA_CHUNK_HDR + size);
+	if(!c) return NULL;
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	_nchunks++;
+	return c;
+}
+
+// returns NULL if it does not fit in c
+void *Alloc_Arena::bump(chunk *c, tw_size nbytes) {
+	char *base = (char *) c + ARENA_CHUNK_HDR;
+	// the size header goes just before an aligned address
+	size_t start = align_up(c->used + ARENA_SIZE_HDR);
+	if(start + nbytes > c->size)
+		return NULL;
+	c->used = start + nbytes;
+	void *ret = base + start;
+	size_of(ret) = nbytes;
+	return ret;
+}
+
+void *Alloc_Arena::i_malloc(tw_size nbytes) {
+	void *ret = NULL;
+	if(_head)
+		ret = bump(_head, nbytes);
+	if(!ret) {
+		size_t need = align_up(nbytes + ARENA_SIZE_HDR) + TW_ARENA_ALIGN;
+		if(need > (size_t) _chunksize / 4) {
+			// a big one gets a chunk of its own, chained behind the current chunk so it keeps bumping
+			chunk *c = newChunk(need);
+			if(!c) return NULL;
+			ret = bump(c, nbytes);
+			if(_head) {
+				c->next = _head->next;
+				_head->next = c;
+			} else
+				_head = c;
+			_used += nbytes;
+			return ret;
+		}
+		chunk *c = newChunk(_chunksize);
+		if(!c) return NULL;
+		c->next = _head;
+		_head = c;
+		ret = bump(c, nbytes);
+	}
+	_last = ret;
+	_used += nbytes;
+	return ret;
+}
+
+void *Alloc_Arena::i_calloc(tw_size nelem, tw_size elemsize) {
+	tw_size n = nelem * elemsize;
+	void *ret = i_malloc(n);
+	if(ret) ::memset(ret, 0, n);
+	return ret;
+}
+
+void *Alloc_Arena::i_realloc(void *d, tw_size s) {
+	if(!d) return i_malloc(s);
+	size_t old = size_of(d);
+	if((size_t) s <= old) {
+		size_of(d) = s;
+		return d;
+	}
+	// the last thing allocated from the current chunk can just grow
+	if(d == _last && _head) {
+		size_t start = (char *) d - ((char *) _head + ARENA_CHUNK_HDR);
+		if(start + s <= _head->size) {
+			_head->used = start + s;
+			_used += s - old;
+			size_of(d) = s;
+			return d;
+		}
+	}
+	void *ret = i_malloc(s);
+	if(ret)
+		::memcpy(ret, d, old);
+	return ret;
+}
+
+void Alloc_Arena::reset() {
+	if(!_head) return;
+	// keep one regular sized chunk around, since the arena will most likely be used again
+	chunk *keep = NULL;
+	while(_head) {
+		chunk *c = _head;
+		_head = c->next;
+		if(!keep && c->size == (size_t) _chunksize)
+			keep = c;
+		else {
+			::free(c);
+			_nchunks--;
+		}
+	}
+	if(keep) {
+		keep->next = NULL;
+		keep->used = 0;
+	}
+	_head = keep;
+	_used = 0;
+	_last = NULL;
+}
@@ -0,0 +1,296 @@
+// tupperware container lib
+// tw_alloc_mmap.cpp
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <TW/tw_log.h>
+#include <TW/tw_alloc_mmap.h>
+
+using namespace TWlib;
+
+const char *TWlib::Alloc_MMap::ALLOC_NOMEM_ERROR_MESSAGE = "*** MEMORY TWlib::Allocator FAILURE using ALLOC (Alloc_MMap - file full or not open?): %s:%d ***\n";
+
+Alloc_MMap *Alloc_MMap::_default = NULL;
+
+#define MMAP_MAGIC 0x54574D4D // 'TWMM'
+#define MMAP_VERSION 1
+#define MMAP_INUSE 0xA110CA7EDB10CULL // marks a block as allocated (in 'next')
+#define MMAP_MIN_BLOCK (sizeof(block) + TW_MMAP_ALIGN)
+
+// lives at offset 0 of the file
+struct Alloc_MMap::header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t base;     // the address the file was mapped at
+	uint64_t maxsize;
+	uint64_t filesize;
+	uint64_t top;      // everything from here to filesize has never been allocated
+	uint64_t freehead; // offset of the first free block, 0 if none
+	uint64_t root;     // offset of the user's root object, 0 if none
+	uint64_t pad;
+};
+
+// in front of every allocation. 'size' includes this header.
+struct Alloc_MMap::block {
+	uint64_t size;
+	uint64_t next; // next free block offset, or MMAP_INUSE
+};
+
+namespace {
+inline uint64_t align_up(uint64_t n, uint64_t a) { return (n + a - 1) & ~(a - 1); }
+}
+
+Alloc_MMap::Alloc_MMap() : _hdr(NULL), _fd(-1), _maxsize(0) {
+	pthread_mutex_init(&_mutex, NULL);
+}
+
+Alloc_MMap::~Alloc_MMap() {
+	close();
+	pthread_mutex_destroy(&_mutex);
+}
+
+int Alloc_MMap::open(const char *path, uint64_t maxsize) {
+	if(_hdr) return EBUSY;
+	uint64_t page = (uint64_t) sysconf(_SC_PAGESIZE);
+	int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+	if(fd < 0) return errno;
+	struct stat st;
+	if(fstat(fd, &st) < 0) {
+		int e = errno; ::close(fd); return e;
+	}
+	header existing;
+	void *want = NULL;
+	bool fresh = (st.st_size == 0);
+	if(!fresh) {
+		if(pread(fd, &existing, sizeof(header), 0) != sizeof(header) || existing.magic != MMAP_MAGIC || existing.version != MMAP_VERSION) {
+			::close(fd);
+			return EINVAL;
+		}
+		maxsize = existing.maxsize;
+		want = (void *) existing.base;
+	} else {
+		maxsize = align_up(maxsize, page);
+		if(ftruncate(fd, page) < 0) {
+			int e = errno; ::close(fd); return e;
+		}
+	}
+	// map all of maxsize now, so the mapping never has to move as the file grows
+	int flags = MAP_SHARED;
+#ifdef MAP_FIXED_NOREPLACE
+	if(want) flags |= MAP_FIXED_NOREPLACE;
+#endif
+	void *m = mmap(want, maxsize, PROT_READ | PROT_WRITE, flags, fd, 0);
+	if(m == MAP_FAILED) {
+		int e = errno; ::close(fd); return e;
+	}
+	if(want && m != want) { // pointers in the file would be wrong anywhere else
+		TW_ERROR("Alloc_MMap: could not map %s at its recorded address %p\n", path, want);
+		munmap(m, maxsize);
+		::close(fd);
+		return EADDRINUSE;
+	}
+	_hdr = (header *) m;
+	_fd = fd;
+	_maxsize = maxsize;
+	if(fresh) {
+		_hdr->magic = MMAP_MAGIC;
+		_hdr->version = MMAP_VERSION;
+		_hdr->base = (uint64_t) m;
+		_hdr->maxsize = maxsize;
+		_hdr->filesize = page;
+		_hdr->top = align_up(sizeof(header), TW_MMAP_ALIGN);
+		_hdr->freehead = 0;
+		_hdr->root = 0;
+		msync(m, page, MS_SYNC);
+	}
+	return 0;
+}
+
+int Alloc_MMap::close() {
+	if(!_hdr) return 0;
+	pthread_mutex_lock(&_mutex);
+	msync(_hdr, _hdr->filesize, MS_SYNC);
+	munmap(_hdr, _maxsize);
+	::close(_fd);
+	_hdr = NULL;
+	_fd = -1;
+	pthread_mutex_unlock(&_mutex);
+	if(_default == this) _default = NULL;
+	return 0;
+}
+
+// lock must be held. extends the file so that 'need' more bytes fit past top
+bool Alloc_MMap::grow(uint64_t need) {
+	uint64_t want = _hdr->top + need;
+	if(want <= _hdr->filesize) return true;
+	if(want > _maxsize) return false;
+	uint64_t n = _hdr->filesize * 2;
+	if(n < want) n = want;
+	n = align_up(n, (uint64_t) sysconf(_SC_PAGESIZE));
+	if(n > _maxsize) n = _maxsize;
+	if(ftruncate(_fd, (off_t) n) < 0) return false;
+	_hdr->filesize = n;
+	return true;
+}
+
+void *Alloc_MMap::allocLocked(tw_size nbytes) {
+	uint64_t need = align_up((uint64_t) nbytes, TW_MMAP_ALIGN) + sizeof(block);
+	if(need < MMAP_MIN_BLOCK) need = MMAP_MIN_BLOCK;
+	// first fit
+	uint64_t prev = 0;
+	uint64_t cur = _hdr->freehead;
+	while(cur) {
+		block *b = blockAt(cur);
+		if(b->size >= need) {
+			uint64_t next = b->next;
+			if(b->size - need >= MMAP_MIN_BLOCK) { // split - the tail stays free
+				block *rest = blockAt(cur + need);
+				rest->size = b->size - need;
+				rest->next = next;
+				next = cur + need;
+				b->size = need;
+			}
+			if(prev) blockAt(prev)->next = next;
+			else _hdr->freehead = next;
+			b->next = MMAP_INUSE;
+			return (char *) b + sizeof(block);
+		}
+		prev = cur;
+		cur = b->next;
+	}
+	if(!grow(need)) return NULL;
+	block *b = blockAt(_hdr->top);
+	b->size = need;
+	b->next = MMAP_INUSE;
+	_hdr->top += need;
+	return (char *) b + sizeof(block);
+}
+
+void Alloc_MMap::freeLocked(void *p) {
+	block *b = (block *) ((char *) p - sizeof(block));
+	if(b->next != MMAP_INUSE) {
+		TW_ERROR("Alloc_MMap: free() of %p which is not allocated\n", p);
+		return;
+	}
+	uint64_t off = offsetOf(b);
+	// keep the free list in address order, so neighbors can be merged
+	uint64_t prev = 0;
+	uint64_t cur = _hdr->freehead;
+	while(cur && cur < off) {
+		prev = cur;
+		cur = blockAt(cur)->next;
+	}
+	b->next = cur;
+	if(cur && off + b->size == cur) { // merge w/ the following block
+		b->size += blockAt(cur)->size;
+		b->next = blockAt(cur)->next;
+	}
+	if(prev) {
+		block *pb = blockAt(prev);
+		if(prev + pb->size == off) { // merge into the previous block
+			pb->size += b->size;
+			pb->next = b->next;
+		} else
+			pb->next = off;
+	} else
+		_hdr->freehead = off;
+}
+
+void *Alloc_MMap::i_malloc(tw_size nbytes) {
+	if(!_hdr) return NULL;
+	pthread_mutex_lock(&_mutex);
+	void *ret = allocLocked(nbytes);
+	pthread_mutex_unlock(&_mutex);
+	return ret;
+}
+
+void *Alloc_MMap::i_calloc(tw_size nelem, tw_size elemsize) {
+	tw_size n = nelem * elemsize;
+	void *ret = i_malloc(n);
+	if(ret) ::memset(ret, 0, n);
+	return ret;
+}
+
+void *Alloc_MMap::i_realloc(void *d, tw_size s) {
+	if(!d) return i_malloc(s);
+	if(s == 0) {
+		i_free(d);
+		return NULL;
+	}
+	if(!_hdr) return NULL;
+	if(!contains(d)) {
+		TW_ERROR("Alloc_MMap: realloc() of %p which is outside the mapping\n", d);
+		return NULL;
+	}
+	pthread_mutex_lock(&_mutex);
+	block *b = (block *) ((char *) d - sizeof(block));
+	if(b->next != MMAP_INUSE) {
+		pthread_mutex_unlock(&_mutex);
+		TW_ERROR("Alloc_MMap: realloc() of %p which is not allocated\n", d);
+		return NULL;
+	}
+	uint64_t have = b->size - sizeof(block);
+	if((uint64_t) s <= have) {
+		pthread_mutex_unlock(&_mutex);
+		return d;
+	}
+	void *ret = allocLocked(s);
+	if(ret) {
+		::memcpy(ret, d, have);
+		freeLocked(d);
+	}
+	pthread_mutex_unlock(&_mutex);
+	return ret;
+}
+
+void Alloc_MMap::i_free(void *p) {
+	if(!p || !_hdr) return;
+	if(!contains(p)) {
+		TW_ERROR("Alloc_MMap: free() of %p which is outside the mapping\n", p);
+		return;
+	}
+	pthread_mutex_lock(&_mutex);
+	freeLocked(p);
+	pthread_mutex_unlock(&_mutex);
+}
+
+int Alloc_MMap::i_sync(void *addr, tw_size len, int flags) {
+	if(!_hdr) return EBADF;
+	if(!flags) flags = MS_SYNC;
+	if(!addr)
+		return (msync(_hdr, _hdr->filesize, flags) < 0) ? errno : 0;
+	// msync() needs a page aligned start
+	uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t) addr & ~(page - 1);
+	uintptr_t end = (uintptr_t) addr + len;
+	return (msync((void *) start, end - start, flags) < 0) ? errno : 0;
+}
+
+void Alloc_MMap::setRoot(void *p) {
+	if(!_hdr) return;
+	_hdr->root = p ? offsetOf(p) : 0;
+}
+
+void *Alloc_MMap::getRoot() {
+	if(!_hdr || !_hdr->root) return NULL;
+	return (char *) _hdr + _hdr->root;
+}
+
+uint64_t Alloc_MMap::fileSize() {
+	return _hdr ? _hdr->filesize : 0;
+}
+
+uint64_t Alloc_MMap::bytesFree() {
+	if(!_hdr) return 0;
+	pthread_mutex_lock(&_mutex);
+	uint64_t ret = _hdr->filesize - _hdr->top;
+	for(uint64_t cur = _hdr->freehead; cur; cur = blockAt(cur)->next)
+		ret += blockAt(cur)->size;
+	pthread_mutex_unlock(&_mutex);
+	return ret;
+}
@@ -0,0 +1,273 @@
+// tupperware container lib
+// tw_alloc_pool.cpp
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <TW/tw_alloc_pool.h>
+
+using namespace TWlib;
+
+const char *TWlib::Alloc_Pool::ALLOC_NOMEM_ERROR_MESSAGE = "*** MEMORY TWlib::Allocator FAILURE using ALLOC (Alloc_Pool): %s:%d ***\n";
+
+namespace {
+
+#define POOL_LARGE_CLASS -1
+#define POOL_MAGIC 0x7E11
+
+// sits in front of every chunk - padded out so the chunk itself stays TW_POOL_ALIGN aligned
+struct pool_hdr {
+	int16_t cls;     // size class, or POOL_LARGE_CLASS if it came from ::malloc
+	uint16_t magic;
+	tw_size size;    // requested size - only used for large chunks
+};
+#define POOL_HDR_SIZE TW_POOL_ALIGN
+
+struct pool_chunk {
+	pool_chunk *next;
+};
+
+struct pool_list {
+	pool_chunk *head;
+	int count;
+};
+
+struct pool_threadcache {
+	pool_list lists[TW_POOL_NUM_CLASSES];
+};
+
+struct pool_shared {
+	pthread_mutex_t mutex;
+	pool_list free;
+	size_t slabBytes;
+};
+
+pool_shared poolShared[TW_POOL_NUM_CLASSES];
+pthread_key_t poolKey;
+pthread_once_t poolOnce = PTHREAD_ONCE_INIT;
+__thread pool_threadcache *poolCache = NULL;
+
+inline pool_hdr *hdr_of(void *p) { return (pool_hdr *) ((char *) p - POOL_HDR_SIZE); }
+inline void *chunk_of(pool_hdr *h) { return (char *) h + POOL_HDR_SIZE; }
+
+inline int class_size(int cls) { return (cls + 1) * TW_POOL_ALIGN; }
+inline int class_of(tw_size n) { return (n <= TW_POOL_ALIGN) ? 0 : (n + TW_POOL_ALIGN - 1) / TW_POOL_ALIGN - 1; }
+inline int class_stride(int cls) { return class_size(cls) + POOL_HDR_SIZE; }
+
+// how many chunks move between a thread and the shared pool at a time (roughly 8K worth)
+inline int class_batch(int cls) {
+	int b = 8192 / class_stride(cls);
+	if(b < 8) return 8;
+	if(b > 64) return 64;
+	return b;
+}
+
+// pops up to n chunks off of l into a chain. returns the number moved.
+int take_chain(pool_list &l, int n, pool_chunk *&chain) {
+	pool_chunk *first = l.head;
+	pool_chunk *last = NULL;
+	int x = 0;
+	while(l.head && x < n) {
+		last = l.head;
+		l.head = l.head->next;
+		x++;
+	}
+	if(last) last->next = NULL;
+	l.count -= x;
+	chain = (x > 0) ? first : NULL;
+	return x;
+}
+
+void put_chain(pool_list &l, pool_chunk *chain, int n) {
+	if(!chain) return;
+	pool_chunk *last = chain;
+	while(last->next) last = last->next;
+	last->next = l.head;
+	l.head = chain;
+	l.count += n;
+}
+
+void pool_thread_exit(void *d) {
+	pool_threadcache *c = (pool_threadcache *) d;
+	if(!c) return;
+	for(int n=0;n<TW_POOL_NUM_CLASSES;n++) {
+		if(c->lists[n].head) {
+			pthread_mutex_lock(&poolShared[n].mutex);
+			put_chain(poolShared[n].free, c->lists[n].head, c->lists[n].count);
+			pthread_mutex_unlock(&poolShared[n].mutex);
+		}
+	}
+	if(poolCache == c) poolCache = NULL;
+	::free(c);
+}
+
+void pool_init() {
+	for(int n=0;n<TW_POOL_NUM_CLASSES;n++) {
+		pthread_mutex_init(&poolShared[n].mutex, NULL);
+		poolShared[n].free.head = NULL;
+		poolShared[n].free.count = 0;
+		poolShared[n].slabBytes = 0;
+	}
+	pthread_key_create(&poolKey, pool_thread_exit);
+}
+
+inline pool_threadcache *get_cache() {
+	if(!poolCache) {
+		pthread_once(&poolOnce, pool_init);
+		poolCache = (pool_threadcache *) ::calloc(1, sizeof(pool_threadcache));
+		if(poolCache)
+			pthread_setspecific(poolKey, poolCache);
+	}
+	return poolCache;
+}
+
+// shared pool lock must be held. Carves a new slab into the shared free list.
+bool carve_slab(int cls) {
+	char *slab = (char *) ::malloc(TW_POOL_SLAB_SIZE);
+	if(!slab) return false;
+	int stride = class_stride(cls);
+	int n = TW_POOL_SLAB_SIZE / stride;
+	pool_list &l = poolShared[cls].free;
+	for(int x=n-1;x>=0;x--) {
+		pool_hdr *h = (pool_hdr *) (slab + x * stride);
+		h->cls = (int16_t) cls;
+		h->magic = POOL_MAGIC;
+		h->size = 0;
+		pool_chunk *c = (pool_chunk *) chunk_of(h);
+		c->next = l.head;
+		l.head = c;
+	}
+	l.count += n;
+	poolShared[cls].slabBytes += TW_POOL_SLAB_SIZE;
+	return true;
+}
+
+bool refill(pool_threadcache *c, int cls) {
+	pool_chunk *chain;
+	int got;
+	pthread_mutex_lock(&poolShared[cls].mutex);
+	if(!poolShared[cls].free.head && !carve_slab(cls)) {
+		pthread_mutex_unlock(&poolShared[cls].mutex);
+		return false;
+	}
+	got = take_chain(poolShared[cls].free, class_batch(cls), chain);
+	pthread_mutex_unlock(&poolShared[cls].mutex);
+	put_chain(c->lists[cls], chain, got);
+	return true;
+}
+
+void drain(pool_threadcache *c, int cls) {
+	pool_chunk *chain;
+	int got = take_chain(c->lists[cls], class_batch(cls), chain);
+	pthread_mutex_lock(&poolShared[cls].mutex);
+	put_chain(poolShared[cls].free, chain, got);
+	pthread_mutex_unlock(&poolShared[cls].mutex);
+}
+
+void *malloc_large(tw_size nbytes) {
+	pool_hdr *h = (pool_hdr *) ::malloc(nbytes + POOL_HDR_SIZE);
+	if(!h) return NULL;
+	h->cls = POOL_LARGE_CLASS;
+	h->magic = POOL_MAGIC;
+	h->size = nbytes;
+	return chunk_of(h);
+}
+
+}
+
+void *Alloc_Pool::malloc(tw_size nbytes) {
+	if(nbytes > TW_POOL_MAX_CHUNK)
+		return malloc_large(nbytes);
+	int cls = class_of(nbytes);
+	pool_threadcache *c = get_cache();
+	if(!c) return NULL;
+	pool_list &l = c->lists[cls];
+	if(!l.head && !refill(c, cls))
+		return NULL;
+	pool_chunk *ret = l.head;
+	l.head = ret->next;
+	l.count--;
+	return ret;
+}
+
+void *Alloc_Pool::calloc(tw_size nelem, tw_size elemsize) {
+	tw_size n = nelem * elemsize;
+	void *ret = Alloc_Pool::malloc(n);
+	if(ret) ::memset(ret, 0, n);
+	return ret;
+}
+
+void *Alloc_Pool::realloc(void *d, tw_size s) {
+	if(!d) return Alloc_Pool::malloc(s);
+	if(s == 0) {
+		Alloc_Pool::free(d);
+		return NULL;
+	}
+	pool_hdr *h = hdr_of(d);
+	if(h->cls == POOL_LARGE_CLASS) {
+		if(s > TW_POOL_MAX_CHUNK) {
+			h = (pool_hdr *) ::realloc(h, s + POOL_HDR_SIZE);
+			if(!h) return NULL;
+			h->size = s;
+			return chunk_of(h);
+		}
+	} else if(s <= class_size(h->cls))
+		return d; // still fits
+	void *ret = Alloc_Pool::malloc(s);
+	if(!ret) return NULL;
+	tw_size old = usableSize(d);
+	::memcpy(ret, d, (old < s) ? old : s);
+	Alloc_Pool::free(d);
+	return ret;
+}
+
+void Alloc_Pool::free(void *p) {
+	if(!p) return;
+	pool_hdr *h = hdr_of(p);
+	if(h->cls == POOL_LARGE_CLASS) {
+		::free(h);
+		return;
+	}
+	int cls = h->cls;
+	pool_threadcache *c = get_cache();
+	if(!c) { // no thread cache - give straight back to the shared pool
+		((pool_chunk *) p)->next = NULL; // a chain of one - 'next' is still the caller's data
+		pthread_mutex_lock(&poolShared[cls].mutex);
+		put_chain(poolShared[cls].free, (pool_chunk *) p, 1);
+		pthread_mutex_unlock(&poolShared[cls].mutex);
+		return;
+	}
+	pool_chunk *chunk = (pool_chunk *) p;
+	pool_list &l = c->lists[cls];
+	chunk->next = l.head;
+	l.head = chunk;
+	l.count++;
+	if(l.count > 2 * class_batch(cls))
+		drain(c, cls);
+}
+
+void Alloc_Pool::releaseThreadCache() {
+	if(poolCache) {
+		pool_threadcache *c = poolCache;
+		pthread_setspecific(poolKey, NULL);
+		pool_thread_exit(c);
+	}
+}
+
+tw_size Alloc_Pool::usableSize(void *p) {
+	pool_hdr *h = hdr_of(p);
+	if(h->cls == POOL_LARGE_CLASS)
+		return h->size;
+	return class_size(h->cls);
+}
+
+size_t Alloc_Pool::slabBytes() {
+	size_t ret = 0;
+	pthread_once(&poolOnce, pool_init);
+	for(int n=0;n<TW_POOL_NUM_CLASSES;n++) {
+		pthread_mutex_lock(&poolShared[n].mutex);
+		ret += poolShared[n].slabBytes;
+		pthread_mutex_unlock(&poolShared[n].mutex);
+	}
+	return ret;
+}
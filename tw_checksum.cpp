@@ -0,0 +1,296 @@
+// tupperware container lib
+// tw_checksum.cpp
+
+#include <pthread.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <TW/tw_checksum.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define TW_CRC32C_X86 1
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define TW_CRC32C_ARM64 1
+#endif
+
+using namespace TWlib;
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////
+// CRC32C - table version (slicing by 8)
+
+#define CRC32C_POLY 0x82F63B78 // reflected Castagnoli polynomial
+
+uint32_t crc_table[8][256];
+pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+void make_crc_table() {
+	for(int n=0;n<256;n++) {
+		uint32_t c = n;
+		for(int k=0;k<8;k++)
+			c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : (c >> 1);
+		crc_table[0][n] = c;
+	}
+	for(int n=0;n<256;n++) {
+		uint32_t c = crc_table[0][n];
+		for(int t=1;t<8;t++) {
+			c = crc_table[0][c & 0xFF] ^ (c >> 8);
+			crc_table[t][n] = c;
+		}
+	}
+}
+
+inline uint64_t read64le( const unsigned char *p ) {
+	uint64_t v;
+	memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+inline uint32_t read32le( const unsigned char *p ) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+uint32_t crc32c_table( uint32_t crc, const void *data, size_t len ) {
+	pthread_once(&crc_table_once, make_crc_table);
+	const unsigned char *p = (const unsigned char *) data;
+	uint32_t c = ~crc;
+	while(len && ((uintptr_t) p & 7)) {
+		c = crc_table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+		len--;
+	}
+	while(len >= 8) {
+		uint64_t v = read64le(p) ^ c;
+		c = crc_table[7][v & 0xFF] ^ crc_table[6][(v >> 8) & 0xFF] ^
+			crc_table[5][(v >> 16) & 0xFF] ^ crc_table[4][(v >> 24) & 0xFF] ^
+			crc_table[3][(v >> 32) & 0xFF] ^ crc_table[2][(v >> 40) & 0xFF] ^
+			crc_table[1][(v >> 48) & 0xFF] ^ crc_table[0][v >> 56];
+		p += 8;
+		len -= 8;
+	}
+	while(len--)
+		c = crc_table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+	return ~c;
+}
+
+///////////////////////////////////////////////////////////////////////
+// CRC32C - CPU instructions
+
+#ifdef TW_CRC32C_X86
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw( uint32_t crc, const void *data, size_t len ) {
+	const unsigned char *p = (const unsigned char *) data;
+	uint32_t c = ~crc;
+	while(len && ((uintptr_t) p & 7)) {
+		c = _mm_crc32_u8(c, *p++);
+		len--;
+	}
+#ifdef __x86_64__
+	uint64_t c64 = c;
+	while(len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		c64 = _mm_crc32_u64(c64, v);
+		p += 8;
+		len -= 8;
+	}
+	c = (uint32_t) c64;
+#endif
+	while(len >= 4) {
+		uint32_t v;
+		memcpy(&v, p, 4);
+		c = _mm_crc32_u32(c, v);
+		p += 4;
+		len -= 4;
+	}
+	while(len--)
+		c = _mm_crc32_u8(c, *p++);
+	return ~c;
+}
+
+bool have_crc_hw() {
+	return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(TW_CRC32C_ARM64)
+__attribute__((target("+crc")))
+uint32_t crc32c_hw( uint32_t crc, const void *data, size_t len ) {
+	const unsigned char *p = (const unsigned char *) data;
+	uint32_t c = ~crc;
+	while(len && ((uintptr_t) p & 7)) {
+		c = __crc32cb(c, *p++);
+		len--;
+	}
+	while(len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		c = __crc32cd(c, v);
+		p += 8;
+		len -= 8;
+	}
+	while(len--)
+		c = __crc32cb(c, *p++);
+	return ~c;
+}
+
+bool have_crc_hw() {
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+#endif
+
+typedef uint32_t (*crc_func)( uint32_t, const void *, size_t );
+
+crc_func pick_crc() {
+#if defined(TW_CRC32C_X86) || defined(TW_CRC32C_ARM64)
+	if(have_crc_hw())
+		return crc32c_hw;
+#endif
+	return crc32c_table;
+}
+
+crc_func crc_impl() {
+	static crc_func f = pick_crc();
+	return f;
+}
+
+///////////////////////////////////////////////////////////////////////
+// hash64 (XXH64)
+
+const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t P3 = 0x165667B19E3779F9ULL;
+const uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl64( uint64_t x, int r ) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t round64( uint64_t acc, uint64_t in ) {
+	acc += in * P2;
+	acc = rotl64(acc, 31);
+	return acc * P1;
+}
+
+inline uint64_t merge64( uint64_t acc, uint64_t v ) {
+	acc ^= round64(0, v);
+	return acc * P1 + P4;
+}
+
+// consumes whole 32 byte stripes, returns the bytes used
+inline size_t stripes( uint64_t *v, const unsigned char *p, size_t len ) {
+	const unsigned char *start = p;
+	uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+	while(len >= 32) {
+		v1 = round64(v1, read64le(p));
+		v2 = round64(v2, read64le(p + 8));
+		v3 = round64(v3, read64le(p + 16));
+		v4 = round64(v4, read64le(p + 24));
+		p += 32;
+		len -= 32;
+	}
+	v[0] = v1; v[1] = v2; v[2] = v3; v[3] = v4;
+	return p - start;
+}
+
+}
+
+uint32_t TWlib::tw_crc32c( uint32_t crc, const void *data, size_t len ) {
+	return crc_impl()(crc, data, len);
+}
+
+uint32_t TWlib::tw_crc32c_sw( uint32_t crc, const void *data, size_t len ) {
+	return crc32c_table(crc, data, len);
+}
+
+bool TWlib::tw_crc32c_hw() {
+	return crc_impl() != crc32c_table;
+}
+
+void TWlib::tw_hash64_init( tw_hash64_state &s, uint64_t seed ) {
+	s.v[0] = seed + P1 + P2;
+	s.v[1] = seed + P2;
+	s.v[2] = seed;
+	s.v[3] = seed - P1;
+	s.total = 0;
+	s.seed = seed;
+	s.memsize = 0;
+}
+
+void TWlib::tw_hash64_update( tw_hash64_state &s, const void *data, size_t len ) {
+	const unsigned char *p = (const unsigned char *) data;
+	s.total += len;
+	if(s.memsize) { // finish the stripe left over from the last update
+		size_t fill = 32 - s.memsize;
+		if(len < fill) {
+			memcpy(s.mem + s.memsize, p, len);
+			s.memsize += (int) len;
+			return;
+		}
+		memcpy(s.mem + s.memsize, p, fill);
+		stripes(s.v, s.mem, 32);
+		p += fill;
+		len -= fill;
+		s.memsize = 0;
+	}
+	size_t used = stripes(s.v, p, len);
+	p += used;
+	len -= used;
+	if(len) {
+		memcpy(s.mem, p, len);
+		s.memsize = (int) len;
+	}
+}
+
+uint64_t TWlib::tw_hash64_final( tw_hash64_state &s ) {
+	uint64_t h;
+	if(s.total >= 32) {
+		h = rotl64(s.v[0], 1) + rotl64(s.v[1], 7) + rotl64(s.v[2], 12) + rotl64(s.v[3], 18);
+		h = merge64(h, s.v[0]);
+		h = merge64(h, s.v[1]);
+		h = merge64(h, s.v[2]);
+		h = merge64(h, s.v[3]);
+	} else
+		h = s.seed + P5;
+	h += s.total;
+	const unsigned char *p = s.mem;
+	int len = s.memsize;
+	while(len >= 8) {
+		h ^= round64(0, read64le(p));
+		h = rotl64(h, 27) * P1 + P4;
+		p += 8;
+		len -= 8;
+	}
+	if(len >= 4) {
+		h ^= (uint64_t) read32le(p) * P1;
+		h = rotl64(h, 23) * P2 + P3;
+		p += 4;
+		len -= 4;
+	}
+	while(len--) {
+		h ^= (*p++) * P5;
+		h = rotl64(h, 11) * P1;
+	}
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t TWlib::tw_hash64( const void *data, size_t len, uint64_t seed ) {
+	tw_hash64_state s;
+	tw_hash64_init(s, seed);
+	tw_hash64_update(s, data, len);
+	return tw_hash64_final(s);
+}
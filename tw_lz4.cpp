@@ -0,0 +1,157 @@
+// tupperware container lib
+// tw_lz4.cpp
+
+#include <string.h>
+#include <stdint.h>
+
+#include <TW/tw_lz4.h>
+
+using namespace TWlib;
+
+namespace {
+
+#define LZ4_MINMATCH 4
+#define LZ4_LASTLITERALS 5   // the last 5 bytes are always literals
+#define LZ4_MFLIMIT 12       // a match can't start in the last 12 bytes
+#define LZ4_MAXOFFSET 65535
+#define LZ4_HASHLOG 12
+
+inline uint32_t read32( const unsigned char *p ) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+inline uint32_t hash32( uint32_t v ) {
+	return (v * 2654435761U) >> (32 - LZ4_HASHLOG);
+}
+
+// writes the 255 run length extension for a length which didn't fit its token nibble
+inline unsigned char *putLength( unsigned char *op, int len ) {
+	while(len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (unsigned char) len;
+	return op;
+}
+
+// emits one sequence: literals [anchor, anchor+lit) then a match (or none if mlen == 0, the last sequence)
+// returns NULL if it does not fit before oend
+inline unsigned char *putSequence( unsigned char *op, unsigned char *oend, const unsigned char *anchor, int lit, int offset, int mlen ) {
+	int need = 1 + lit + (lit / 255) + 1 + (mlen ? 2 + (mlen / 255) + 1 : 0);
+	if(op + need > oend) return NULL;
+	unsigned char *token = op++;
+	int ml = mlen ? mlen - LZ4_MINMATCH : 0;
+	*token = (unsigned char) (((lit >= 15) ? 15 : lit) << 4);
+	if(lit >= 15)
+		op = putLength(op, lit - 15);
+	memcpy(op, anchor, lit);
+	op += lit;
+	if(mlen) {
+		*op++ = (unsigned char) (offset & 0xFF);
+		*op++ = (unsigned char) (offset >> 8);
+		*token |= (unsigned char) ((ml >= 15) ? 15 : ml);
+		if(ml >= 15)
+			op = putLength(op, ml - 15);
+	}
+	return op;
+}
+
+}
+
+int TWlib::tw_lz4_compress( const char *src, int len, char *dst, int cap ) {
+	const unsigned char *base = (const unsigned char *) src;
+	const unsigned char *ip = base;
+	const unsigned char *anchor = base;
+	const unsigned char *iend = base + len;
+	unsigned char *op = (unsigned char *) dst;
+	unsigned char *oend = op + cap;
+	if(len < 0) return 0;
+	if(len > LZ4_MFLIMIT) {
+		const unsigned char *mflimit = iend - LZ4_MFLIMIT;
+		const unsigned char *matchlimit = iend - LZ4_LASTLITERALS;
+		int table[1 << LZ4_HASHLOG];
+		memset(table, 0xFF, sizeof(table)); // -1: empty
+		int misses = 0;
+		while(ip < mflimit) {
+			uint32_t seq = read32(ip);
+			uint32_t h = hash32(seq);
+			int ref = table[h];
+			table[h] = (int) (ip - base);
+			if(ref < 0 || (ip - base) - ref > LZ4_MAXOFFSET || read32(base + ref) != seq) {
+				ip += 1 + (misses++ >> 6); // skip faster through data which doesn't compress
+				continue;
+			}
+			misses = 0;
+			const unsigned char *match = base + ref;
+			// extend backwards over literals, then forwards
+			while(ip > anchor && match > base && ip[-1] == match[-1]) {
+				ip--;
+				match--;
+			}
+			int mlen = LZ4_MINMATCH;
+			while(ip + mlen < matchlimit && ip[mlen] == match[mlen])
+				mlen++;
+			op = putSequence(op, oend, anchor, (int) (ip - anchor), (int) (ip - match), mlen);
+			if(!op) return 0;
+			ip += mlen;
+			anchor = ip;
+			if(ip < mflimit) // the position just before helps the next search
+				table[hash32(read32(ip - 2))] = (int) (ip - 2 - base);
+		}
+	}
+	op = putSequence(op, oend, anchor, (int) (iend - anchor), 0, 0);
+	if(!op) return 0;
+	return (int) (op - (unsigned char *) dst);
+}
+
+int TWlib::tw_lz4_decompress( const char *src, int len, char *dst, int cap ) {
+	const unsigned char *ip = (const unsigned char *) src;
+	const unsigned char *iend = ip + len;
+	unsigned char *op = (unsigned char *) dst;
+	unsigned char *oend = op + cap;
+	if(len <= 0) return -1;
+	while(1) {
+		unsigned int token = *ip++;
+		size_t lit = token >> 4;
+		if(lit == 15) {
+			unsigned int b;
+			do {
+				if(ip >= iend) return -1;
+				b = *ip++;
+				lit += b;
+			} while(b == 255);
+		}
+		if(lit > (size_t) (iend - ip) || lit > (size_t) (oend - op)) return -1;
+		memcpy(op, ip, lit);
+		ip += lit;
+		op += lit;
+		if(ip == iend) break; // the last sequence has no match
+		if(iend - ip < 2) return -1;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > (size_t) (op - (unsigned char *) dst)) return -1;
+		size_t mlen = token & 15;
+		if(mlen == 15) {
+			unsigned int b;
+			do {
+				if(ip >= iend) return -1;
+				b = *ip++;
+				mlen += b;
+			} while(b == 255);
+		}
+		mlen += LZ4_MINMATCH;
+		if(mlen > (size_t) (oend - op)) return -1;
+		const unsigned char *match = op - offset;
+		if(offset >= mlen) {
+			memcpy(op, match, mlen);
+			op += mlen;
+		} else {
+			while(mlen--) // overlapping - repeats the pattern
+				*op++ = *match++;
+		}
+		if(ip >= iend) return -1; // a match can't end the block
+	}
+	return (int) (op - (unsigned char *) dst);
+}
@@ -17,6 +17,10 @@
 #include <sstream>
 #include <iostream>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 struct timeval* TWlib::usec_to_timeval( int64_t usec, struct timeval* tv ) {
 	tv->tv_sec = usec / 1000000 ;
 	tv->tv_usec = usec % 1000000 ;
@@ -86,6 +90,87 @@ string &TWlib::hexDumpToString(char *head, int size, string &out) {
 	return out;
 }
 
+namespace {
+// "00" .. "FF" - two chars per byte value
+const char hex_pairs[513] =
+	"000102030405060708090A0B0C0D0E0F"
+	"101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F"
+	"303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F"
+	"505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F"
+	"707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F"
+	"909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+	"B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+	"D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+	"F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+}
+
+/**
+ * Writes 'len' bytes as upper case hex, two chars per byte. 'out' needs room for 2 * len chars.
+ * Uses SSE2 16 bytes at a time where available. Nothing is allocated, and the output is not NUL terminated.
+ * @return the end of what was written
+ */
+char *TWlib::tw_hex_encode( char *out, const void *in, int len ) {
+	const unsigned char *p = (const unsigned char *) in;
+	int n = 0;
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i af = _mm_set1_epi8('A' - '0' - 10);
+	for(;n + 16 <= len;n += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (p + n));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i lo = _mm_and_si128(v, mask);
+		// nibble -> '0'..'9', 'A'..'F'
+		hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), af));
+		lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), af));
+		_mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi8(hi, lo));
+		out += 32;
+	}
+#endif
+	for(;n < len;n++) {
+		memcpy(out, hex_pairs + 2 * p[n], 2);
+		out += 2;
+	}
+	return out;
+}
+
+/**
+ * Writes 'len' bytes as upper case hex, separated by 'sep': "0A,1B,FF". 'out' needs room for 3 * len - 1 chars.
+ * 16 bytes at a time are encoded w/ tw_hex_encode(), then spread out w/ the separators in between.
+ * @return the end of what was written (not NUL terminated)
+ */
+char *TWlib::tw_hex_encode_sep( char *out, const void *in, int len, char sep ) {
+	const unsigned char *p = (const unsigned char *) in;
+	if(len <= 0)
+		return out;
+	int n = 0;
+	char pairs[32];
+	for(;n + 16 < len;n += 16) { // '<' - the last byte has no separator after it
+		tw_hex_encode(pairs, p + n, 16);
+		for(int x=0;x<16;x++) {
+			memcpy(out, pairs + 2 * x, 2);
+			out[2] = sep;
+			out += 3;
+		}
+	}
+	for(;n<len - 1;n++) {
+		memcpy(out, hex_pairs + 2 * p[n], 2);
+		out[2] = sep;
+		out += 3;
+	}
+	memcpy(out, hex_pairs + 2 * p[len - 1], 2);
+	return out + 2;
+}
+
 namespace TWlib {
 	TWlib::TW_Mutex string_conf_mutex;
 	char string_conv_buf[MAX_STRING_CNV_BUF];